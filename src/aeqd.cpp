@@ -0,0 +1,68 @@
+#include "aeqd.h"
+#include "geo_metrics.h"
+#include <geodesic.h>
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr double kPi = 3.141592653589793238462643383279502884;
+static double deg2rad(double d) { return d * (kPi / 180.0); }
+
+static const geod_geodesic& wgs84_geodesic() {
+  static const geod_geodesic g = [] {
+    geod_geodesic init;
+    geod_init(&init, 6378137.0, 1.0 / 298.257223563);
+    return init;
+  }();
+  return g;
+}
+
+void AeqdProjection::set_center(double lat_deg, double lon_deg) {
+  lat0_ = lat_deg;
+  lon0_ = lon_deg;
+  sin_lat0_ = std::sin(deg2rad(lat_deg));
+  cos_lat0_ = std::cos(deg2rad(lat_deg));
+}
+
+void AeqdProjection::forward(std::size_t n, double* x, double* y) const {
+  const auto& g = wgs84_geodesic();
+  for (std::size_t i = 0; i < n; ++i) {
+    double s, azi1, azi2;
+    geod_inverse(&g, lat0_, lon0_, y[i], x[i], &s, &azi1, &azi2);
+    const double a = deg2rad(azi1);
+    x[i] = s * std::sin(a);
+    y[i] = s * std::cos(a);
+  }
+}
+
+double AeqdProjection::forward_sphere(std::size_t n, double* x, double* y) const {
+  double rmax = 0.0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const double phi = deg2rad(y[i]), dlam = deg2rad(x[i] - lon0_);
+    const double sp = std::sin(phi), cp = std::cos(phi);
+    const double sl = std::sin(dlam), cl = std::cos(dlam);
+    // Unit direction components and the central angle c.
+    const double e = cp * sl;
+    const double nth = cos_lat0_ * sp - sin_lat0_ * cp * cl;
+    const double sin_c = std::hypot(e, nth);
+    const double cos_c = sin_lat0_ * sp + cos_lat0_ * cp * cl;
+    const double r = kEarthMeanRadiusM * std::atan2(sin_c, cos_c);
+    const double k = sin_c > 0.0 ? r / sin_c : kEarthMeanRadiusM;
+    x[i] = k * e;
+    y[i] = k * nth;
+    rmax = std::max(rmax, r);
+  }
+  return rmax;
+}
+
+void AeqdProjection::inverse(double x, double y, double& lon_deg, double& lat_deg) const {
+  const double s = std::hypot(x, y);
+  if (s == 0.0) {
+    lon_deg = lon0_;
+    lat_deg = lat0_;
+    return;
+  }
+  double azi2;
+  geod_direct(&wgs84_geodesic(), lat0_, lon0_, std::atan2(x, y) * (180.0 / kPi), s,
+              &lat_deg, &lon_deg, &azi2);
+}
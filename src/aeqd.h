@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+
+// Azimuthal equidistant projection centred on a query point, evaluated in
+// process instead of through a per-query PROJ pipeline. Setting the centre
+// only caches a few sines and cosines.
+//
+// forward()/inverse() are exact on the WGS84 ellipsoid: a point maps to
+// (s sin(azi), s cos(azi)) where s and azi are the geodesic distance and
+// azimuth from the centre (Karney's algorithm, PROJ's geodesic.h -- the
+// same thing PROJ's own +proj=aeqd does on the ellipsoid). Distances from the
+// origin are therefore exact geodesic distances.
+//
+// forward_sphere() is the spherical projection: a handful of trig calls per
+// point, used to rule candidates out before paying for the exact one.
+class AeqdProjection {
+public:
+  void set_center(double lat_deg, double lon_deg);
+
+  // In place: x holds longitudes and y latitudes (degrees) on input, metres
+  // on output.
+  void forward(std::size_t n, double* x, double* y) const;
+  // Returns the largest distance from the origin among the n points.
+  double forward_sphere(std::size_t n, double* x, double* y) const;
+
+  void inverse(double x, double y, double& lon_deg, double& lat_deg) const;
+
+private:
+  double lat0_ = 0.0, lon0_ = 0.0;   // degrees
+  double sin_lat0_ = 0.0, cos_lat0_ = 1.0;
+};
+
+// A point's forward_sphere() position lies within this fraction of its
+// distance from the origin of its forward() position (flattening changes
+// distance and azimuth by at most ~0.6% between them).
+inline constexpr double kAeqdSphereError = 0.01;
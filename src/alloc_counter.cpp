@@ -0,0 +1,51 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global (non-aligned) operator new/delete with malloc/free plus
+// a relaxed counter, so "distance --profile" can report how many heap
+// allocations a query made. The counter is only written while counting is on. Aligned and sized variants keep their library defaults; the
+// sized deletes forward to free() through the unsized ones.
+
+static std::atomic<uint64_t> g_allocs{0};
+static std::atomic<bool> g_counting{false};
+
+uint64_t alloc_count() {
+  return g_allocs.load(std::memory_order_relaxed);
+}
+
+void count_allocations(bool on) {
+  g_counting.store(on, std::memory_order_relaxed);
+}
+
+static void* counted_alloc(std::size_t n) {
+  if (g_counting.load(std::memory_order_relaxed)) g_allocs.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(n ? n : 1);
+}
+
+void* operator new(std::size_t n) {
+  if (void* p = counted_alloc(n)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t n) {
+  if (void* p = counted_alloc(n)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+  return counted_alloc(n);
+}
+
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept {
+  return counted_alloc(n);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+// Number of global operator new calls in this process (all threads) while
+// counting was on. Counted by the replacement operators in alloc_counter.cpp,
+// which is linked into the dist2land and dist2land_bench executables only
+// (allocations inside the Windows GDAL plugin are not seen).
+uint64_t alloc_count();
+
+// Turns counting on or off; it starts off. While off, operator new only
+// reads a flag, so worker threads never write a shared counter. dist2land
+// turns it on for --profile, dist2land_bench always.
+void count_allocations(bool on);
@@ -31,3 +31,15 @@ std::filesystem::path provider_dir(const std::string& provider_id) {
 std::filesystem::path downloads_dir() {
   return cache_root_dir() / "downloads";
 }
+
+std::filesystem::path coast_index_path(const std::string& provider_id) {
+  return provider_dir(provider_id) / "coastline.idx";
+}
+
+std::filesystem::path provider_source_path(const std::string& provider_id) {
+  return provider_dir(provider_id) / "source.ini";
+}
+
+std::filesystem::path provider_manifest_path(const std::string& provider_id) {
+  return provider_dir(provider_id) / "manifest.ini";
+}
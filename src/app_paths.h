@@ -1,6 +1,16 @@
 #pragma once
 #include <filesystem>
+#include <string>
 
 std::filesystem::path cache_root_dir();
 std::filesystem::path provider_dir(const std::string& provider_id);
 std::filesystem::path downloads_dir();
+
+// Compiled coastline index for a provider (see coast_index.h).
+std::filesystem::path coast_index_path(const std::string& provider_id);
+
+// What setup downloaded for a provider (see ProviderSource in providers.h).
+std::filesystem::path provider_source_path(const std::string& provider_id);
+
+// Where setup found a provider's shapefile (see ProviderManifest).
+std::filesystem::path provider_manifest_path(const std::string& provider_id);
@@ -1,6 +1,8 @@
 #include "archive_extract.h"
 #include <archive.h>
 #include <archive_entry.h>
+#include <cerrno>
+#include <exception>
 #include <stdexcept>
 #include <filesystem>
 #include <string>
@@ -9,47 +11,100 @@ static void throw_arch(const std::string& where, struct archive* a) {
   throw std::runtime_error(where + ": " + (archive_error_string(a) ? archive_error_string(a) : "unknown"));
 }
 
-void extract_zip(const std::filesystem::path& zip_file, const std::filesystem::path& out_dir) {
-  std::filesystem::create_directories(out_dir);
-
+namespace {
+// Reader and disk writer, freed on every path out.
+struct Extraction {
   struct archive* a = archive_read_new();
-  archive_read_support_filter_all(a);
-  archive_read_support_format_all(a);
+  struct archive* ext = archive_write_disk_new();
+
+  Extraction() {
+    archive_read_support_filter_all(a);
+    archive_read_support_format_all(a);
+    archive_write_disk_set_options(ext, ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM | ARCHIVE_EXTRACT_ACL | ARCHIVE_EXTRACT_FFLAGS);
+    archive_write_disk_set_standard_lookup(ext);
+  }
+  ~Extraction() {
+    archive_write_free(ext);
+    archive_read_free(a);
+  }
+  Extraction(const Extraction&) = delete;
+  Extraction& operator=(const Extraction&) = delete;
 
-  if (archive_read_open_filename(a, zip_file.string().c_str(), 10240) != ARCHIVE_OK)
-    throw_arch("archive_read_open_filename", a);
+  void run(const std::filesystem::path& out_dir, const ArchiveEntryFilter& want) {
+    struct archive_entry* entry;
+    int r;
+    while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK || r == ARCHIVE_WARN) {
+      const char* p = archive_entry_pathname(entry);
+      if (!p || (want && !want(p))) { archive_read_data_skip(a); continue; }
 
-  struct archive* ext = archive_write_disk_new();
-  archive_write_disk_set_options(ext, ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM | ARCHIVE_EXTRACT_ACL | ARCHIVE_EXTRACT_FFLAGS);
-  archive_write_disk_set_standard_lookup(ext);
-
-  struct archive_entry* entry;
-  while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
-    const char* p = archive_entry_pathname(entry);
-    if (!p) { archive_read_data_skip(a); continue; }
-
-    auto full = out_dir / std::filesystem::path(p);
-    archive_entry_set_pathname(entry, full.string().c_str());
-
-    int r = archive_write_header(ext, entry);
-    if (r != ARCHIVE_OK) {
-      // Some entries might be directories; keep going if not fatal.
-    } else {
-      const void* buff;
-      size_t size;
-      la_int64_t offset;
-      while (true) {
-        int rr = archive_read_data_block(a, &buff, &size, &offset);
-        if (rr == ARCHIVE_EOF) break;
-        if (rr != ARCHIVE_OK) throw_arch("archive_read_data_block", a);
-        if (archive_write_data_block(ext, buff, size, offset) != ARCHIVE_OK) throw_arch("archive_write_data_block", ext);
+      auto full = out_dir / std::filesystem::path(p);
+      archive_entry_set_pathname(entry, full.string().c_str());
+
+      int w = archive_write_header(ext, entry);
+      if (w != ARCHIVE_OK) {
+        // Some entries might be directories; keep going if not fatal.
+      } else {
+        const void* buff;
+        size_t size;
+        la_int64_t offset;
+        while (true) {
+          int rr = archive_read_data_block(a, &buff, &size, &offset);
+          if (rr == ARCHIVE_EOF) break;
+          if (rr != ARCHIVE_OK) throw_arch("archive_read_data_block", a);
+          if (archive_write_data_block(ext, buff, size, offset) != ARCHIVE_OK) throw_arch("archive_write_data_block", ext);
+        }
       }
+      archive_write_finish_entry(ext);
     }
-    archive_write_finish_entry(ext);
+    if (r != ARCHIVE_EOF) throw_arch("archive_read_next_header", a);
+
+    archive_write_close(ext);
+    archive_read_close(a);
+  }
+};
+
+struct StreamSource {
+  const ArchiveBlockReader* next;
+  std::exception_ptr error;
+};
+
+la_ssize_t stream_read(struct archive* a, void* client, const void** buff) {
+  auto* s = static_cast<StreamSource*>(client);
+  try {
+    return (la_ssize_t)(*s->next)(buff);
+  } catch (...) {
+    // Exceptions must not cross libarchive; rethrown once it returns.
+    s->error = std::current_exception();
+    archive_set_error(a, EIO, "read failed");
+    return -1;
   }
+}
+} // namespace
+
+void extract_zip(const std::filesystem::path& zip_file, const std::filesystem::path& out_dir,
+                 const ArchiveEntryFilter& want) {
+  std::filesystem::create_directories(out_dir);
 
-  archive_write_close(ext);
-  archive_write_free(ext);
-  archive_read_close(a);
-  archive_read_free(a);
+  Extraction x;
+  if (archive_read_open_filename(x.a, zip_file.string().c_str(), 10240) != ARCHIVE_OK)
+    throw_arch("archive_read_open_filename", x.a);
+  x.run(out_dir, want);
+}
+
+void extract_archive_stream(const ArchiveBlockReader& next, const std::filesystem::path& out_dir,
+                            const ArchiveEntryFilter& want) {
+  std::filesystem::create_directories(out_dir);
+
+  Extraction x;
+  StreamSource src{&next, nullptr};
+  try {
+    // No seek callback: libarchive reads zips from the local headers instead
+    // of the central directory at the end.
+    if (archive_read_open(x.a, &src, nullptr, stream_read, nullptr) != ARCHIVE_OK)
+      throw_arch("archive_read_open", x.a);
+    x.run(out_dir, want);
+  } catch (...) {
+    if (src.error) std::rethrow_exception(src.error);
+    throw;
+  }
 }
@@ -1,4 +1,21 @@
 #pragma once
+#include <cstddef>
 #include <filesystem>
+#include <functional>
+#include <string>
 
-void extract_zip(const std::filesystem::path& zip_file, const std::filesystem::path& out_dir);
+// Decides from an entry's path inside the archive whether to extract it.
+using ArchiveEntryFilter = std::function<bool(const std::string& entry_path)>;
+
+// Points *data at the next block of archive bytes and returns its size, 0 at
+// the end. May throw; the exception is passed on to the caller.
+using ArchiveBlockReader = std::function<std::size_t(const void** data)>;
+
+// Extracts the entries `want` accepts (all if it is empty) under out_dir.
+void extract_zip(const std::filesystem::path& zip_file, const std::filesystem::path& out_dir,
+                 const ArchiveEntryFilter& want = {});
+
+// Same, but reads the archive front to back from `next` as it arrives (e.g.
+// from an HttpStream), so it never has to exist as a file.
+void extract_archive_stream(const ArchiveBlockReader& next, const std::filesystem::path& out_dir,
+                            const ArchiveEntryFilter& want = {});
@@ -0,0 +1,506 @@
+#include "batch.h"
+#include "geo_metrics.h"
+#include "json_scan.h"
+#include "result_format.h"
+#include "track.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct BatchRecord {
+  std::size_t line = 0;
+  double lat = std::numeric_limits<double>::quiet_NaN();
+  double lon = std::numeric_limits<double>::quiet_NaN();
+  std::string id_json;   // raw JSON value echoed back as "id" (json output only)
+  std::string error;     // non-empty if the record could not be parsed
+};
+
+bool is_blank(const std::string& s) {
+  for (unsigned char c : s) if (!std::isspace(c)) return false;
+  return true;
+}
+
+std::string trim_copy(const std::string& s) {
+  size_t b = 0, e = s.size();
+  while (b < e && std::isspace((unsigned char)s[b])) ++b;
+  while (e > b && std::isspace((unsigned char)s[e - 1])) --e;
+  return s.substr(b, e - b);
+}
+
+// ------------------------- CSV -------------------------
+
+// Fields are separated by ',', ';' or tabs; a line with none of those is
+// split on spaces. Quoted fields with embedded separators are not supported.
+std::vector<std::string> split_fields(const std::string& line) {
+  const bool has_sep = line.find_first_of(",;\t") != std::string::npos;
+  std::vector<std::string> out;
+  std::string cur;
+  for (char c : line) {
+    const bool sep = has_sep ? (c == ',' || c == ';' || c == '\t') : (c == ' ');
+    if (sep) {
+      if (has_sep || !cur.empty()) out.push_back(trim_copy(cur));
+      cur.clear();
+    } else {
+      cur.push_back(c);
+    }
+  }
+  if (has_sep || !cur.empty()) out.push_back(trim_copy(cur));
+  return out;
+}
+
+int find_column(const std::vector<std::string>& names, std::initializer_list<const char*> want) {
+  for (size_t i = 0; i < names.size(); ++i) {
+    auto n = to_lower(names[i]);
+    if (n.size() >= 2 && n.front() == '"' && n.back() == '"') n = n.substr(1, n.size() - 2);
+    for (const char* w : want) {
+      if (n == w) return (int)i;
+    }
+  }
+  return -1;
+}
+
+// ------------------------- NDJSON -------------------------
+
+bool key_is(const std::string& key, std::initializer_list<const char*> want) {
+  const auto k = to_lower(key);
+  for (const char* w : want) if (k == w) return true;
+  return false;
+}
+
+void parse_ndjson_record(const std::string& line, BatchRecord& rec) {
+  JsonObjectScanner sc(line);
+  bool have_lat = false, have_lon = false;
+  const bool ok = sc.for_each_member([&](const std::string& key, const std::string& raw) {
+    if (key_is(key, {"lat", "lat_deg", "latitude"})) have_lat = parse_number(raw, rec.lat);
+    else if (key_is(key, {"lon", "lon_deg", "lng", "longitude"})) have_lon = parse_number(raw, rec.lon);
+    else if (key_is(key, {"id"})) rec.id_json = raw;
+  });
+  if (!ok) rec.error = "malformed JSON object";
+  else if (!have_lat || !have_lon) rec.error = "missing or non-numeric lat/lon";
+}
+
+// ------------------------- reader -------------------------
+
+class BatchReader {
+public:
+  BatchReader(std::istream& in, const std::string& format) : in_(in), format_(to_lower(format)) {
+    if (!format_.empty() && format_ != "csv" && format_ != "ndjson" && format_ != "jsonl") {
+      throw std::runtime_error("Unknown --format: " + format + " (use csv|ndjson)");
+    }
+    if (format_ == "jsonl") format_ = "ndjson";
+  }
+
+  bool next(BatchRecord& rec) {
+    std::string line;
+    while (std::getline(in_, line)) {
+      ++lineno_;
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (is_blank(line)) continue;
+
+      if (format_.empty()) format_ = (trim_copy(line).front() == '{') ? "ndjson" : "csv";
+
+      rec = BatchRecord{};
+      rec.line = lineno_;
+      if (format_ == "ndjson") {
+        parse_ndjson_record(line, rec);
+        return true;
+      }
+      if (parse_csv_record(line, rec)) return true;
+    }
+    return false;
+  }
+
+private:
+  std::istream& in_;
+  std::string format_;
+  std::size_t lineno_ = 0;
+  bool seen_first_csv_ = false;
+  int lat_col_ = 0, lon_col_ = 1, id_col_ = -1;
+
+  // Returns false if the line was a header rather than a record.
+  bool parse_csv_record(const std::string& line, BatchRecord& rec) {
+    auto fields = split_fields(line);
+
+    if (!seen_first_csv_) {
+      seen_first_csv_ = true;
+      double dummy = 0.0;
+      bool any_number = false;
+      for (const auto& f : fields) any_number = any_number || parse_number(f, dummy);
+      if (!any_number) {
+        lat_col_ = find_column(fields, {"lat", "lat_deg", "latitude"});
+        lon_col_ = find_column(fields, {"lon", "lon_deg", "lng", "long", "longitude"});
+        id_col_  = find_column(fields, {"id"});
+        if (lat_col_ < 0 || lon_col_ < 0) {
+          throw std::runtime_error("CSV header at line " + std::to_string(lineno_) +
+                                   " has no lat/lon columns");
+        }
+        return false;
+      }
+    }
+
+    const int need = std::max(lat_col_, lon_col_);
+    if ((int)fields.size() <= need) {
+      rec.error = "expected at least " + std::to_string(need + 1) + " fields";
+      return true;
+    }
+    if (!parse_number(fields[(size_t)lat_col_], rec.lat) ||
+        !parse_number(fields[(size_t)lon_col_], rec.lon)) {
+      rec.error = "non-numeric lat/lon";
+      return true;
+    }
+    if (id_col_ >= 0 && (size_t)id_col_ < fields.size()) {
+      double v = 0.0;
+      auto f = fields[(size_t)id_col_];
+      if (f.size() >= 2 && f.front() == '"' && f.back() == '"') f = f.substr(1, f.size() - 2);
+      const bool plain = f.find_first_not_of("0123456789+-.eE") == std::string::npos;
+      rec.id_json = (plain && parse_number(f, v)) ? f : "\"" + json_escape(f) + "\"";
+    }
+    return true;
+  }
+};
+
+struct BatchAnswer {
+  std::string line;   // output line, always newline-terminated
+  std::string error;  // diagnostic for stderr; empty on success
+};
+
+BatchAnswer error_answer(const BatchRecord& rec, const std::string& msg, const BatchOptions& opt) {
+  BatchAnswer a;
+  a.error = "line " + std::to_string(rec.line) + ": " + msg;
+  if (opt.json) {
+    a.line = "{\"line\":" + std::to_string(rec.line) + ",";
+    if (!rec.id_json.empty()) a.line += "\"id\":" + rec.id_json + ",";
+    a.line += "\"error\":\"" + json_escape(msg) + "\"}\n";
+  } else {
+    a.line = "nan " + to_lower(opt.units) + " nan nan\n";
+  }
+  return a;
+}
+
+// Why `rec` cannot be queried, or null if it can.
+const char* record_problem(const BatchRecord& rec) {
+  if (!rec.error.empty()) return rec.error.c_str();
+  if (!std::isfinite(rec.lat) || rec.lat < -90.0 || rec.lat > 90.0) {
+    return "lat must be in [-90, 90] degrees";
+  }
+  if (!std::isfinite(rec.lon) || rec.lon < -180.0 || rec.lon > 180.0) {
+    return "lon must be in [-180, 180] degrees";
+  }
+  return nullptr;
+}
+
+BatchAnswer result_answer(const BatchRecord& rec, const DistanceQueryResult& r, const BatchOptions& opt) {
+  try {
+    const double d_m = metric_distance_m(opt.metric, rec.lat, rec.lon, r);
+    const double out = convert_units(d_m, opt.units);
+    BatchAnswer a;
+    if (opt.json) {
+      const std::string extra = rec.id_json.empty() ? "" : "\"id\":" + rec.id_json + ",";
+      a.line = format_result_json(rec.lat, rec.lon, out, opt.units, opt.metric, d_m, r, extra);
+    } else {
+      a.line = format_result_text(out, opt.units, r);
+    }
+    return a;
+  } catch (const std::exception& e) {
+    return error_answer(rec, e.what(), opt);
+  }
+}
+
+// Answers one record, through `track` when given. Parse and query errors
+// become error answers rather than exceptions so one bad row never stops the
+// stream (and never moves the track).
+BatchAnswer evaluate(DistanceEngine& engine, const BatchRecord& rec, const BatchOptions& opt,
+                     DistanceTrack* track = nullptr) {
+  if (const char* problem = record_problem(rec)) return error_answer(rec, problem, opt);
+  try {
+    const auto r = track ? track->next(rec.lat, rec.lon) : engine.query(rec.lat, rec.lon);
+    return result_answer(rec, r, opt);
+  } catch (const std::exception& e) {
+    return error_answer(rec, e.what(), opt);
+  }
+}
+
+// Per-worker buffers for evaluate_run, reused between runs.
+struct RunScratch {
+  std::vector<std::size_t> idx;
+  std::vector<double> lat, lon;
+  std::vector<DistanceQueryResult> results;
+  std::vector<std::string> errors;
+};
+
+// Answers records [lo, hi) like evaluate(), querying all the valid ones with
+// a single DistanceEngine::query_many (one plugin call, where there is one).
+void evaluate_run(DistanceEngine& engine, const std::vector<BatchRecord>& recs, std::size_t lo,
+                  std::size_t hi, const BatchOptions& opt, std::vector<BatchAnswer>& answers,
+                  RunScratch& s) {
+  s.idx.clear();
+  s.lat.clear();
+  s.lon.clear();
+  for (std::size_t i = lo; i < hi; ++i) {
+    if (const char* problem = record_problem(recs[i])) {
+      answers[i] = error_answer(recs[i], problem, opt);
+      continue;
+    }
+    s.idx.push_back(i);
+    s.lat.push_back(recs[i].lat);
+    s.lon.push_back(recs[i].lon);
+  }
+  s.results.resize(s.idx.size());
+  s.errors.resize(s.idx.size());
+  engine.query_many(s.idx.size(), s.lat.data(), s.lon.data(), s.results.data(), s.errors.data());
+  for (std::size_t k = 0; k < s.idx.size(); ++k) {
+    const BatchRecord& rec = recs[s.idx[k]];
+    answers[s.idx[k]] = s.errors[k].empty() ? result_answer(rec, s.results[k], opt)
+                                             : error_answer(rec, s.errors[k], opt);
+  }
+}
+
+void emit(const BatchAnswer& a, std::ostream& out, BatchSummary& sum) {
+  out << a.line;
+  ++sum.records;
+  if (!a.error.empty()) {
+    ++sum.errors;
+    std::cerr << a.error << "\n";
+  }
+}
+
+// Per-worker index ranges with stealing: each worker pops short runs from the
+// front of its own range and, once that is empty, steals the back half of
+// another worker's range. Coastal records can cost orders of magnitude more
+// than open-ocean ones, so a static split would leave cores idle.
+class WorkStealingRanges {
+public:
+  explicit WorkStealingRanges(std::size_t workers)
+      : n_(workers), slots_(std::make_unique<Slot[]>(workers)) {}
+
+  void reset(std::size_t count) {
+    for (std::size_t w = 0; w < n_; ++w) {
+      std::lock_guard<std::mutex> lk(slots_[w].m);
+      slots_[w].lo = count * w / n_;
+      slots_[w].hi = count * (w + 1) / n_;
+    }
+  }
+
+  // Next run [lo, hi) of at most `max_run` indices for `worker`.
+  bool next(std::size_t worker, std::size_t max_run, std::size_t& lo, std::size_t& hi) {
+    {
+      Slot& own = slots_[worker];
+      std::lock_guard<std::mutex> lk(own.m);
+      if (own.lo < own.hi) {
+        lo = own.lo;
+        hi = std::min(own.hi, lo + max_run);
+        own.lo = hi;
+        return true;
+      }
+    }
+    for (std::size_t k = 1; k < n_; ++k) {
+      Slot& victim = slots_[(worker + k) % n_];
+      std::size_t b = 0, e = 0;
+      {
+        std::lock_guard<std::mutex> lk(victim.m);
+        const std::size_t left = victim.hi - victim.lo;
+        if (left == 0) continue;
+        e = victim.hi;
+        b = e - (left + 1) / 2;
+        victim.hi = b;
+      }
+      Slot& own = slots_[worker];
+      std::lock_guard<std::mutex> lk(own.m);
+      lo = b;
+      hi = std::min(e, b + max_run);
+      own.lo = hi;
+      own.hi = e;
+      return true;
+    }
+    return false;
+  }
+
+private:
+  struct alignas(64) Slot {
+    std::mutex m;
+    std::size_t lo = 0, hi = 0;
+  };
+  std::size_t n_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+// Persistent workers, one per engine, answering one block of records at a time.
+class BatchWorkers {
+public:
+  BatchWorkers(const std::vector<DistanceEngine*>& engines, const BatchOptions& opt)
+      : engines_(engines), opt_(opt), ranges_(engines.size()) {
+    for (std::size_t w = 0; w < engines_.size(); ++w) {
+      threads_.emplace_back([this, w] { worker_main(w); });
+    }
+  }
+
+  ~BatchWorkers() {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      stop_ = true;
+    }
+    cv_work_.notify_all();
+    for (auto& t : threads_) t.join();
+  }
+
+  void start(const std::vector<BatchRecord>& recs, std::vector<BatchAnswer>& answers) {
+    answers.assign(recs.size(), BatchAnswer{});
+    ranges_.reset(recs.size());
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      recs_ = &recs;
+      answers_ = &answers;
+      done_ = 0;
+      ++generation_;
+    }
+    cv_work_.notify_all();
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lk(m_);
+    cv_done_.wait(lk, [&] { return done_ == threads_.size(); });
+    if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+
+private:
+  std::vector<DistanceEngine*> engines_;
+  const BatchOptions& opt_;
+  WorkStealingRanges ranges_;
+  std::vector<std::thread> threads_;
+
+  std::mutex m_;
+  std::condition_variable cv_work_, cv_done_;
+  std::uint64_t generation_ = 0;
+  std::size_t done_ = 0;
+  bool stop_ = false;
+  std::exception_ptr error_;
+  const std::vector<BatchRecord>* recs_ = nullptr;
+  std::vector<BatchAnswer>* answers_ = nullptr;
+
+  // Records per query_many call: enough to amortise a plugin call, few
+  // enough that stealing still evens out runs of slow coastal records.
+  static constexpr std::size_t kRunLength = 16;
+
+  void worker_main(std::size_t w) {
+    RunScratch scratch;
+    std::uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lk(m_);
+        cv_work_.wait(lk, [&] { return stop_ || generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+      }
+
+      std::exception_ptr err;
+      try {
+        std::size_t lo = 0, hi = 0;
+        while (ranges_.next(w, kRunLength, lo, hi)) {
+          evaluate_run(*engines_[w], *recs_, lo, hi, opt_, *answers_, scratch);
+        }
+      } catch (...) {
+        err = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lk(m_);
+        if (err && !error_) error_ = err;
+        ++done_;
+      }
+      cv_done_.notify_one();
+    }
+  }
+};
+
+// Reads up to `cap` records, stopping early (after at least one) when the
+// input would block so interactive producers are not stalled.
+void read_block(BatchReader& reader, std::istream& in, std::size_t cap,
+                std::vector<BatchRecord>& block) {
+  block.clear();
+  BatchRecord rec;
+  while (block.size() < cap && (block.empty() || in.rdbuf()->in_avail() > 0) && reader.next(rec)) {
+    block.push_back(std::move(rec));
+  }
+}
+
+void validate_options(const BatchOptions& opt) {
+  convert_units(0.0, opt.units);
+  if (opt.metric != "geodesic" && opt.metric != "chord" && opt.metric != "rhumb") {
+    throw std::runtime_error("Unknown --metric: " + opt.metric + " (use geodesic|chord|rhumb)");
+  }
+}
+
+// Answers records one at a time on the calling thread.
+BatchSummary run_sequential(DistanceEngine& engine, DistanceTrack* track, std::istream& in,
+                            std::ostream& out, const BatchOptions& opt) {
+  BatchReader reader(in, opt.format);
+  BatchSummary sum;
+  BatchRecord rec;
+  while (reader.next(rec)) {
+    emit(evaluate(engine, rec, opt, track), out, sum);
+
+    // Flush whenever we are about to block on input, so interactive pipes see
+    // each answer promptly while bulk input still gets buffered output.
+    if (in.rdbuf()->in_avail() <= 0) out.flush();
+  }
+  out.flush();
+  return sum;
+}
+
+} // namespace
+
+BatchSummary run_batch(const std::vector<DistanceEngine*>& engines, std::istream& in,
+                       std::ostream& out, const BatchOptions& opt) {
+  if (engines.empty()) throw std::runtime_error("run_batch: no engines");
+
+  // Validate options before reading any input.
+  validate_options(opt);
+
+  if (engines.size() == 1) return run_sequential(*engines[0], nullptr, in, out, opt);
+
+  BatchReader reader(in, opt.format);
+  BatchSummary sum;
+
+  // Double-buffered blocks: workers answer block k while this thread reads
+  // block k+1; answers are written in input order once the block completes.
+  // Memory stays bounded by two blocks regardless of input length.
+  const std::size_t cap = std::max<std::size_t>(1024, engines.size() * 256);
+  BatchWorkers workers(engines, opt);
+  std::vector<BatchRecord> cur, next;
+  std::vector<BatchAnswer> answers;
+
+  read_block(reader, in, cap, cur);
+  while (!cur.empty()) {
+    workers.start(cur, answers);
+    read_block(reader, in, cap, next);
+    workers.wait();
+
+    for (const auto& a : answers) emit(a, out, sum);
+    out.flush();
+    std::swap(cur, next);
+  }
+  return sum;
+}
+
+BatchSummary run_track(DistanceEngine& engine, std::istream& in, std::ostream& out,
+                       const BatchOptions& opt) {
+  validate_options(opt);
+  DistanceTrack track(engine);
+  return run_sequential(engine, &track, in, out, opt);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "distance_iface.h"
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct BatchOptions {
+  std::string format;          // "csv", "ndjson" or "" (detect from first record)
+  std::string units = "m";
+  std::string metric = "geodesic";
+  bool json = false;           // NDJSON output instead of the text line format
+};
+
+struct BatchSummary {
+  std::size_t records = 0;
+  std::size_t errors = 0;
+};
+
+// Streams lat/lon records from `in` and writes exactly one result line per
+// record to `out`, in input order. Blank lines and a CSV header are not
+// records. Records that fail to parse or query produce an error line
+// (text: "nan <units> nan nan"; json: {"line":N,"error":"..."}) and a
+// message on stderr, so output stays row-aligned with the input.
+//
+// One worker thread runs per engine (each engine owns its own dataset
+// handle); with more than one engine records are processed in blocks and
+// answers are still written in input order.
+BatchSummary run_batch(const std::vector<DistanceEngine*>& engines, std::istream& in,
+                       std::ostream& out, const BatchOptions& opt);
+
+// Like run_batch with one engine, but the records are consecutive fixes of
+// one moving point: each query is bounded by the previous answer (see
+// DistanceTrack). Same output; faster when fixes are close together.
+BatchSummary run_track(DistanceEngine& engine, std::istream& in, std::ostream& out,
+                       const BatchOptions& opt);
@@ -0,0 +1,251 @@
+// dist2land_bench: runs a fixed query corpus against every installed provider
+// and prints one JSON document with cold and warm latency percentiles,
+// throughput, work counters and peak RSS, so builds can be compared.
+#include "alloc_counter.h"
+#include "app_paths.h"
+#include "distance_iface.h"
+#include "providers.h"
+#include "result_format.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace {
+
+struct Point {
+  double lat, lon;
+};
+
+struct QuerySet {
+  const char* name;
+  std::vector<Point> points;
+};
+
+// The canonical corpus. Changing it makes results incomparable with earlier
+// runs, so add new sets rather than editing these.
+const std::vector<QuerySet>& corpus() {
+  static const std::vector<QuerySet> sets = {
+    {"open_ocean", {
+      {0.0, -30.0}, {36.84, -62.42}, {-30.0, -120.0}, {10.0, -140.0},
+      {-20.0, 80.0}, {-55.0, -150.0}, {45.0, -40.0}, {20.0, 160.0}}},
+    {"near_shore", {
+      {42.33, -70.90}, {-33.86, 151.30}, {51.00, 1.60}, {36.80, -122.00},
+      {-34.40, 18.45}, {60.10, 24.95}, {25.75, -80.10}, {43.25, 5.30}}},
+    {"inside_land", {
+      {39.0, -98.0}, {47.0, 103.0}, {0.0, 23.0}, {-10.0, -55.0},
+      {62.0, 100.0}, {-25.0, 134.0}, {78.0, -40.0}, {-80.0, 30.0}}},
+    {"antimeridian", {
+      {-17.0, 179.9}, {-17.0, -179.9}, {52.0, 179.95}, {51.8, -179.9},
+      {65.5, -179.5}, {66.0, 179.8}, {-40.0, 179.99}, {0.0, 180.0}}},
+    {"high_latitude", {
+      {89.5, 0.0}, {85.0, -150.0}, {80.0, 15.0}, {82.5, -60.0},
+      {-70.0, -10.0}, {-78.0, -170.0}, {75.0, -100.0}, {-85.0, 45.0}}},
+    {"archipelago", {
+      {37.5, 25.3}, {11.0, 123.5}, {59.4, 18.8}, {60.2, 21.5},
+      {74.5, -95.0}, {4.2, 73.5}, {-8.5, 119.5}, {57.5, -6.8}}},
+  };
+  return sets;
+}
+
+double now_ms() {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Peak resident set size of this process so far, in KiB.
+long peak_rss_kb() {
+  struct rusage ru {};
+  if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1024;   // bytes there
+#else
+  return ru.ru_maxrss;
+#endif
+}
+
+double percentile(std::vector<double> v, double q) {
+  if (v.empty()) return 0.0;
+  const std::size_t k = std::min(v.size() - 1, (std::size_t)(q * (double)v.size()));
+  std::nth_element(v.begin(), v.begin() + (std::ptrdiff_t)k, v.end());
+  return v[k];
+}
+
+std::string num(double v) {
+  char buf[64];
+  std::snprintf(buf, sizeof buf, "%.4f", v);
+  return buf;
+}
+
+std::string latency_json(const std::vector<double>& ms) {
+  double max = 0.0;
+  for (double v : ms) max = std::max(max, v);
+  return "{\"p50\":" + num(percentile(ms, 0.50)) + ",\"p90\":" + num(percentile(ms, 0.90)) +
+         ",\"p99\":" + num(percentile(ms, 0.99)) + ",\"max\":" + num(max) + "}";
+}
+
+struct Options {
+  int repeat = 20;   // warm passes over each set
+};
+
+// Cold: a fresh engine per query, opened and asked once, which is what one
+// CLI call pays (minus process start). Warm: one engine, after a warm-up
+// pass, `repeat` passes over the set.
+std::string run_set(const Provider& p, const std::filesystem::path& shp, const QuerySet& set,
+                    const Options& opt) {
+  std::vector<double> cold;
+  for (const auto& pt : set.points) {
+    const double t0 = now_ms();
+    try {
+      DistanceEngine engine(p.id, shp);
+      engine.query(pt.lat, pt.lon);
+    } catch (const std::exception&) {
+      // counted once, in the warm-up pass below
+    }
+    cold.push_back(now_ms() - t0);
+  }
+
+  DistanceEngine engine(p.id, shp);
+  double checksum_m = 0.0;
+  int errors = 0;
+  for (const auto& pt : set.points) {
+    try {
+      checksum_m += engine.query(pt.lat, pt.lon).geodesic_m;
+    } catch (const std::exception&) {
+      ++errors;
+    }
+  }
+
+  const QueryStats before = engine.stats();
+  const uint64_t allocs_before = alloc_count();
+  std::vector<double> warm;
+  warm.reserve(set.points.size() * (std::size_t)opt.repeat);
+  const double start = now_ms();
+  for (int r = 0; r < opt.repeat; ++r) {
+    for (const auto& pt : set.points) {
+      const double t0 = now_ms();
+      try {
+        engine.query(pt.lat, pt.lon);
+      } catch (const std::exception&) {
+      }
+      warm.push_back(now_ms() - t0);
+    }
+  }
+  const double total_ms = now_ms() - start;
+  const uint64_t allocs = alloc_count() - allocs_before;
+  const QueryStats after = engine.stats();
+  const double n = (double)std::max<std::size_t>(1, warm.size());
+
+  std::ostringstream os;
+  os << "{\"name\":\"" << set.name << "\""
+     << ",\"points\":" << set.points.size()
+     << ",\"errors\":" << errors
+     << ",\"cold_ms\":" << latency_json(cold)
+     << ",\"warm_ms\":" << latency_json(warm)
+     << ",\"qps\":" << num(total_ms > 0.0 ? 1000.0 * (double)warm.size() / total_ms : 0.0)
+     << ",\"features_per_query\":" << num((double)(after.features - before.features) / n)
+     << ",\"vertices_per_query\":" << num((double)(after.vertices - before.vertices) / n)
+     << ",\"allocs_per_query\":" << num((double)allocs / n)
+     << ",\"distance_sum_m\":" << num(checksum_m)
+     << "}";
+  return os.str();
+}
+
+std::string run_provider(const Provider& p, const Options& opt) {
+  const auto shp = provider_shapefile_path(p);
+
+  // The backend reported is the one this engine actually opened.
+  const double t0 = now_ms();
+  std::string backend;
+  {
+    DistanceEngine probe(p.id, shp);
+    backend = probe.backend_name();
+  }
+  const double open_ms = now_ms() - t0;
+
+  std::ostringstream os;
+  os << "{\"provider\":\"" << json_escape(p.id) << "\""
+     << ",\"backend\":\"" << json_escape(backend) << "\""
+     << ",\"open_ms\":" << num(open_ms)
+     << ",\"sets\":[";
+  bool first = true;
+  for (const auto& set : corpus()) {
+    std::cerr << p.id << ": " << set.name << "...\n";
+    os << (first ? "" : ",") << run_set(p, shp, set, opt);
+    first = false;
+  }
+  os << "],\"peak_rss_kb\":" << peak_rss_kb() << "}";
+  return os.str();
+}
+
+void print_usage() {
+  std::cout <<
+R"(dist2land_bench [--provider (osm|gshhg|ne|all)] [--repeat <n>] [--output <file>]
+
+Runs the built-in query corpus (open_ocean, near_shore, inside_land, antimeridian,
+high_latitude, archipelago) against each installed provider and writes one JSON
+document: per set, cold latency (fresh engine per query) and warm latency (one
+engine, --repeat passes, default 20) percentiles in ms, warm queries per second,
+features and vertices per query, allocations per query and the sum of the answers
+(which must not change between builds). peak_rss_kb is the process peak so far.
+)";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  try {
+    ArgvView av(argc, argv);
+    if (av.has("--help") || av.has("-h")) {
+      print_usage();
+      return 0;
+    }
+
+    count_allocations(true);
+    Options opt;
+    const double repeat = av.get_double("--repeat", opt.repeat);
+    if (repeat < 1.0 || repeat != std::floor(repeat)) throw std::runtime_error("--repeat must be a positive integer");
+    opt.repeat = (int)repeat;
+
+    const std::string prov = to_lower(av.get("--provider", "all"));
+    std::vector<Provider> todo;
+    if (prov == "all") {
+      for (const auto& p : all_providers()) {
+        if (provider_installed(p)) todo.push_back(p);
+      }
+    } else {
+      todo.push_back(provider_by_id(prov));
+      if (!provider_installed(todo.back())) throw std::runtime_error("Provider '" + prov + "' not installed");
+    }
+    if (todo.empty()) throw std::runtime_error("No providers installed. Run: dist2land setup --provider ne");
+
+    std::ostringstream os;
+    os << "{\"repeat\":" << opt.repeat << ",\"providers\":[";
+    for (std::size_t i = 0; i < todo.size(); ++i) os << (i ? "," : "") << run_provider(todo[i], opt);
+    os << "],\"peak_rss_kb\":" << peak_rss_kb() << "}\n";
+
+    const std::string out = av.get("--output", "");
+    if (out.empty()) {
+      std::cout << os.str();
+    } else {
+      std::ofstream f(out, std::ios::trunc);
+      f << os.str();
+      if (!f) throw std::runtime_error("Failed to write " + out);
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return 1;
+  }
+}
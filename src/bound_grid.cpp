@@ -0,0 +1,103 @@
+#include "bound_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+static_assert(sizeof(BoundGridHeader) % 8 == 0, "header must keep cells 8-byte aligned");
+static_assert(sizeof(BoundGridCell) == 8, "cells are two packed floats");
+
+std::filesystem::path bound_grid_path(const std::filesystem::path& index_path) {
+  auto p = index_path;
+  p.replace_extension(".bounds");
+  return p;
+}
+
+void write_bound_grid(const std::filesystem::path& path, const CoastIndexHeader& idx,
+                      uint32_t cols, uint32_t rows, const std::vector<BoundGridCell>& cells) {
+  if (cols == 0 || rows == 0 || cells.size() != (std::size_t)cols * rows) {
+    throw std::runtime_error("write_bound_grid: inconsistent cell array");
+  }
+
+  BoundGridHeader h{};
+  std::memcpy(h.magic, kBoundGridMagic, sizeof(h.magic));
+  h.version = kBoundGridVersion;
+  h.header_size = sizeof(BoundGridHeader);
+  h.source_size = idx.source_size;
+  h.source_mtime = idx.source_mtime;
+  h.source_hash = idx.source_hash;
+  h.vertex_count = idx.vertex_count;
+  h.cols = cols;
+  h.rows = rows;
+  h.cell_deg = kBoundGridCellDeg;
+  h.off_cells = sizeof(BoundGridHeader);
+
+  auto tmp = path;
+  tmp += ".tmp";
+  std::FILE* f = std::fopen(tmp.string().c_str(), "wb");
+  if (!f) throw std::runtime_error("Failed to create " + tmp.string());
+
+  bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+            std::fwrite(cells.data(), sizeof(BoundGridCell), cells.size(), f) == cells.size();
+  ok = (std::fclose(f) == 0) && ok;
+  if (!ok) {
+    std::error_code ec;
+    std::filesystem::remove(tmp, ec);
+    throw std::runtime_error("Failed to write " + tmp.string());
+  }
+
+#ifdef _WIN32
+  std::error_code ec;
+  std::filesystem::remove(path, ec);  // Windows rename does not replace
+#endif
+  std::filesystem::rename(tmp, path);   // atomic on POSIX: readers see old or new
+}
+
+BoundGrid::BoundGrid(const std::filesystem::path& path) : file_(path) {
+  const auto* base = file_.data();
+  const uint64_t size = file_.size();
+  if (size < sizeof(BoundGridHeader)) throw std::runtime_error("Bound grid truncated: " + path.string());
+
+  hdr_ = (const BoundGridHeader*)base;
+  const auto& h = *hdr_;
+  if (std::memcmp(h.magic, kBoundGridMagic, sizeof(h.magic)) != 0) {
+    throw std::runtime_error("Not a dist2land bound grid: " + path.string());
+  }
+  if (h.version != kBoundGridVersion || h.header_size != sizeof(BoundGridHeader)) {
+    throw std::runtime_error("Bound grid version mismatch (rebuild with dist2land build-index): " + path.string());
+  }
+  const uint64_t n = (uint64_t)h.cols * h.rows;
+  if (n == 0 || !(h.cell_deg > 0.0) || h.off_cells % 8 != 0 || h.off_cells > size ||
+      n > (size - h.off_cells) / sizeof(BoundGridCell)) {
+    throw std::runtime_error("Bound grid truncated: " + path.string());
+  }
+  cells_ = (const BoundGridCell*)(base + h.off_cells);
+}
+
+bool BoundGrid::matches(const CoastIndexHeader& idx) const {
+  return hdr_->source_size == idx.source_size && hdr_->source_mtime == idx.source_mtime &&
+         hdr_->source_hash == idx.source_hash && hdr_->vertex_count == idx.vertex_count;
+}
+
+bool BoundGrid::matches(const std::filesystem::path& shp_path) const {
+  std::error_code ec;
+  if (!std::filesystem::exists(shp_path, ec)) return false;
+  const auto src = coast_index_source_of(shp_path, false);
+  if (src.size != hdr_->source_size) return false;
+  if (src.mtime == hdr_->source_mtime) return true;
+  return coast_index_source_of(shp_path, true).hash == hdr_->source_hash;
+}
+
+BoundGridCell BoundGrid::lookup(double lat_deg, double lon_deg) const {
+  const auto& h = *hdr_;
+  const double fc = std::floor((lon_deg + 180.0) / h.cell_deg);
+  const double fr = std::floor((lat_deg + 90.0) / h.cell_deg);
+  if (!std::isfinite(fc) || !std::isfinite(fr)) return {0.0f, std::numeric_limits<float>::infinity()};
+  const uint32_t c = (uint32_t)std::clamp(fc, 0.0, (double)(h.cols - 1));
+  const uint32_t r = (uint32_t)std::clamp(fr, 0.0, (double)(h.rows - 1));
+  return cells_[(std::size_t)r * h.cols + c];
+}
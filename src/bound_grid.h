@@ -0,0 +1,71 @@
+#pragma once
+#include "coast_index.h"
+#include "mmap_file.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Coarse distance bounds, built next to the coastline index
+// (coastline.bounds): a regular lon/lat grid of kBoundGridCellDeg cells, each
+// holding a lower and an upper bound (m) on the distance from any point of
+// the cell to the nearest coastline. Searches start from the upper bound (no
+// coastline beyond it can be nearest) and may stop as soon as they find
+// coastline at the lower bound.
+//
+// Cells whose centre is on land store an infinite upper bound: a land point's
+// nearest coastline can be arbitrarily far inland of the cell.
+//
+// Layout: header | cell[rows * cols] {float lower_m, upper_m}, rows from
+// south to north, columns from west to east.
+
+static constexpr char     kBoundGridMagic[8] = {'D', '2', 'L', 'B', 'N', 'D', 'S', '\0'};
+static constexpr uint32_t kBoundGridVersion  = 1;
+static constexpr double   kBoundGridCellDeg  = 0.25;
+
+struct BoundGridHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  // Identity of the shapefile (via its coastline index) the grid was built from.
+  uint64_t source_size;
+  int64_t  source_mtime;
+  uint64_t source_hash;
+  uint64_t vertex_count;
+
+  uint32_t cols, rows;
+  double   cell_deg;
+  uint64_t off_cells;
+};
+
+struct BoundGridCell {
+  float lower_m;
+  float upper_m;
+};
+
+// coastline.idx -> coastline.bounds
+std::filesystem::path bound_grid_path(const std::filesystem::path& index_path);
+
+// Atomically writes a grid of rows x cols cells built for the index with header `idx`.
+void write_bound_grid(const std::filesystem::path& path, const CoastIndexHeader& idx,
+                      uint32_t cols, uint32_t rows, const std::vector<BoundGridCell>& cells);
+
+class BoundGrid {
+public:
+  // Throws std::runtime_error if the file is missing, truncated or of another version.
+  explicit BoundGrid(const std::filesystem::path& path);
+
+  // True if the grid was built from exactly this index.
+  bool matches(const CoastIndexHeader& idx) const;
+  // True if the grid was built from this shapefile (same checks as
+  // coast_index_status), for use without the index.
+  bool matches(const std::filesystem::path& shp_path) const;
+
+  BoundGridCell lookup(double lat_deg, double lon_deg) const;
+
+private:
+  MappedFile file_;
+  const BoundGridHeader* hdr_ = nullptr;
+  const BoundGridCell* cells_ = nullptr;
+};
@@ -0,0 +1,540 @@
+#include "coast_index.h"
+#include "bound_grid.h"
+#include "land_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <system_error>
+
+static_assert(sizeof(CoastIndexHeader) % 8 == 0, "header must keep sections 8-byte aligned");
+
+// ------------------------- source fingerprint -------------------------
+
+static uint64_t fnv1a_file(const std::filesystem::path& p) {
+  std::ifstream f(p, std::ios::binary);
+  if (!f.is_open()) throw std::runtime_error("Failed to open for hashing: " + p.string());
+
+  // FNV-1a over 8-byte words (plus a byte-wise tail); fast enough to run over
+  // the large OSM shapefile in about a second.
+  uint64_t h = 1469598103934665603ull;
+  constexpr uint64_t prime = 1099511628211ull;
+  std::vector<char> buf(1 << 20);
+  while (f) {
+    f.read(buf.data(), (std::streamsize)buf.size());
+    const std::size_t n = (std::size_t)f.gcount();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      uint64_t w;
+      std::memcpy(&w, buf.data() + i, 8);
+      h ^= w;
+      h *= prime;
+    }
+    for (; i < n; ++i) {
+      h ^= (unsigned char)buf[i];
+      h *= prime;
+    }
+  }
+  return h;
+}
+
+CoastIndexSource coast_index_source_of(const std::filesystem::path& shp_path, bool with_hash) {
+  CoastIndexSource s;
+  s.size = (uint64_t)std::filesystem::file_size(shp_path);
+  s.mtime = (int64_t)std::filesystem::last_write_time(shp_path).time_since_epoch().count();
+  if (with_hash) s.hash = fnv1a_file(shp_path);
+  return s;
+}
+
+const char* coast_index_status_name(CoastIndexStatus s) {
+  switch (s) {
+    case CoastIndexStatus::Missing: return "missing";
+    case CoastIndexStatus::Fresh:   return "fresh";
+    case CoastIndexStatus::Stale:   return "stale";
+    case CoastIndexStatus::Invalid: return "invalid";
+  }
+  return "?";
+}
+
+// Rewrites source_mtime in the header of a file built from the index whose
+// header was `old` (the index itself, or one of its grids), when its identity
+// still matches (its mtime may already be the new one). Best effort: if the
+// write fails, the hash is just checked again next time.
+template <class Header>
+static void restamp_source_mtime(const std::filesystem::path& path, const CoastIndexHeader& old,
+                                 int64_t mtime) {
+  std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+  if (!f.is_open()) return;
+  Header h{};
+  if (!f.read((char*)&h, sizeof(h))) return;
+  if (h.source_size != old.source_size || h.source_hash != old.source_hash ||
+      h.vertex_count != old.vertex_count) {
+    return;
+  }
+  if (h.source_mtime != old.source_mtime && h.source_mtime != mtime) return;
+  f.seekp((std::streamoff)offsetof(Header, source_mtime));
+  f.write((const char*)&mtime, sizeof(mtime));
+}
+
+CoastIndexStatus coast_index_status(const std::filesystem::path& index_path,
+                                    const std::filesystem::path& shp_path) {
+  std::error_code ec;
+  if (!std::filesystem::exists(index_path, ec)) return CoastIndexStatus::Missing;
+
+  CoastIndexHeader h{};
+  {
+    std::ifstream f(index_path, std::ios::binary);
+    if (!f.read((char*)&h, sizeof(h))) return CoastIndexStatus::Invalid;
+  }
+  if (std::memcmp(h.magic, kCoastIndexMagic, sizeof(h.magic)) != 0) return CoastIndexStatus::Invalid;
+  if (h.version != kCoastIndexVersion || h.header_size != sizeof(CoastIndexHeader)) {
+    return CoastIndexStatus::Stale;
+  }
+
+  if (!std::filesystem::exists(shp_path, ec)) return CoastIndexStatus::Stale;
+  const auto src = coast_index_source_of(shp_path, false);
+  if (src.size != h.source_size) return CoastIndexStatus::Stale;
+  if (src.mtime == h.source_mtime) return CoastIndexStatus::Fresh;
+  if (fnv1a_file(shp_path) != h.source_hash) return CoastIndexStatus::Stale;
+
+  // Same contents under a new mtime (e.g. a re-extracted archive): record the
+  // new mtime so later checks do not hash the shapefile again. The grids go
+  // first, as they only count while their identity matches the index's.
+  restamp_source_mtime<LandGridHeader>(land_grid_path(index_path), h, src.mtime);
+  restamp_source_mtime<BoundGridHeader>(bound_grid_path(index_path), h, src.mtime);
+  restamp_source_mtime<CoastIndexHeader>(index_path, h, src.mtime);
+  return CoastIndexStatus::Fresh;
+}
+
+// ------------------------- writer -------------------------
+
+// Hilbert curve index of (x, y) in a 2^16 grid (from flatbush, after
+// "Fast Hilbert curve generation" by Rawrunprotected).
+static uint32_t hilbert16(uint32_t x, uint32_t y) {
+  uint32_t a = x ^ y;
+  uint32_t b = 0xFFFF ^ a;
+  uint32_t c = 0xFFFF ^ (x | y);
+  uint32_t d = x & (y ^ 0xFFFF);
+
+  uint32_t A = a | (b >> 1);
+  uint32_t B = (a >> 1) ^ a;
+  uint32_t C = ((c >> 1) ^ (b & (d >> 1))) ^ c;
+  uint32_t D = ((a & (c >> 1)) ^ (d >> 1)) ^ d;
+
+  a = A; b = B; c = C; d = D;
+  A = ((a & (a >> 2)) ^ (b & (b >> 2)));
+  B = ((a & (b >> 2)) ^ (b & ((a ^ b) >> 2)));
+  C ^= ((a & (c >> 2)) ^ (b & (d >> 2)));
+  D ^= ((b & (c >> 2)) ^ ((a ^ b) & (d >> 2)));
+
+  a = A; b = B; c = C; d = D;
+  A = ((a & (a >> 4)) ^ (b & (b >> 4)));
+  B = ((a & (b >> 4)) ^ (b & ((a ^ b) >> 4)));
+  C ^= ((a & (c >> 4)) ^ (b & (d >> 4)));
+  D ^= ((b & (c >> 4)) ^ ((a ^ b) & (d >> 4)));
+
+  a = A; b = B; c = C; d = D;
+  C ^= ((a & (c >> 8)) ^ (b & (d >> 8)));
+  D ^= ((b & (c >> 8)) ^ ((a ^ b) & (d >> 8)));
+
+  a = C ^ (C >> 1);
+  b = D ^ (D >> 1);
+
+  uint32_t i0 = x ^ y;
+  uint32_t i1 = b | (0xFFFF ^ (i0 | a));
+
+  i0 = (i0 | (i0 << 8)) & 0x00FF00FF;
+  i0 = (i0 | (i0 << 4)) & 0x0F0F0F0F;
+  i0 = (i0 | (i0 << 2)) & 0x33333333;
+  i0 = (i0 | (i0 << 1)) & 0x55555555;
+
+  i1 = (i1 | (i1 << 8)) & 0x00FF00FF;
+  i1 = (i1 | (i1 << 4)) & 0x0F0F0F0F;
+  i1 = (i1 | (i1 << 2)) & 0x33333333;
+  i1 = (i1 | (i1 << 1)) & 0x55555555;
+
+  return (i1 << 1) | i0;
+}
+
+static std::FILE* open_write_or_throw(const std::filesystem::path& p) {
+  std::FILE* f = std::fopen(p.string().c_str(), "wb");
+  if (!f) throw std::runtime_error("Failed to open for write: " + p.string());
+  return f;
+}
+
+static void write_or_throw(std::FILE* f, const void* data, std::size_t bytes) {
+  if (bytes && std::fwrite(data, 1, bytes, f) != bytes) {
+    throw std::runtime_error("Write failed while building coastline index");
+  }
+}
+
+CoastIndexWriter::CoastIndexWriter(const std::filesystem::path& out_path) : out_path_(out_path) {
+  if (!out_path_.parent_path().empty()) std::filesystem::create_directories(out_path_.parent_path());
+  tmp_lon_ = out_path_; tmp_lon_ += ".lon.tmp";
+  tmp_lat_ = out_path_; tmp_lat_ += ".lat.tmp";
+  f_lon_ = open_write_or_throw(tmp_lon_);
+  try {
+    f_lat_ = open_write_or_throw(tmp_lat_);
+  } catch (...) {
+    cleanup_tmp();
+    throw;
+  }
+}
+
+CoastIndexWriter::~CoastIndexWriter() { cleanup_tmp(); }
+
+void CoastIndexWriter::cleanup_tmp() {
+  if (f_lon_) { std::fclose(f_lon_); f_lon_ = nullptr; }
+  if (f_lat_) { std::fclose(f_lat_); f_lat_ = nullptr; }
+  std::error_code ec;
+  std::filesystem::remove(tmp_lon_, ec);
+  std::filesystem::remove(tmp_lat_, ec);
+}
+
+void CoastIndexWriter::begin_polygon() { ++poly_count_; }
+
+void CoastIndexWriter::add_ring(const double* xy, std::size_t n, bool exterior) {
+  if (poly_count_ == 0) begin_polygon();
+
+  // Drop non-finite and repeated points, then close the ring.
+  auto& r = ring_xy_;
+  r.clear();
+  for (std::size_t i = 0; i < n; ++i) {
+    const double x = xy[2 * i], y = xy[2 * i + 1];
+    if (!std::isfinite(x) || !std::isfinite(y)) continue;
+    if (!r.empty() && r[r.size() - 2] == x && r[r.size() - 1] == y) continue;
+    r.push_back(x);
+    r.push_back(y);
+  }
+  if (r.size() >= 2 && (r[0] != r[r.size() - 2] || r[1] != r[r.size() - 1])) {
+    r.push_back(r[0]);
+    r.push_back(r[1]);
+  }
+  const std::size_t m = r.size() / 2;
+  if (m < 4) return;
+
+  // Land on the left: exteriors counter-clockwise, holes clockwise.
+  double area2 = 0.0;
+  for (std::size_t i = 0; i + 1 < m; ++i) {
+    area2 += r[2 * i] * r[2 * i + 3] - r[2 * i + 2] * r[2 * i + 1];
+  }
+  if (area2 == 0.0) return;
+  if ((area2 > 0.0) != exterior) {
+    for (std::size_t i = 0, j = m - 1; i < j; ++i, --j) {
+      std::swap(r[2 * i], r[2 * j]);
+      std::swap(r[2 * i + 1], r[2 * j + 1]);
+    }
+  }
+
+  if (vertex_count_ + m > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("Coastline index: too many vertices");
+  }
+  const uint32_t base = (uint32_t)vertex_count_;
+  const uint32_t ring = (uint32_t)ring_poly_.size();
+  ring_first_.push_back(base);
+  ring_poly_.push_back(poly_count_ - 1);
+
+  for (std::size_t i = 0; i < m; ++i) {
+    write_or_throw(f_lon_, &r[2 * i], sizeof(double));
+    write_or_throw(f_lat_, &r[2 * i + 1], sizeof(double));
+  }
+
+  for (std::size_t i = 0; i < m; ++i) {
+    uint8_t fl = 0;
+    if (i + 1 == m) {
+      fl = kSegArtificial; // no segment starts at the closing vertex
+    } else {
+      const double x0 = r[2 * i], y0 = r[2 * i + 1];
+      const double x1 = r[2 * i + 2], y1 = r[2 * i + 3];
+      if (x0 == x1) {
+        if (std::abs(x0) == 180.0) fl = kSegArtificial;  // antimeridian cut
+        else axis_edges_.push_back({x0, std::min(y0, y1), std::max(y0, y1), base + (uint32_t)i, true, y1 > y0});
+      } else if (y0 == y1) {
+        if (y0 <= -90.0) fl = kSegArtificial;            // south pole closure
+        else axis_edges_.push_back({y0, std::min(x0, x1), std::max(x0, x1), base + (uint32_t)i, false, x1 > x0});
+      }
+    }
+    vflags_.push_back(fl);
+  }
+
+  for (std::size_t s = 0; s + 1 < m; s += kCoastChunkSegments) {
+    const std::size_t nseg = std::min<std::size_t>(kCoastChunkSegments, m - 1 - s);
+    double b[4] = {r[2 * s], r[2 * s + 1], r[2 * s], r[2 * s + 1]};
+    for (std::size_t i = s + 1; i <= s + nseg; ++i) {
+      b[0] = std::min(b[0], r[2 * i]);
+      b[1] = std::min(b[1], r[2 * i + 1]);
+      b[2] = std::max(b[2], r[2 * i]);
+      b[3] = std::max(b[3], r[2 * i + 1]);
+    }
+    chunk_first_.push_back(base + (uint32_t)s);
+    chunk_ring_.push_back(ring);
+    chunk_nseg_.push_back((uint16_t)nseg);
+    chunk_box_.insert(chunk_box_.end(), b, b + 4);
+  }
+
+  vertex_count_ += m;
+}
+
+// Split datasets (OSM land polygons) cut land into tiles along grid lines.
+// Those cuts appear twice, once per neighbouring tile and in opposite
+// directions. An axis-aligned edge fully covered by opposite-direction edges
+// on the same line is such a seam rather than coastline.
+void CoastIndexWriter::mark_seams() {
+  auto& e = axis_edges_;
+  std::sort(e.begin(), e.end(), [](const AxisEdge& a, const AxisEdge& b) {
+    if (a.vertical != b.vertical) return a.vertical < b.vertical;
+    if (a.key != b.key) return a.key < b.key;
+    return a.lo < b.lo;
+  });
+
+  using Interval = std::pair<double, double>;
+  std::vector<Interval> fwd, bwd;
+  auto merge = [](std::vector<Interval>& v) {
+    std::vector<Interval> out;
+    for (const auto& iv : v) {  // input sorted by lo
+      if (!out.empty() && iv.first <= out.back().second) out.back().second = std::max(out.back().second, iv.second);
+      else out.push_back(iv);
+    }
+    v.swap(out);
+  };
+  auto covered = [](const std::vector<Interval>& v, double lo, double hi) {
+    auto it = std::upper_bound(v.begin(), v.end(), lo, [](double x, const Interval& iv) { return x < iv.first; });
+    if (it == v.begin()) return false;
+    --it;
+    return it->first <= lo && hi <= it->second;
+  };
+
+  for (std::size_t i = 0; i < e.size();) {
+    std::size_t j = i;
+    while (j < e.size() && e[j].vertical == e[i].vertical && e[j].key == e[i].key) ++j;
+    if (j - i >= 2) {
+      fwd.clear();
+      bwd.clear();
+      for (std::size_t k = i; k < j; ++k) (e[k].forward ? fwd : bwd).emplace_back(e[k].lo, e[k].hi);
+      if (!fwd.empty() && !bwd.empty()) {
+        merge(fwd);
+        merge(bwd);
+        for (std::size_t k = i; k < j; ++k) {
+          if (covered(e[k].forward ? bwd : fwd, e[k].lo, e[k].hi)) vflags_[e[k].vertex] |= kSegArtificial;
+        }
+      }
+    }
+    i = j;
+  }
+  e.clear();
+  e.shrink_to_fit();
+}
+
+static uint64_t align8(uint64_t v) { return (v + 7) & ~uint64_t(7); }
+
+void CoastIndexWriter::finish(const CoastIndexSource& src) {
+  std::fclose(f_lon_); f_lon_ = nullptr;
+  std::fclose(f_lat_); f_lat_ = nullptr;
+
+  mark_seams();
+
+  // Keep only chunks with at least one real coastline segment.
+  std::vector<uint32_t> keep;
+  for (uint32_t c = 0; c < (uint32_t)chunk_first_.size(); ++c) {
+    for (uint32_t s = 0; s < chunk_nseg_[c]; ++s) {
+      if (!(vflags_[chunk_first_[c] + s] & kSegArtificial)) { keep.push_back(c); break; }
+    }
+  }
+  if (keep.empty()) throw std::runtime_error("Coastline index: no coastline segments found");
+
+  double ext[4] = {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(),
+                   -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()};
+  for (uint32_t c : keep) {
+    const double* b = &chunk_box_[4 * (std::size_t)c];
+    ext[0] = std::min(ext[0], b[0]);
+    ext[1] = std::min(ext[1], b[1]);
+    ext[2] = std::max(ext[2], b[2]);
+    ext[3] = std::max(ext[3], b[3]);
+  }
+
+  // Hilbert-sort the chunks so the leaves of each tree node are spatially close.
+  {
+    const double w = std::max(ext[2] - ext[0], 1e-12), h = std::max(ext[3] - ext[1], 1e-12);
+    std::vector<uint32_t> hv(chunk_first_.size());
+    for (uint32_t c : keep) {
+      const double* b = &chunk_box_[4 * (std::size_t)c];
+      const auto hx = (uint32_t)std::floor(65535.0 * ((b[0] + b[2]) / 2 - ext[0]) / w);
+      const auto hy = (uint32_t)std::floor(65535.0 * ((b[1] + b[3]) / 2 - ext[1]) / h);
+      hv[c] = hilbert16(hx, hy);
+    }
+    std::stable_sort(keep.begin(), keep.end(), [&](uint32_t a, uint32_t b) { return hv[a] < hv[b]; });
+  }
+
+  const std::size_t nc = keep.size();
+  std::vector<uint32_t> chunk_first(nc), chunk_ring(nc);
+  std::vector<uint16_t> chunk_nseg(nc);
+  std::vector<uint64_t> level_end;
+  std::size_t n = nc, num_nodes = nc;
+  level_end.push_back(num_nodes);
+  do {
+    n = (n + kCoastTreeNodeSize - 1) / kCoastTreeNodeSize;
+    num_nodes += n;
+    level_end.push_back(num_nodes);
+  } while (n != 1);
+
+  std::vector<double> boxes(num_nodes * 4);
+  std::vector<uint32_t> index(num_nodes);
+  for (std::size_t i = 0; i < nc; ++i) {
+    const uint32_t c = keep[i];
+    chunk_first[i] = chunk_first_[c];
+    chunk_ring[i] = chunk_ring_[c];
+    chunk_nseg[i] = chunk_nseg_[c];
+    std::copy_n(&chunk_box_[4 * (std::size_t)c], 4, &boxes[4 * i]);
+    index[i] = (uint32_t)i;
+  }
+  for (std::size_t lvl = 0, pos = 0, out = nc; lvl + 1 < level_end.size(); ++lvl) {
+    const std::size_t end = level_end[lvl];
+    while (pos < end) {
+      const std::size_t first = pos;
+      double b[4] = {boxes[4 * pos], boxes[4 * pos + 1], boxes[4 * pos + 2], boxes[4 * pos + 3]};
+      for (std::size_t k = 0; k < kCoastTreeNodeSize && pos < end; ++k, ++pos) {
+        b[0] = std::min(b[0], boxes[4 * pos]);
+        b[1] = std::min(b[1], boxes[4 * pos + 1]);
+        b[2] = std::max(b[2], boxes[4 * pos + 2]);
+        b[3] = std::max(b[3], boxes[4 * pos + 3]);
+      }
+      std::copy_n(b, 4, &boxes[4 * out]);
+      index[out] = (uint32_t)first;
+      ++out;
+    }
+  }
+
+  ring_first_.push_back((uint32_t)vertex_count_);
+
+  CoastIndexHeader h{};
+  std::memcpy(h.magic, kCoastIndexMagic, sizeof(h.magic));
+  h.version = kCoastIndexVersion;
+  h.header_size = sizeof(CoastIndexHeader);
+  h.source_size = src.size;
+  h.source_mtime = src.mtime;
+  h.source_hash = src.hash;
+  h.vertex_count = vertex_count_;
+  h.ring_count = ring_poly_.size();
+  h.chunk_count = nc;
+  h.node_count = num_nodes;
+  h.node_size = kCoastTreeNodeSize;
+  h.level_count = (uint32_t)level_end.size();
+  h.min_lon = ext[0]; h.min_lat = ext[1]; h.max_lon = ext[2]; h.max_lat = ext[3];
+
+  uint64_t off = sizeof(CoastIndexHeader);
+  auto place = [&](uint64_t& field, uint64_t bytes) { field = off; off = align8(off + bytes); };
+  const uint64_t V = vertex_count_;
+  place(h.off_lon, V * 8);
+  place(h.off_lat, V * 8);
+  place(h.off_vflags, V);
+  place(h.off_ring_first, ring_first_.size() * 4);
+  place(h.off_ring_poly, ring_poly_.size() * 4);
+  place(h.off_chunk_first, nc * 4);
+  place(h.off_chunk_ring, nc * 4);
+  place(h.off_chunk_nseg, nc * 2);
+  place(h.off_tree_boxes, boxes.size() * 8);
+  place(h.off_tree_index, index.size() * 4);
+  place(h.off_level_end, level_end.size() * 8);
+
+  auto tmp_out = out_path_;
+  tmp_out += ".tmp";
+  std::FILE* f = open_write_or_throw(tmp_out);
+  try {
+    uint64_t pos = 0;
+    auto section = [&](uint64_t at, const void* data, uint64_t bytes) {
+      static const char zeros[8] = {};
+      write_or_throw(f, zeros, (std::size_t)(at - pos));
+      write_or_throw(f, data, (std::size_t)bytes);
+      pos = at + bytes;
+    };
+    auto copy_file = [&](uint64_t at, const std::filesystem::path& p) {
+      section(at, nullptr, 0);
+      std::FILE* in = std::fopen(p.string().c_str(), "rb");
+      if (!in) throw std::runtime_error("Failed to reopen " + p.string());
+      std::vector<char> buf(1 << 20);
+      std::size_t got;
+      while ((got = std::fread(buf.data(), 1, buf.size(), in)) > 0) {
+        write_or_throw(f, buf.data(), got);
+        pos += got;
+      }
+      std::fclose(in);
+    };
+
+    section(0, &h, sizeof(h));
+    copy_file(h.off_lon, tmp_lon_);
+    copy_file(h.off_lat, tmp_lat_);
+    section(h.off_vflags, vflags_.data(), vflags_.size());
+    section(h.off_ring_first, ring_first_.data(), ring_first_.size() * 4);
+    section(h.off_ring_poly, ring_poly_.data(), ring_poly_.size() * 4);
+    section(h.off_chunk_first, chunk_first.data(), nc * 4);
+    section(h.off_chunk_ring, chunk_ring.data(), nc * 4);
+    section(h.off_chunk_nseg, chunk_nseg.data(), nc * 2);
+    section(h.off_tree_boxes, boxes.data(), boxes.size() * 8);
+    section(h.off_tree_index, index.data(), index.size() * 4);
+    section(h.off_level_end, level_end.data(), level_end.size() * 8);
+    if (std::fclose(f) != 0) { f = nullptr; throw std::runtime_error("Failed to write " + tmp_out.string()); }
+    f = nullptr;
+  } catch (...) {
+    if (f) std::fclose(f);
+    std::error_code ec;
+    std::filesystem::remove(tmp_out, ec);
+    throw;
+  }
+
+#ifdef _WIN32
+  std::error_code ec;
+  std::filesystem::remove(out_path_, ec);  // Windows rename does not replace
+#endif
+  std::filesystem::rename(tmp_out, out_path_);   // atomic on POSIX: readers see old or new
+  cleanup_tmp();
+}
+
+// ------------------------- reader -------------------------
+
+CoastIndex::CoastIndex(const std::filesystem::path& path) : file_(path) {
+  const auto* base = file_.data();
+  const uint64_t size = file_.size();
+  if (size < sizeof(CoastIndexHeader)) throw std::runtime_error("Coastline index truncated: " + path.string());
+
+  hdr_ = (const CoastIndexHeader*)base;
+  const auto& h = *hdr_;
+  if (std::memcmp(h.magic, kCoastIndexMagic, sizeof(h.magic)) != 0) {
+    throw std::runtime_error("Not a dist2land coastline index: " + path.string());
+  }
+  if (h.version != kCoastIndexVersion || h.header_size != sizeof(CoastIndexHeader)) {
+    throw std::runtime_error("Coastline index version mismatch (rebuild with dist2land build-index): " + path.string());
+  }
+  if (h.chunk_count == 0 || h.node_count <= h.chunk_count || h.level_count < 2) {
+    throw std::runtime_error("Coastline index is empty or corrupt: " + path.string());
+  }
+
+  auto at = [&](uint64_t off, uint64_t bytes) {
+    if (off % 8 != 0 || off > size || bytes > size - off) {
+      throw std::runtime_error("Coastline index truncated: " + path.string());
+    }
+    return base + off;
+  };
+  lon_        = (const double*)  at(h.off_lon, h.vertex_count * 8);
+  lat_        = (const double*)  at(h.off_lat, h.vertex_count * 8);
+  vflags_     = (const uint8_t*) at(h.off_vflags, h.vertex_count);
+  ring_first_ = (const uint32_t*)at(h.off_ring_first, (h.ring_count + 1) * 4);
+  ring_poly_  = (const uint32_t*)at(h.off_ring_poly, h.ring_count * 4);
+  chunk_first_= (const uint32_t*)at(h.off_chunk_first, h.chunk_count * 4);
+  chunk_ring_ = (const uint32_t*)at(h.off_chunk_ring, h.chunk_count * 4);
+  chunk_nseg_ = (const uint16_t*)at(h.off_chunk_nseg, h.chunk_count * 2);
+  tree_boxes_ = (const double*)  at(h.off_tree_boxes, h.node_count * 32);
+  tree_index_ = (const uint32_t*)at(h.off_tree_index, h.node_count * 4);
+  level_end_  = (const uint64_t*)at(h.off_level_end, (uint64_t)h.level_count * 8);
+}
+
+std::size_t CoastIndex::level_end_of(std::size_t pos) const {
+  for (uint32_t l = 0; l < hdr_->level_count; ++l) {
+    if (pos < level_end_[l]) return (std::size_t)level_end_[l];
+  }
+  return node_count();
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include "mmap_file.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Compiled coastline index ("dist2land build-index").
+//
+// A provider shapefile is flattened into rings of lon/lat vertices stored as
+// structure-of-arrays (all longitudes, then all latitudes). Every ring is
+// oriented with land on its left: exteriors counter-clockwise, holes
+// clockwise. Segment i joins vertex i and i+1 of the same ring. Segments that
+// are not real coastline (tile seams shared by two split polygons, cuts along
+// the antimeridian or the south pole) are flagged so searches skip them.
+//
+// Consecutive segments of a ring are grouped into chunks of at most
+// kCoastChunkSegments; a packed Hilbert R-tree (flatbush layout) over the chunk
+// bounding boxes provides the spatial search. The file is mmap'ed read-only.
+//
+// Layout (little-endian, each section 8-byte aligned, offsets in the header):
+//   header | lon[V] | lat[V] | vflags[V] | ring_first[R+1] | ring_poly[R]
+//   | chunk_first[C] | chunk_ring[C] | chunk_nseg[C]
+//   | tree_boxes[N*4] | tree_index[N] | level_end[L]
+
+static constexpr char     kCoastIndexMagic[8]   = {'D', '2', 'L', 'C', 'O', 'A', 'S', 'T'};
+static constexpr uint32_t kCoastIndexVersion    = 1;
+static constexpr uint32_t kCoastChunkSegments   = 16;
+static constexpr uint32_t kCoastTreeNodeSize    = 16;
+
+// vflags bits (per vertex, describing the segment that starts there)
+static constexpr uint8_t kSegArtificial = 1;  // seam/cut edge, not coastline
+
+// Identity of the shapefile an index was built from.
+struct CoastIndexSource {
+  uint64_t size = 0;
+  int64_t  mtime = 0;   // filesystem clock ticks
+  uint64_t hash = 0;    // FNV-1a over the file contents (0 = not computed)
+};
+
+struct CoastIndexHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  uint64_t source_size;
+  int64_t  source_mtime;
+  uint64_t source_hash;
+
+  uint64_t vertex_count;
+  uint64_t ring_count;
+  uint64_t chunk_count;
+  uint64_t node_count;    // boxes in the tree, chunks included
+  uint32_t node_size;
+  uint32_t level_count;
+
+  uint64_t off_lon, off_lat, off_vflags;
+  uint64_t off_ring_first, off_ring_poly;
+  uint64_t off_chunk_first, off_chunk_ring, off_chunk_nseg;
+  uint64_t off_tree_boxes, off_tree_index, off_level_end;
+
+  // Bounds of all chunks (lon/lat degrees).
+  double min_lon, min_lat, max_lon, max_lat;
+};
+
+// Fingerprint of `shp_path`; the content hash is only computed if `with_hash`.
+CoastIndexSource coast_index_source_of(const std::filesystem::path& shp_path, bool with_hash);
+
+enum class CoastIndexStatus { Missing, Fresh, Stale, Invalid };
+const char* coast_index_status_name(CoastIndexStatus s);
+
+// Compares the index header against the shapefile. Size and mtime are checked
+// first; the (slow) content hash only when the size matches but the mtime does
+// not, e.g. after the same archive was re-extracted. A hash that matches is
+// recorded by writing the new mtime into the index (and its grids), so it is
+// only computed once per change.
+CoastIndexStatus coast_index_status(const std::filesystem::path& index_path,
+                                    const std::filesystem::path& shp_path);
+
+// Streaming builder. Vertex coordinates are spooled to temporary files next to
+// the output, so memory stays proportional to rings/chunks, not vertices.
+class CoastIndexWriter {
+public:
+  explicit CoastIndexWriter(const std::filesystem::path& out_path);
+  ~CoastIndexWriter();
+
+  CoastIndexWriter(const CoastIndexWriter&) = delete;
+  CoastIndexWriter& operator=(const CoastIndexWriter&) = delete;
+
+  // Starts a new polygon; the rings added next belong to it.
+  void begin_polygon();
+
+  // Adds one ring of n interleaved lon/lat points (closed or not). The first
+  // ring of a polygon is its exterior, later rings are holes.
+  void add_ring(const double* xy, std::size_t n, bool exterior);
+
+  // Builds the tree and atomically writes the index file.
+  void finish(const CoastIndexSource& src);
+
+private:
+  struct AxisEdge {
+    double key;          // constant coordinate
+    double lo, hi;       // extent along the other axis
+    uint32_t vertex;     // first vertex of the segment
+    bool vertical;       // x constant (else y constant)
+    bool forward;        // direction along the axis (lo -> hi)
+  };
+
+  std::filesystem::path out_path_;
+  std::filesystem::path tmp_lon_, tmp_lat_;
+  std::FILE* f_lon_ = nullptr;
+  std::FILE* f_lat_ = nullptr;
+
+  uint64_t vertex_count_ = 0;
+  uint32_t poly_count_ = 0;
+  std::vector<uint32_t> ring_first_;
+  std::vector<uint32_t> ring_poly_;
+  std::vector<uint32_t> chunk_first_;
+  std::vector<uint32_t> chunk_ring_;
+  std::vector<uint16_t> chunk_nseg_;
+  std::vector<double>   chunk_box_;   // 4 per chunk
+  std::vector<uint8_t>  vflags_;
+  std::vector<AxisEdge> axis_edges_;
+  std::vector<double>   ring_xy_;     // scratch
+
+  void mark_seams();
+  void cleanup_tmp();
+};
+
+// Read-only view of a compiled index.
+class CoastIndex {
+public:
+  // Throws std::runtime_error if the file is missing, truncated or of another version.
+  explicit CoastIndex(const std::filesystem::path& path);
+
+  const CoastIndexHeader& header() const { return *hdr_; }
+
+  std::size_t vertex_count() const { return (std::size_t)hdr_->vertex_count; }
+  std::size_t ring_count()   const { return (std::size_t)hdr_->ring_count; }
+  std::size_t chunk_count()  const { return (std::size_t)hdr_->chunk_count; }
+
+  const double*   lon() const { return lon_; }
+  const double*   lat() const { return lat_; }
+  const uint8_t*  vflags() const { return vflags_; }
+
+  uint32_t ring_begin(uint32_t ring) const { return ring_first_[ring]; }
+  uint32_t ring_end(uint32_t ring) const { return ring_first_[ring + 1]; }  // one past the last vertex
+  uint32_t ring_poly(uint32_t ring) const { return ring_poly_[ring]; }
+
+  uint32_t chunk_first(uint32_t c) const { return chunk_first_[c]; }
+  uint32_t chunk_ring(uint32_t c) const { return chunk_ring_[c]; }
+  uint32_t chunk_nseg(uint32_t c) const { return chunk_nseg_[c]; }
+
+  // Packed R-tree access (flatbush layout). Positions [0, chunk_count) are
+  // leaf boxes whose tree_index is a chunk id; higher positions are internal
+  // nodes whose tree_index is the position of their first child.
+  std::size_t node_count() const { return (std::size_t)hdr_->node_count; }
+  std::size_t node_size() const { return hdr_->node_size; }
+  const double* node_box(std::size_t pos) const { return tree_boxes_ + pos * 4; }
+  uint32_t node_index(std::size_t pos) const { return tree_index_[pos]; }
+  std::size_t root_pos() const { return node_count() - 1; }
+  // One past the last position of the level containing `pos`.
+  std::size_t level_end_of(std::size_t pos) const;
+
+  // Visits the id of every chunk whose box intersects the lon/lat rectangle.
+  template <class Fn>
+  void search(double min_lon, double min_lat, double max_lon, double max_lat, Fn&& visit) const {
+    std::vector<std::size_t> stack;
+    std::size_t pos = root_pos();
+    while (true) {
+      const std::size_t end = std::min(pos + node_size(), level_end_of(pos));
+      for (std::size_t i = pos; i < end; ++i) {
+        const double* b = node_box(i);
+        if (b[2] < min_lon || b[3] < min_lat || b[0] > max_lon || b[1] > max_lat) continue;
+        if (i < chunk_count()) visit(node_index(i));
+        else stack.push_back(node_index(i));
+      }
+      if (stack.empty()) break;
+      pos = stack.back();
+      stack.pop_back();
+    }
+  }
+
+private:
+  MappedFile file_;
+  const CoastIndexHeader* hdr_ = nullptr;
+  const double* lon_ = nullptr;
+  const double* lat_ = nullptr;
+  const uint8_t* vflags_ = nullptr;
+  const uint32_t* ring_first_ = nullptr;
+  const uint32_t* ring_poly_ = nullptr;
+  const uint32_t* chunk_first_ = nullptr;
+  const uint32_t* chunk_ring_ = nullptr;
+  const uint16_t* chunk_nseg_ = nullptr;
+  const double* tree_boxes_ = nullptr;
+  const uint32_t* tree_index_ = nullptr;
+  const uint64_t* level_end_ = nullptr;
+};
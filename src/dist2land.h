@@ -0,0 +1,103 @@
+/* libdist2land: C API for embedding the distance engine in-process.
+ *
+ * An engine opens a provider's dataset once and answers any number of
+ * queries against it. Calls never throw and, once an engine is warm, queries
+ * do not allocate: results go into caller-provided structs and errors into a
+ * fixed buffer inside the engine. An engine is not thread-safe; open one per
+ * thread. Distinct engines are independent.
+ */
+#ifndef DIST2LAND_H
+#define DIST2LAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define DIST2LAND_API __attribute__((visibility("default")))
+#else
+#define DIST2LAND_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped on incompatible changes; also the shared library's SOVERSION. */
+#define DIST2LAND_API_VERSION 1
+
+/* Return codes. */
+#define DIST2LAND_OK 0
+#define DIST2LAND_EINVAL 1   /* null or out-of-range argument */
+#define DIST2LAND_EOPEN 2    /* provider not installed, dataset unreadable */
+#define DIST2LAND_EQUERY 3   /* a query failed (see dist2land_last_error) */
+
+typedef struct dist2land_engine dist2land_engine;
+
+typedef struct dist2land_result {
+  double geodesic_m;     /* 0 when in_land */
+  double land_lat_deg;   /* nearest land point (the query point if in_land) */
+  double land_lon_deg;
+  int in_land;           /* 0/1 */
+  int status;            /* DIST2LAND_OK or DIST2LAND_EQUERY */
+} dist2land_result;
+
+/* Work done by an engine's queries since it was opened. Allocations are not
+ * counted: that takes replacing the global operator new, which a library must
+ * not do to its host process (the dist2land CLI counts them itself). */
+typedef struct dist2land_stats {
+  uint64_t queries;
+  uint64_t passes;     /* search radius iterations */
+  uint64_t windows;    /* spatial searches */
+  uint64_t features;   /* index chunks or shapefile features measured */
+  uint64_t vertices;   /* vertices projected */
+} dist2land_stats;
+
+/* Wall time of queries by phase, while profiling is on. */
+typedef struct dist2land_profile {
+  double setup_ms;
+  double search_ms;
+  double finish_ms;
+} dist2land_profile;
+
+/* DIST2LAND_API_VERSION of the library actually loaded. */
+DIST2LAND_API int dist2land_api_version(void);
+
+/* Opens an engine. `provider_id` is "osm", "gshhg", "ne" or "auto"/NULL for
+ * the best installed one; `shp_path` NULL means the provider's installed
+ * shapefile (as set up by `dist2land setup`), otherwise that file. On failure
+ * *out is NULL and the reason is written to `errbuf` (may be NULL). */
+DIST2LAND_API int dist2land_open(const char* provider_id, const char* shp_path,
+                                 dist2land_engine** out, char* errbuf, size_t errbuf_cap);
+
+/* Closes an engine; NULL is ignored. */
+DIST2LAND_API void dist2land_close(dist2land_engine* engine);
+
+/* Nearest land to one point. */
+DIST2LAND_API int dist2land_query(dist2land_engine* engine, double lat_deg, double lon_deg,
+                                  dist2land_result* out);
+
+/* Nearest land to `n` points, lat_deg[i]/lon_deg[i] into out[i]. A failing
+ * point does not stop the batch: its status is DIST2LAND_EQUERY and the call
+ * returns DIST2LAND_EQUERY, with the last failure's message kept. */
+DIST2LAND_API int dist2land_query_batch(dist2land_engine* engine, const double* lat_deg,
+                                        const double* lon_deg, size_t n, dist2land_result* out);
+
+/* Message of the engine's last failed call, "" if none. Valid until the next
+ * call on the engine. */
+DIST2LAND_API const char* dist2land_last_error(const dist2land_engine* engine);
+
+/* Provider the engine answers for, e.g. "osm". */
+DIST2LAND_API const char* dist2land_provider_id(const dist2land_engine* engine);
+
+DIST2LAND_API int dist2land_get_stats(const dist2land_engine* engine, dist2land_stats* out);
+
+/* Turns phase timing on (from zero) or off. Costs two clock reads per phase
+ * while on, nothing while off. */
+DIST2LAND_API int dist2land_set_profiling(dist2land_engine* engine, int enabled);
+DIST2LAND_API int dist2land_get_profile(const dist2land_engine* engine, dist2land_profile* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIST2LAND_H */
@@ -0,0 +1,167 @@
+// C API of libdist2land (dist2land.h) over DistanceBackend. Exceptions stop
+// here: each entry point catches them and turns them into a return code plus
+// a message copied into the engine's fixed error buffer.
+#include "dist2land.h"
+
+#include "distance_backend.h"
+#include "providers.h"
+#include "util.h"
+
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+struct dist2land_engine {
+  std::string provider_id;
+  std::unique_ptr<DistanceBackend> backend;
+  QueryProfile profile;
+  char error[512] = "";
+};
+
+static void copy_message(char* buf, size_t cap, const char* msg) {
+  if (!buf || cap == 0) return;
+  std::snprintf(buf, cap, "%s", msg);
+}
+
+static void fail(dist2land_engine* e, const char* msg) {
+  copy_message(e->error, sizeof e->error, msg);
+}
+
+static void fill(dist2land_result* out, const DistanceQueryResult& r) {
+  out->geodesic_m = r.geodesic_m;
+  out->land_lat_deg = r.land_lat_deg;
+  out->land_lon_deg = r.land_lon_deg;
+  out->in_land = r.in_land ? 1 : 0;
+  out->status = DIST2LAND_OK;
+}
+
+// One point into `out`; on failure the message goes to the engine.
+static int query_one(dist2land_engine* e, double lat_deg, double lon_deg, dist2land_result* out) {
+  if (!(lat_deg >= -90.0 && lat_deg <= 90.0) || !(lon_deg >= -180.0 && lon_deg <= 180.0)) {
+    fail(e, "lat must be in [-90, 90] and lon in [-180, 180] degrees");
+  } else {
+    try {
+      fill(out, e->backend->query(lat_deg, lon_deg));
+      return DIST2LAND_OK;
+    } catch (const std::exception& ex) {
+      fail(e, ex.what());
+    } catch (...) {
+      fail(e, "unknown error");
+    }
+  }
+  *out = dist2land_result{};
+  out->status = DIST2LAND_EQUERY;
+  return DIST2LAND_EQUERY;
+}
+
+extern "C" {
+
+int dist2land_api_version(void) {
+  return DIST2LAND_API_VERSION;
+}
+
+int dist2land_open(const char* provider_id, const char* shp_path,
+                   dist2land_engine** out, char* errbuf, size_t errbuf_cap) {
+  if (!out) {
+    copy_message(errbuf, errbuf_cap, "dist2land_open: out is NULL");
+    return DIST2LAND_EINVAL;
+  }
+  *out = nullptr;
+  try {
+    std::string prov = to_lower(provider_id ? provider_id : "auto");
+    if (prov == "auto") {
+      prov = best_available_provider_id();
+      if (prov.empty()) throw std::runtime_error("No providers installed. Run: dist2land setup --provider ne");
+    }
+    const Provider p = provider_by_id(prov);
+
+    std::filesystem::path shp;
+    if (shp_path && *shp_path) {
+      shp = shp_path;
+    } else {
+      if (!provider_installed(p)) {
+        throw std::runtime_error("Provider '" + p.id + "' not installed. Run: dist2land setup --provider " + p.id);
+      }
+      shp = provider_shapefile_path(p);
+    }
+
+    auto e = std::make_unique<dist2land_engine>();
+    e->provider_id = p.id;
+    e->backend = open_distance_backend(p.id, shp);
+    *out = e.release();
+    return DIST2LAND_OK;
+  } catch (const std::exception& ex) {
+    copy_message(errbuf, errbuf_cap, ex.what());
+  } catch (...) {
+    copy_message(errbuf, errbuf_cap, "unknown error");
+  }
+  return DIST2LAND_EOPEN;
+}
+
+void dist2land_close(dist2land_engine* engine) {
+  delete engine;
+}
+
+int dist2land_query(dist2land_engine* engine, double lat_deg, double lon_deg,
+                    dist2land_result* out) {
+  if (!engine) return DIST2LAND_EINVAL;
+  engine->error[0] = '\0';
+  if (!out) {
+    fail(engine, "dist2land_query: out is NULL");
+    return DIST2LAND_EINVAL;
+  }
+  return query_one(engine, lat_deg, lon_deg, out);
+}
+
+int dist2land_query_batch(dist2land_engine* engine, const double* lat_deg,
+                          const double* lon_deg, size_t n, dist2land_result* out) {
+  if (!engine) return DIST2LAND_EINVAL;
+  engine->error[0] = '\0';
+  if (n > 0 && (!lat_deg || !lon_deg || !out)) {
+    fail(engine, "dist2land_query_batch: NULL array");
+    return DIST2LAND_EINVAL;
+  }
+  int rc = DIST2LAND_OK;
+  for (size_t i = 0; i < n; ++i) {
+    if (query_one(engine, lat_deg[i], lon_deg[i], &out[i]) != DIST2LAND_OK) rc = DIST2LAND_EQUERY;
+  }
+  return rc;
+}
+
+const char* dist2land_last_error(const dist2land_engine* engine) {
+  return engine ? engine->error : "engine is NULL";
+}
+
+const char* dist2land_provider_id(const dist2land_engine* engine) {
+  return engine ? engine->provider_id.c_str() : "";
+}
+
+int dist2land_get_stats(const dist2land_engine* engine, dist2land_stats* out) {
+  if (!engine || !out) return DIST2LAND_EINVAL;
+  const QueryStats& s = engine->backend->stats();
+  out->queries = s.queries;
+  out->passes = s.passes;
+  out->windows = s.windows;
+  out->features = s.features;
+  out->vertices = s.vertices;
+  return DIST2LAND_OK;
+}
+
+int dist2land_set_profiling(dist2land_engine* engine, int enabled) {
+  if (!engine) return DIST2LAND_EINVAL;
+  engine->profile = QueryProfile{};
+  engine->backend->set_profile(enabled ? &engine->profile : nullptr);
+  return DIST2LAND_OK;
+}
+
+int dist2land_get_profile(const dist2land_engine* engine, dist2land_profile* out) {
+  if (!engine || !out) return DIST2LAND_EINVAL;
+  out->setup_ms = engine->profile.setup_ms;
+  out->search_ms = engine->profile.search_ms;
+  out->finish_ms = engine->profile.finish_ms;
+  return DIST2LAND_OK;
+}
+
+} // extern "C"
@@ -1,31 +1,184 @@
-#ifdef _WIN32
-
+// The dist2land_gdal plugin: DistanceBackend behind the C ABI in
+// dist2land_gdal_plugin_api.h.
+#include "dist2land_gdal_plugin_api.h"
+#include "distance_backend.h"
 #include "ogr_distance.h"
 #include <cstdio>
 #include <exception>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
-extern "C" __declspec(dllexport)
-int dist2land_gdal_ping(char* errbuf, int errbuf_cap) {
+namespace {
+
+struct PluginHandle {
+  std::unique_ptr<DistanceBackend> backend;
+  QueryProfile profile;
+  std::vector<CoastPoint> points;   // nearby() scratch
+  std::vector<RouteClearance> legs;   // route() scratch
+};
+
+void write_error(char* errbuf, int errbuf_cap, const char* msg) {
+  if (errbuf && errbuf_cap > 0) {
+    std::snprintf(errbuf, (size_t)errbuf_cap, "%s", msg);
+    errbuf[errbuf_cap - 1] = '\0';
+  }
+}
+
+// Runs `body`, turning exceptions into an error code and message.
+template <class F>
+int guarded(char* errbuf, int errbuf_cap, F&& body) {
   try {
-    // Force-load dependencies and prove the DLL can be loaded/called.
+    body();
     return 0;
   } catch (const std::exception& e) {
-    if (errbuf && errbuf_cap > 0) {
-      std::snprintf(errbuf, (size_t)errbuf_cap, "%s", e.what());
-      errbuf[errbuf_cap - 1] = '\0';
-    }
+    write_error(errbuf, errbuf_cap, e.what());
     return 1;
   } catch (...) {
-    if (errbuf && errbuf_cap > 0) {
-      std::snprintf(errbuf, (size_t)errbuf_cap, "Unknown exception in GDAL backend");
-      errbuf[errbuf_cap - 1] = '\0';
-    }
+    write_error(errbuf, errbuf_cap, "Unknown exception in GDAL backend");
     return 2;
   }
 }
 
-extern "C" __declspec(dllexport)
+PluginHandle& handle_or_throw(void* handle) {
+  if (!handle) throw std::runtime_error("dist2land_gdal: null handle");
+  return *static_cast<PluginHandle*>(handle);
+}
+
+} // namespace
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_ping(char* errbuf, int errbuf_cap) {
+  // Loading the plugin already resolved GDAL; nothing else to prove.
+  return guarded(errbuf, errbuf_cap, [] {});
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_abi_version() {
+  return kDist2LandGdalAbiVersion;
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_open(const char* shp_path, const char* provider_id, void** handle,
+                        char* errbuf, int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    if (!shp_path || !handle) throw std::runtime_error("dist2land_gdal_open: invalid arguments");
+    *handle = nullptr;
+    auto h = std::make_unique<PluginHandle>();
+    h->backend = open_distance_backend(provider_id ? provider_id : "", std::filesystem::path(shp_path));
+    *handle = h.release();
+  });
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_query_many(void* handle, std::size_t n,
+                              const double* lat_deg, const double* lon_deg,
+                              double* geodesic_m, double* land_lat_deg, double* land_lon_deg,
+                              unsigned char* in_land, std::size_t* done,
+                              char* errbuf, int errbuf_cap) {
+  std::size_t i = 0;
+  const int rc = guarded(errbuf, errbuf_cap, [&] {
+    auto& h = handle_or_throw(handle);
+    if (n > 0 && (!lat_deg || !lon_deg || !geodesic_m || !land_lat_deg || !land_lon_deg || !in_land)) {
+      throw std::runtime_error("dist2land_gdal_query_many: invalid arguments");
+    }
+    for (; i < n; ++i) {
+      const auto r = h.backend->query(lat_deg[i], lon_deg[i]);
+      geodesic_m[i] = r.geodesic_m;
+      land_lat_deg[i] = r.land_lat_deg;
+      land_lon_deg[i] = r.land_lon_deg;
+      in_land[i] = r.in_land ? 1 : 0;
+    }
+  });
+  if (done) *done = i;
+  return rc;
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_nearby(void* handle, double lat_deg, double lon_deg,
+                          std::size_t k, double radius_m, int per_polygon,
+                          Dist2LandGdalCoastPoint* out, std::size_t cap,
+                          std::size_t* count, char* errbuf, int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    auto& h = handle_or_throw(handle);
+    if (!count || (cap > 0 && !out)) throw std::runtime_error("dist2land_gdal_nearby: invalid arguments");
+    NearbyQuery q;
+    q.k = k;
+    q.radius_m = radius_m;
+    q.per_polygon = per_polygon != 0;
+    h.backend->nearby(lat_deg, lon_deg, q, h.points);
+    *count = h.points.size();
+    for (std::size_t i = 0; i < h.points.size() && i < cap; ++i) {
+      const CoastPoint& p = h.points[i];
+      out[i] = Dist2LandGdalCoastPoint{p.geodesic_m, p.lat_deg, p.lon_deg, p.polygon};
+    }
+  });
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_ray(void* handle, double lat_deg, double lon_deg, double bearing_deg,
+                       double max_m, Dist2LandGdalRayHit* out, char* errbuf, int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    auto& h = handle_or_throw(handle);
+    if (!out) throw std::runtime_error("dist2land_gdal_ray: invalid arguments");
+    const RayHit r = h.backend->ray(lat_deg, lon_deg, bearing_deg, max_m);
+    *out = Dist2LandGdalRayHit{r.hit ? 1 : 0, r.in_land ? 1 : 0, r.geodesic_m, r.lat_deg, r.lon_deg};
+  });
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_route(void* handle, std::size_t n, const double* lat_deg, const double* lon_deg,
+                         int per_leg, Dist2LandGdalRouteClearance* out, std::size_t cap,
+                         std::size_t* count, char* errbuf, int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    auto& h = handle_or_throw(handle);
+    if (!count || (n > 0 && (!lat_deg || !lon_deg)) || (n > 1 && cap + 1 < n) || (cap > 0 && !out)) {
+      throw std::runtime_error("dist2land_gdal_route: invalid arguments");
+    }
+    h.backend->route(n, lat_deg, lon_deg, per_leg != 0, h.legs);
+    *count = h.legs.size();
+    for (std::size_t i = 0; i < h.legs.size(); ++i) {
+      const RouteClearance& r = h.legs[i];
+      out[i] = Dist2LandGdalRouteClearance{r.geodesic_m, r.lat_deg, r.lon_deg, r.land_lat_deg,
+                                           r.land_lon_deg, (uint64_t)r.leg, r.in_land ? 1 : 0};
+    }
+  });
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_set_profiling(void* handle, int enabled, char* errbuf, int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    auto& h = handle_or_throw(handle);
+    h.profile = QueryProfile{};
+    h.backend->set_profile(enabled ? &h.profile : nullptr);
+  });
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_counters(void* handle, Dist2LandGdalCounters* out, char* errbuf, int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    auto& h = handle_or_throw(handle);
+    if (!out) throw std::runtime_error("dist2land_gdal_counters: invalid arguments");
+    const QueryStats& s = h.backend->stats();
+    *out = Dist2LandGdalCounters{s.queries, s.passes, s.windows, s.features, s.vertices,
+                                 h.profile.setup_ms, h.profile.search_ms, h.profile.finish_ms};
+  });
+}
+
+DIST2LAND_GDAL_EXPORT
+const char* dist2land_gdal_backend_name(void* handle) {
+  return handle ? static_cast<PluginHandle*>(handle)->backend->name() : "";
+}
+
+DIST2LAND_GDAL_EXPORT
+void dist2land_gdal_close(void* handle) {
+  delete static_cast<PluginHandle*>(handle);
+}
+
+// One-shot query that opens the dataset for this point alone. Superseded by
+// the handle calls above; kept for executables built against the old ABI.
+DIST2LAND_GDAL_EXPORT
 int dist2land_gdal_distance(const char* shp_path,
                             const char* provider_id,
                             double lat_deg, double lon_deg,
@@ -34,31 +187,41 @@ int dist2land_gdal_distance(const char* shp_path,
                             double* land_lon_deg,
                             char* errbuf,
                             int errbuf_cap) {
-  try {
+  return guarded(errbuf, errbuf_cap, [&] {
     if (!shp_path || !geodesic_m || !land_lat_deg || !land_lon_deg) {
       throw std::runtime_error("dist2land_gdal_distance: invalid arguments");
     }
 
     const std::string prov = provider_id ? provider_id : "";
-    auto r = distance_query_geodesic_ogr(lat_deg, lon_deg, prov, std::filesystem::path(shp_path));
+    auto r = open_distance_backend(prov, std::filesystem::path(shp_path))->query(lat_deg, lon_deg);
 
     *geodesic_m   = r.geodesic_m;
     *land_lat_deg = r.land_lat_deg;
     *land_lon_deg = r.land_lon_deg;
-    return 0;
-  } catch (const std::exception& e) {
-    if (errbuf && errbuf_cap > 0) {
-      std::snprintf(errbuf, (size_t)errbuf_cap, "%s", e.what());
-      errbuf[errbuf_cap - 1] = '\0';
-    }
-    return 1;
-  } catch (...) {
-    if (errbuf && errbuf_cap > 0) {
-      std::snprintf(errbuf, (size_t)errbuf_cap, "Unknown exception in GDAL backend");
-      errbuf[errbuf_cap - 1] = '\0';
+  });
+}
+
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_build_index(const char* shp_path,
+                               const char* index_path,
+                               char* errbuf,
+                               int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    if (!shp_path || !index_path) {
+      throw std::runtime_error("dist2land_gdal_build_index: invalid arguments");
     }
-    return 2;
-  }
+    build_coast_index_ogr(std::filesystem::path(shp_path), std::filesystem::path(index_path));
+  });
 }
 
-#endif
+DIST2LAND_GDAL_EXPORT
+int dist2land_gdal_build_spatial_index(const char* shp_path,
+                                       char* errbuf,
+                                       int errbuf_cap) {
+  return guarded(errbuf, errbuf_cap, [&] {
+    if (!shp_path) {
+      throw std::runtime_error("dist2land_gdal_build_spatial_index: invalid arguments");
+    }
+    build_spatial_index_ogr(std::filesystem::path(shp_path));
+  });
+}
@@ -1,11 +1,105 @@
 #pragma once
+// ABI of the dist2land_gdal plugin (dist2land_gdal.dll on Windows,
+// dist2land_gdal.so with DIST2LAND_GDAL_PLUGIN=ON elsewhere), which keeps GDAL
+// out of the executable. Plain C types only; nothing throws across it.
+//
+// Queries go through a handle that keeps the dataset open, and points cross
+// the boundary in arrays, so a batch costs one call rather than one per point.
+// Every call returns 0 on success and writes a message to `errbuf` otherwise.
 #include <cstddef>
+#include <cstdint>
 
-struct Dist2LandQueryOut {
+#ifdef _WIN32
+#define DIST2LAND_GDAL_EXPORT extern "C" __declspec(dllexport)
+#else
+#define DIST2LAND_GDAL_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+// Returned by dist2land_gdal_abi_version; bump on incompatible changes.
+static constexpr int kDist2LandGdalAbiVersion = 6;
+
+// QueryStats and QueryProfile of a handle, flattened.
+struct Dist2LandGdalCounters {
+  uint64_t queries;
+  uint64_t passes;
+  uint64_t windows;
+  uint64_t features;
+  uint64_t vertices;
+  double setup_ms;    // phase times, summed while profiling is on
+  double search_ms;
+  double finish_ms;
+};
+
+// CoastPoint, flattened.
+struct Dist2LandGdalCoastPoint {
+  double geodesic_m;
+  double lat_deg;
+  double lon_deg;
+  int64_t polygon;
+};
+
+// RayHit, flattened (hit and in_land 0/1).
+struct Dist2LandGdalRayHit {
+  int hit;
+  int in_land;
+  double geodesic_m;
+  double lat_deg;
+  double lon_deg;
+};
+
+// RouteClearance, flattened.
+struct Dist2LandGdalRouteClearance {
   double geodesic_m;
+  double lat_deg;
+  double lon_deg;
   double land_lat_deg;
   double land_lon_deg;
-  int    in_land; // 0/1
+  uint64_t leg;
+  int in_land;
 };
 
-static constexpr const char* kDist2LandGdalProcName = "dist2land_gdal_query_geodesic";
+using Dist2LandGdalAbiVersionFn = int (*)();
+
+// Opens the dataset for `shp_path` (UTF-8), using the provider's coastline
+// index when it is fresh, and returns a handle in *handle.
+using Dist2LandGdalOpenFn = int (*)(const char* shp_path, const char* provider_id, void** handle,
+                                    char* errbuf, int errbuf_cap);
+
+// Answers points [0, n): lat_deg/lon_deg in, the other arrays out (in_land
+// 0/1). Stops at the first point that fails, with *done the number answered
+// before it, so the caller can report that point and continue after it.
+using Dist2LandGdalQueryManyFn = int (*)(void* handle, std::size_t n,
+                                         const double* lat_deg, const double* lon_deg,
+                                         double* geodesic_m, double* land_lat_deg,
+                                         double* land_lon_deg, unsigned char* in_land,
+                                         std::size_t* done, char* errbuf, int errbuf_cap);
+
+// DistanceEngine::nearby: writes the first min(*count, cap) points to `out`
+// and the number found to *count; call again with a larger array if that
+// was more than `cap`.
+using Dist2LandGdalNearbyFn = int (*)(void* handle, double lat_deg, double lon_deg,
+                                      std::size_t k, double radius_m, int per_polygon,
+                                      Dist2LandGdalCoastPoint* out, std::size_t cap,
+                                      std::size_t* count, char* errbuf, int errbuf_cap);
+
+// DistanceEngine::ray.
+using Dist2LandGdalRayFn = int (*)(void* handle, double lat_deg, double lon_deg, double bearing_deg,
+                                   double max_m, Dist2LandGdalRayHit* out, char* errbuf, int errbuf_cap);
+
+// DistanceEngine::route over waypoints [0, n): the minimum (per_leg 0) or one
+// entry per leg (per_leg 1) into `out`, which must have room for n - 1.
+using Dist2LandGdalRouteFn = int (*)(void* handle, std::size_t n, const double* lat_deg,
+                                     const double* lon_deg, int per_leg,
+                                     Dist2LandGdalRouteClearance* out, std::size_t cap,
+                                     std::size_t* count, char* errbuf, int errbuf_cap);
+
+// Turns phase timing on (from zero) or off.
+using Dist2LandGdalSetProfilingFn = int (*)(void* handle, int enabled, char* errbuf, int errbuf_cap);
+
+using Dist2LandGdalCountersFn = int (*)(void* handle, Dist2LandGdalCounters* out,
+                                        char* errbuf, int errbuf_cap);
+
+// DistanceBackend::name of the handle ("index" or "shapefile"); static storage.
+using Dist2LandGdalBackendNameFn = const char* (*)(void* handle);
+
+using Dist2LandGdalCloseFn = void (*)(void* handle);
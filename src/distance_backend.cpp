@@ -0,0 +1,17 @@
+#include "distance_backend.h"
+#include "app_paths.h"
+#include "bound_grid.h"
+#include "coast_index.h"
+#include "index_distance.h"
+#include "ogr_distance.h"
+
+std::unique_ptr<DistanceBackend> open_distance_backend(const std::string& provider_id,
+                                                       const std::filesystem::path& shp_path) {
+  const auto idx = coast_index_path(provider_id);
+  if (coast_index_status(idx, shp_path) == CoastIndexStatus::Fresh) {
+    return std::make_unique<IndexDistanceEngine>(idx);
+  }
+  // A bound grid left by an index that is now stale (e.g. from an older
+  // format version) still applies if the shapefile is unchanged.
+  return std::make_unique<OgrDistanceEngine>(shp_path, bound_grid_path(idx));
+}
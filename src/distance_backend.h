@@ -0,0 +1,91 @@
+#pragma once
+#include "distance_iface.h"
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Query implementation behind DistanceEngine (POSIX), libdist2land and the
+// GDAL plugin. Implementations keep their dataset open between queries and
+// are not thread-safe; use one per thread. Results carry only the numbers;
+// DistanceEngine fills in provider_id and shp_path, so a warm query need not
+// allocate.
+class DistanceBackend {
+public:
+  virtual ~DistanceBackend() = default;
+  virtual DistanceQueryResult query(double lat_deg, double lon_deg) = 0;
+
+  // "index" or "shapefile": what the backend answers from.
+  virtual const char* name() const = 0;
+
+  // See DistanceEngine::query_near.
+  virtual DistanceQueryResult query_near(double lat_deg, double lon_deg, TrackHint& hint) {
+    (void)hint;
+    return query(lat_deg, lon_deg);
+  }
+
+  // See DistanceEngine::nearby; `out` is cleared first. Only the coastline
+  // index backend implements it.
+  virtual void nearby(double lat_deg, double lon_deg, const NearbyQuery& q, std::vector<CoastPoint>& out) {
+    (void)lat_deg;
+    (void)lon_deg;
+    (void)q;
+    (void)out;
+    throw std::runtime_error("nearby queries need the coastline index (run: dist2land build-index)");
+  }
+
+  // See DistanceEngine::ray. Only the coastline index backend implements it.
+  virtual RayHit ray(double lat_deg, double lon_deg, double bearing_deg, double max_m) {
+    (void)lat_deg;
+    (void)lon_deg;
+    (void)bearing_deg;
+    (void)max_m;
+    throw std::runtime_error("bearing queries need the coastline index (run: dist2land build-index)");
+  }
+
+  // See DistanceEngine::route: `out` gets the route's minimum, or with
+  // per_leg one entry per leg. Only the coastline index backend implements it.
+  virtual void route(std::size_t n, const double* lat_deg, const double* lon_deg, bool per_leg,
+                     std::vector<RouteClearance>& out) {
+    (void)n;
+    (void)lat_deg;
+    (void)lon_deg;
+    (void)per_leg;
+    (void)out;
+    throw std::runtime_error("route queries need the coastline index (run: dist2land build-index)");
+  }
+
+  const QueryStats& stats() const { return stats_; }
+  void set_profile(QueryProfile* profile) { profile_ = profile; }
+
+protected:
+  QueryStats stats_;                   // maintained by the implementations
+  QueryProfile* profile_ = nullptr;    // see PhaseTimer
+};
+
+// Charges the time since the previous mark (or construction) to a phase of
+// a QueryProfile; free when there is no profile.
+class PhaseTimer {
+public:
+  explicit PhaseTimer(QueryProfile* profile) : profile_(profile) {
+    if (profile_) last_ = std::chrono::steady_clock::now();
+  }
+
+  void mark(double QueryProfile::*phase) {
+    if (!profile_) return;
+    const auto t = std::chrono::steady_clock::now();
+    profile_->*phase += std::chrono::duration<double, std::milli>(t - last_).count();
+    last_ = t;
+  }
+
+private:
+  QueryProfile* profile_;
+  std::chrono::steady_clock::time_point last_{};
+};
+
+// Uses the compiled coastline index (coast_index_path) when it is fresh for
+// `shp_path`, and falls back to reading the shapefile through OGR otherwise.
+std::unique_ptr<DistanceBackend> open_distance_backend(const std::string& provider_id,
+                                                       const std::filesystem::path& shp_path);
@@ -0,0 +1,383 @@
+// Distance calls through the dist2land_gdal plugin (dist2land_gdal_plugin_api.h).
+// Always used on Windows, where it keeps GDAL out of the executable; on POSIX
+// with DIST2LAND_GDAL_PLUGIN=ON, so that path can be tested and benchmarked.
+#include "dist2land_gdal_plugin_api.h"
+#include "distance_iface.h"
+#include "win_runtime.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <limits.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+static constexpr const char* kPluginFile = "dist2land_gdal.dll";
+
+static std::wstring exe_dir_w() {
+  wchar_t buf[MAX_PATH];
+  DWORD n = GetModuleFileNameW(nullptr, buf, MAX_PATH);
+  std::wstring path(buf, buf + n);
+  auto pos = path.find_last_of(L"\\/");
+  if (pos == std::wstring::npos) return L".";
+  return path.substr(0, pos);
+}
+
+static std::string utf8_from_wstring(const std::wstring& w) {
+  if (w.empty()) return {};
+  int n = WideCharToMultiByte(CP_UTF8, 0, w.data(), (int)w.size(), nullptr, 0, nullptr, nullptr);
+  if (n <= 0) return {};
+  std::string out;
+  out.resize((size_t)n);
+  WideCharToMultiByte(CP_UTF8, 0, w.data(), (int)w.size(), out.data(), n, nullptr, nullptr);
+  return out;
+}
+
+static std::string win_errmsg(DWORD err) {
+  wchar_t* msg = nullptr;
+  DWORD flags = FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS;
+  DWORD n = FormatMessageW(flags, nullptr, err, 0, (LPWSTR)&msg, 0, nullptr);
+  std::wstring w = (n && msg) ? std::wstring(msg, msg + n) : L"";
+  if (msg) LocalFree(msg);
+  // trim
+  while (!w.empty() && (w.back() == L'\r' || w.back() == L'\n' || w.back() == L' ')) w.pop_back();
+  auto s = utf8_from_wstring(w);
+  if (s.empty()) s = "Windows error " + std::to_string((unsigned long)err);
+  return s;
+}
+
+static std::string path_u8(const std::filesystem::path& p) {
+  return utf8_from_wstring(p.wstring());
+}
+
+static std::filesystem::path default_plugin_path() {
+  return std::filesystem::path(exe_dir_w()) / kPluginFile;
+}
+
+static void* load_library(const std::filesystem::path& path, std::string& error) {
+  // Its dependent DLLs should be resolved from the plugin's own folder.
+  HMODULE mod = LoadLibraryExW(path.c_str(), nullptr,
+                               LOAD_LIBRARY_SEARCH_DLL_LOAD_DIR | LOAD_LIBRARY_SEARCH_DEFAULT_DIRS);
+  if (!mod) error = win_errmsg(GetLastError());
+  return (void*)mod;
+}
+
+static void* find_symbol(void* lib, const char* name) {
+  return (void*)GetProcAddress((HMODULE)lib, name);
+}
+#else
+static constexpr const char* kPluginFile = "dist2land_gdal.so";
+
+static std::string path_u8(const std::filesystem::path& p) {
+  return p.string();
+}
+
+static std::filesystem::path default_plugin_path() {
+  char buf[PATH_MAX];
+  ssize_t n = ::readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+  if (n <= 0) return kPluginFile;
+  buf[n] = '\0';
+  return std::filesystem::path(buf).parent_path() / kPluginFile;
+}
+
+static void* load_library(const std::filesystem::path& path, std::string& error) {
+  void* lib = ::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!lib) error = ::dlerror();
+  return lib;
+}
+
+static void* find_symbol(void* lib, const char* name) {
+  return ::dlsym(lib, name);
+}
+#endif
+
+using BuildIndexFn = int (*)(
+  const char* shp_path,
+  const char* index_path,
+  char* errbuf,
+  int errbuf_cap
+);
+
+using BuildSpatialIndexFn = int (*)(
+  const char* shp_path,
+  char* errbuf,
+  int errbuf_cap
+);
+
+struct PluginApi {
+  Dist2LandGdalOpenFn open = nullptr;
+  Dist2LandGdalQueryManyFn query_many = nullptr;
+  Dist2LandGdalNearbyFn nearby = nullptr;
+  Dist2LandGdalRayFn ray = nullptr;
+  Dist2LandGdalRouteFn route = nullptr;
+  Dist2LandGdalSetProfilingFn set_profiling = nullptr;
+  Dist2LandGdalCountersFn counters = nullptr;
+  Dist2LandGdalBackendNameFn backend_name = nullptr;
+  Dist2LandGdalCloseFn close = nullptr;
+  BuildIndexFn build_index = nullptr;
+  BuildSpatialIndexFn build_spatial_index = nullptr;
+};
+
+static PluginApi load_plugin_or_throw() {
+  // Critical: set PROJ_DATA/PROJ_LIB/GDAL_DATA to native paths BEFORE GDAL/PROJ loads.
+  win_prepare_runtime();
+
+  std::filesystem::path path = default_plugin_path();
+  if (const char* env = std::getenv("DIST2LAND_GDAL_PLUGIN"); env && *env) path = env;
+
+  std::string error;
+  void* lib = load_library(path, error);
+  if (!lib) {
+    throw std::runtime_error("Failed to load " + std::string(kPluginFile) + " from: " + path_u8(path) +
+                             " (" + error + ")");
+  }
+  // The plugin stays loaded for the life of the process.
+
+  auto need = [&](const char* name) {
+    void* sym = find_symbol(lib, name);
+    if (!sym) {
+      throw std::runtime_error(path_u8(path) + " is missing symbol " + name +
+                               " (older plugin? rebuild it with this dist2land)");
+    }
+    return sym;
+  };
+
+  const auto version = (Dist2LandGdalAbiVersionFn)need("dist2land_gdal_abi_version");
+  if (version() != kDist2LandGdalAbiVersion) {
+    throw std::runtime_error(path_u8(path) + " has plugin ABI " + std::to_string(version()) +
+                             ", expected " + std::to_string(kDist2LandGdalAbiVersion));
+  }
+
+  PluginApi api;
+  api.open = (Dist2LandGdalOpenFn)need("dist2land_gdal_open");
+  api.query_many = (Dist2LandGdalQueryManyFn)need("dist2land_gdal_query_many");
+  api.nearby = (Dist2LandGdalNearbyFn)need("dist2land_gdal_nearby");
+  api.ray = (Dist2LandGdalRayFn)need("dist2land_gdal_ray");
+  api.route = (Dist2LandGdalRouteFn)need("dist2land_gdal_route");
+  api.set_profiling = (Dist2LandGdalSetProfilingFn)need("dist2land_gdal_set_profiling");
+  api.counters = (Dist2LandGdalCountersFn)need("dist2land_gdal_counters");
+  api.backend_name = (Dist2LandGdalBackendNameFn)need("dist2land_gdal_backend_name");
+  api.close = (Dist2LandGdalCloseFn)need("dist2land_gdal_close");
+  api.build_index = (BuildIndexFn)need("dist2land_gdal_build_index");
+  api.build_spatial_index = (BuildSpatialIndexFn)need("dist2land_gdal_build_spatial_index");
+  return api;
+}
+
+// Loaded on first use; a failed load is retried by the next call.
+static const PluginApi& plugin() {
+  static const PluginApi api = load_plugin_or_throw();
+  return api;
+}
+
+static void check(int rc, const char* errbuf, const char* what) {
+  if (rc != 0) throw std::runtime_error(errbuf[0] ? std::string(errbuf) : std::string(what));
+}
+
+// One plugin handle: the dataset stays open inside the plugin between calls.
+struct DistanceEngine::Impl {
+  void* handle = nullptr;
+  QueryProfile* profile = nullptr;
+  Dist2LandGdalCounters profiled{};   // plugin phase totals already added to *profile
+  // per-batch scratch, reused so the plugin can write straight into arrays
+  std::vector<double> geodesic_m, land_lat, land_lon;
+  std::vector<unsigned char> in_land;
+  std::vector<Dist2LandGdalCoastPoint> points;
+  char errbuf[2048] = {0};
+
+  Impl(const std::string& provider_id, const std::filesystem::path& shp_path) {
+    check(plugin().open(path_u8(shp_path).c_str(), provider_id.c_str(), &handle,
+                        errbuf, (int)sizeof(errbuf)),
+          errbuf, "GDAL backend open failed");
+  }
+
+  ~Impl() {
+    if (handle) plugin().close(handle);
+  }
+
+  Dist2LandGdalCounters counters() {
+    Dist2LandGdalCounters c{};
+    check(plugin().counters(handle, &c, errbuf, (int)sizeof(errbuf)), errbuf, "GDAL backend call failed");
+    return c;
+  }
+
+  // Adds the plugin's phase time since the last call to the attached profile.
+  void collect_profile() {
+    if (!profile) return;
+    const auto c = counters();
+    profile->setup_ms += c.setup_ms - profiled.setup_ms;
+    profile->search_ms += c.search_ms - profiled.search_ms;
+    profile->finish_ms += c.finish_ms - profiled.finish_ms;
+    profiled = c;
+  }
+};
+
+DistanceEngine::DistanceEngine(const std::string& provider_id,
+                               const std::filesystem::path& shp_path)
+    : provider_id_(provider_id),
+      shp_path_(shp_path),
+      impl_(std::make_unique<Impl>(provider_id, shp_path)) {}
+
+DistanceEngine::~DistanceEngine() = default;
+
+DistanceQueryResult DistanceEngine::query(double lat_deg, double lon_deg) {
+  DistanceQueryResult out;
+  std::string error;
+  query_many(1, &lat_deg, &lon_deg, &out, &error);
+  if (!error.empty()) throw std::runtime_error(error);
+  return out;
+}
+
+void DistanceEngine::query_many(std::size_t n, const double* lat_deg, const double* lon_deg,
+                                DistanceQueryResult* out, std::string* errors) {
+  Impl& im = *impl_;
+  im.geodesic_m.resize(n);
+  im.land_lat.resize(n);
+  im.land_lon.resize(n);
+  im.in_land.resize(n);
+
+  // One call per run of good points: the plugin stops at a failing point,
+  // which is reported here and skipped.
+  std::size_t i = 0;
+  while (i < n) {
+    std::size_t done = 0;
+    im.errbuf[0] = '\0';
+    const int rc = plugin().query_many(im.handle, n - i, lat_deg + i, lon_deg + i,
+                                       im.geodesic_m.data() + i, im.land_lat.data() + i,
+                                       im.land_lon.data() + i, im.in_land.data() + i,
+                                       &done, im.errbuf, (int)sizeof(im.errbuf));
+    for (std::size_t k = i; k < i + done; ++k) {
+      out[k].provider_id = provider_id_;
+      out[k].shp_path = shp_path_;
+      out[k].geodesic_m = im.geodesic_m[k];
+      out[k].land_lat_deg = im.land_lat[k];
+      out[k].land_lon_deg = im.land_lon[k];
+      out[k].in_land = im.in_land[k] != 0;
+      errors[k].clear();
+    }
+    i += done;
+    if (rc != 0 && i < n) {
+      out[i] = DistanceQueryResult{};
+      errors[i] = im.errbuf[0] ? im.errbuf : "GDAL backend call failed";
+      ++i;
+    }
+  }
+  im.collect_profile();
+}
+
+std::vector<CoastPoint> DistanceEngine::nearby(double lat_deg, double lon_deg, const NearbyQuery& q) {
+  Impl& im = *impl_;
+  if (im.points.size() < std::max<std::size_t>(q.k, 64)) im.points.resize(std::max<std::size_t>(q.k, 64));
+  std::size_t count = 0;
+  // A radius query may find more points than fit; then it is asked again.
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    im.errbuf[0] = '\0';
+    check(plugin().nearby(im.handle, lat_deg, lon_deg, q.k, q.radius_m, q.per_polygon ? 1 : 0,
+                          im.points.data(), im.points.size(), &count, im.errbuf, (int)sizeof(im.errbuf)),
+          im.errbuf, "GDAL backend call failed");
+    if (count <= im.points.size()) break;
+    im.points.resize(count);
+  }
+  im.collect_profile();
+
+  std::vector<CoastPoint> out(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto& p = im.points[i];
+    out[i] = CoastPoint{p.geodesic_m, p.lat_deg, p.lon_deg, p.polygon};
+  }
+  return out;
+}
+
+const char* DistanceEngine::backend_name() const {
+  return plugin().backend_name(impl_->handle);
+}
+
+RayHit DistanceEngine::ray(double lat_deg, double lon_deg, double bearing_deg, double max_m) {
+  Impl& im = *impl_;
+  Dist2LandGdalRayHit h{};
+  im.errbuf[0] = '\0';
+  check(plugin().ray(im.handle, lat_deg, lon_deg, bearing_deg, max_m, &h, im.errbuf, (int)sizeof(im.errbuf)),
+        im.errbuf, "GDAL backend call failed");
+  im.collect_profile();
+  return RayHit{h.hit != 0, h.geodesic_m, h.lat_deg, h.lon_deg, h.in_land != 0};
+}
+
+RouteClearance DistanceEngine::route(std::size_t n, const double* lat_deg, const double* lon_deg,
+                                     std::vector<RouteClearance>* legs) {
+  Impl& im = *impl_;
+  std::vector<Dist2LandGdalRouteClearance> raw(n > 1 ? n - 1 : 1);
+  std::size_t count = 0;
+  im.errbuf[0] = '\0';
+  check(plugin().route(im.handle, n, lat_deg, lon_deg, legs ? 1 : 0, raw.data(), raw.size(), &count,
+                       im.errbuf, (int)sizeof(im.errbuf)),
+        im.errbuf, "GDAL backend call failed");
+  im.collect_profile();
+
+  std::vector<RouteClearance> out(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto& r = raw[i];
+    out[i] = RouteClearance{r.geodesic_m, r.lat_deg, r.lon_deg, r.land_lat_deg, r.land_lon_deg,
+                            (std::size_t)r.leg, r.in_land != 0};
+  }
+  if (!legs) return out.front();
+  *legs = std::move(out);
+  return route_minimum(*legs);
+}
+
+DistanceQueryResult DistanceEngine::query_near(double lat_deg, double lon_deg, TrackHint& hint) {
+  // The plugin ABI has no way to pass the hint along.
+  (void)hint;
+  return query(lat_deg, lon_deg);
+}
+
+QueryStats DistanceEngine::stats() const {
+  const auto c = impl_->counters();
+  return QueryStats{c.queries, c.passes, c.windows, c.features, c.vertices};
+}
+
+void DistanceEngine::set_profile(QueryProfile* profile) {
+  Impl& im = *impl_;
+  check(plugin().set_profiling(im.handle, profile ? 1 : 0, im.errbuf, (int)sizeof(im.errbuf)),
+        im.errbuf, "GDAL backend call failed");
+  im.profile = profile;
+  im.profiled = Dist2LandGdalCounters{};
+}
+
+DistanceQueryResult distance_query_geodesic(double lat_deg, double lon_deg,
+                                           const std::string& provider_id,
+                                           const std::filesystem::path& shp_path) {
+  DistanceEngine engine(provider_id, shp_path);
+  return engine.query(lat_deg, lon_deg);
+}
+
+void build_coast_index(const std::filesystem::path& shp_path,
+                       const std::filesystem::path& index_path) {
+  char errbuf[2048] = {0};
+  int rc = plugin().build_index(path_u8(shp_path).c_str(), path_u8(index_path).c_str(),
+                                errbuf, (int)sizeof(errbuf));
+  check(rc, errbuf, "GDAL backend index build failed");
+}
+
+void build_spatial_index(const std::filesystem::path& shp_path) {
+  char errbuf[2048] = {0};
+  int rc = plugin().build_spatial_index(path_u8(shp_path).c_str(), errbuf, (int)sizeof(errbuf));
+  check(rc, errbuf, "GDAL backend spatial index build failed");
+}
+
+bool distance_backend_selftest(std::string* out_error) {
+  try {
+    plugin();
+    return true;
+  } catch (const std::exception& e) {
+    if (out_error) *out_error = e.what();
+    return false;
+  }
+}
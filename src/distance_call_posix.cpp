@@ -1,10 +1,96 @@
 #include "distance_iface.h"
+#include "distance_backend.h"
 #include "ogr_distance.h"
 
+struct DistanceEngine::Impl {
+  std::unique_ptr<DistanceBackend> backend;
+
+  Impl(const std::string& provider_id, const std::filesystem::path& shp_path)
+      : backend(open_distance_backend(provider_id, shp_path)) {}
+};
+
+DistanceEngine::DistanceEngine(const std::string& provider_id,
+                               const std::filesystem::path& shp_path)
+    : provider_id_(provider_id),
+      shp_path_(shp_path),
+      impl_(std::make_unique<Impl>(provider_id, shp_path)) {}
+
+DistanceEngine::~DistanceEngine() = default;
+
+const char* DistanceEngine::backend_name() const {
+  return impl_->backend->name();
+}
+
+DistanceQueryResult DistanceEngine::query(double lat_deg, double lon_deg) {
+  auto r = impl_->backend->query(lat_deg, lon_deg);
+  r.provider_id = provider_id_;
+  r.shp_path = shp_path_;
+  return r;
+}
+
+void DistanceEngine::query_many(std::size_t n, const double* lat_deg, const double* lon_deg,
+                                DistanceQueryResult* out, std::string* errors) {
+  for (std::size_t i = 0; i < n; ++i) {
+    try {
+      out[i] = query(lat_deg[i], lon_deg[i]);
+      errors[i].clear();
+    } catch (const std::exception& e) {
+      out[i] = DistanceQueryResult{};
+      errors[i] = e.what();
+    }
+  }
+}
+
+std::vector<CoastPoint> DistanceEngine::nearby(double lat_deg, double lon_deg, const NearbyQuery& q) {
+  std::vector<CoastPoint> out;
+  impl_->backend->nearby(lat_deg, lon_deg, q, out);
+  return out;
+}
+
+RayHit DistanceEngine::ray(double lat_deg, double lon_deg, double bearing_deg, double max_m) {
+  return impl_->backend->ray(lat_deg, lon_deg, bearing_deg, max_m);
+}
+
+RouteClearance DistanceEngine::route(std::size_t n, const double* lat_deg, const double* lon_deg,
+                                     std::vector<RouteClearance>* legs) {
+  std::vector<RouteClearance> out;
+  impl_->backend->route(n, lat_deg, lon_deg, legs != nullptr, out);
+  if (!legs) return out.front();
+  *legs = std::move(out);
+  return route_minimum(*legs);
+}
+
+DistanceQueryResult DistanceEngine::query_near(double lat_deg, double lon_deg, TrackHint& hint) {
+  auto r = impl_->backend->query_near(lat_deg, lon_deg, hint);
+  r.provider_id = provider_id_;
+  r.shp_path = shp_path_;
+  return r;
+}
+
+QueryStats DistanceEngine::stats() const {
+  return impl_->backend->stats();
+}
+
+void DistanceEngine::set_profile(QueryProfile* profile) {
+  impl_->backend->set_profile(profile);
+}
+
 DistanceQueryResult distance_query_geodesic(double lat_deg, double lon_deg,
                                            const std::string& provider_id,
                                            const std::filesystem::path& shp_path) {
-  return distance_query_geodesic_ogr(lat_deg, lon_deg, provider_id, shp_path);
+  auto r = open_distance_backend(provider_id, shp_path)->query(lat_deg, lon_deg);
+  r.provider_id = provider_id;
+  r.shp_path = shp_path;
+  return r;
+}
+
+void build_coast_index(const std::filesystem::path& shp_path,
+                       const std::filesystem::path& index_path) {
+  build_coast_index_ogr(shp_path, index_path);
+}
+
+void build_spatial_index(const std::filesystem::path& shp_path) {
+  build_spatial_index_ogr(shp_path);
 }
 
 bool distance_backend_selftest(std::string* out_error) {
@@ -1,6 +1,11 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <vector>
 
 struct DistanceQueryResult {
   std::string provider_id;
@@ -16,10 +21,165 @@ struct DistanceQueryResult {
   bool in_land = false;
 };
 
+// What one answer tells the next query near it (see DistanceTrack).
+struct TrackHint {
+  // The answer is known to be no farther than this (m).
+  double upper_bound_m = std::numeric_limits<double>::infinity();
+  // Backend-specific handle of where the previous nearest land was found
+  // (index chunk or shapefile FID), -1 if none; updated by query_near.
+  int64_t feature = -1;
+};
+
+// Selects the coastline returned by DistanceEngine::nearby. At least one of
+// k and radius_m must limit it.
+struct NearbyQuery {
+  std::size_t k = 0;   // at most this many points, 0 = no limit
+  double radius_m = std::numeric_limits<double>::infinity();   // only points this close
+  // One point per polygon (the polygon's nearest), so k points lie on k
+  // different polygons; otherwise one per coastline segment.
+  bool per_polygon = true;
+};
+
+// One coastline point returned by DistanceEngine::nearby.
+struct CoastPoint {
+  double geodesic_m = 0.0;
+  double lat_deg = 0.0;
+  double lon_deg = 0.0;
+  int64_t polygon = -1;   // polygon of the dataset it lies on (split datasets count pieces)
+};
+
+// Where a geodesic from a point first meets the coastline (DistanceEngine::ray).
+struct RayHit {
+  bool hit = false;        // false: no coastline within the range
+  double geodesic_m = 0.0; // along the geodesic; 0 when the start is on land
+  double lat_deg = 0.0;    // the crossing (the start when in_land)
+  double lon_deg = 0.0;
+  bool in_land = false;    // the start itself is on land
+};
+
+// Rays are followed this far at most; beyond it the projection they are
+// traced in becomes too distorted (a quarter of the way round the Earth).
+inline constexpr double kRayMaxRangeM = 10'000'000.0;
+
+// Closest approach of a route (or of one of its legs) to the coastline
+// (DistanceEngine::route). Leg i joins waypoints i and i + 1 along the geodesic.
+struct RouteClearance {
+  double geodesic_m = 0.0;     // 0 where the route touches or crosses land
+  double lat_deg = 0.0;        // the point of the route where it occurs
+  double lon_deg = 0.0;
+  double land_lat_deg = 0.0;   // nearest coastline to it (the point itself when on land)
+  double land_lon_deg = 0.0;
+  std::size_t leg = 0;
+  bool in_land = false;        // that point is on land (always so at a crossing)
+};
+
+// The nearest of a route's leg minima (the first on ties); legs must not be empty.
+inline const RouteClearance& route_minimum(const std::vector<RouteClearance>& legs) {
+  std::size_t best = 0;
+  for (std::size_t i = 1; i < legs.size(); ++i) {
+    if (legs[i].geodesic_m < legs[best].geodesic_m) best = i;
+  }
+  return legs[best];
+}
+
+// Work an engine's queries have done since it was opened: a few integer adds
+// per feature, always counted. Heap allocations are not among them: they are
+// counted by replacing the global operator new (alloc_counter.cpp), which only
+// an executable may do, so only dist2land and dist2land_bench report them.
+struct QueryStats {
+  uint64_t queries = 0;
+  uint64_t passes = 0;     // search radius iterations (a retry without a cap counts)
+  uint64_t windows = 0;    // spatial searches: shapefile windows, index tree walks
+  uint64_t features = 0;   // index chunks or shapefile features measured
+  uint64_t vertices = 0;   // vertices projected
+};
+
+// Wall time of queries by phase, summed while attached to an engine with
+// DistanceEngine::set_profile. Without one no clock is read at all.
+struct QueryProfile {
+  double setup_ms = 0.0;    // grid lookups, projection centred on the point
+  double search_ms = 0.0;   // window scans / tree search
+  double finish_ms = 0.0;   // nearest point back to lon/lat, land/water side
+};
+
+// Long-lived query engine: opens the provider dataset once in the constructor
+// and answers any number of queries against it. Not thread-safe; create one
+// engine per thread.
+class DistanceEngine {
+public:
+  DistanceEngine(const std::string& provider_id, const std::filesystem::path& shp_path);
+  ~DistanceEngine();
+
+  DistanceEngine(const DistanceEngine&) = delete;
+  DistanceEngine& operator=(const DistanceEngine&) = delete;
+
+  DistanceQueryResult query(double lat_deg, double lon_deg);
+
+  // Answers n points at once into out[0, n). A point that fails gets its
+  // message in errors[i] (cleared otherwise) and leaves out[i] default; the
+  // others are still answered. Through the GDAL plugin this is one call
+  // across the plugin boundary rather than one per point.
+  void query_many(std::size_t n, const double* lat_deg, const double* lon_deg,
+                  DistanceQueryResult* out, std::string* errors);
+
+  // Nearest coastline points to the point, nearest first, as selected by `q`.
+  // Distances are to the coastline itself, also for points on land. Needs
+  // the coastline index: throws while the engine is on the shapefile fallback.
+  std::vector<CoastPoint> nearby(double lat_deg, double lon_deg, const NearbyQuery& q);
+
+  // Follows the geodesic leaving the point at `bearing_deg` (clockwise from
+  // north) for up to `max_m` (capped at kRayMaxRangeM) and returns its first
+  // coastline crossing. Needs the coastline index, like nearby().
+  RayHit ray(double lat_deg, double lon_deg, double bearing_deg, double max_m = kRayMaxRangeM);
+
+  // Minimum distance to land along the route through n >= 2 waypoints, and
+  // where it occurs. With `legs`, also fills in the minimum of every leg (n - 1
+  // entries), a clearance profile of the route. Legs are measured segment
+  // against segment rather than point by point. Needs the coastline index.
+  RouteClearance route(std::size_t n, const double* lat_deg, const double* lon_deg,
+                       std::vector<RouteClearance>* legs = nullptr);
+
+  // Like query(), but only searches within hint.upper_bound_m and starts from
+  // hint.feature, which it updates. The index backend gives query()'s
+  // distance; the shapefile fallback may pick another near-equal segment.
+  // Backends without hint support (the GDAL plugin) just run query().
+  DistanceQueryResult query_near(double lat_deg, double lon_deg, TrackHint& hint);
+
+  // Totals over this engine's queries.
+  QueryStats stats() const;
+
+  // Adds the phase timings of later queries to `*profile` (null detaches).
+  void set_profile(QueryProfile* profile);
+
+  // What the engine answers from: "index" (the coastline index) or
+  // "shapefile" (the OGR fallback).
+  const char* backend_name() const;
+
+  const std::string& provider_id() const { return provider_id_; }
+  const std::filesystem::path& shp_path() const { return shp_path_; }
+
+  struct Impl;
+
+private:
+  std::string provider_id_;
+  std::filesystem::path shp_path_;
+  std::unique_ptr<Impl> impl_;
+};
+
 // Cross-platform API.
 DistanceQueryResult distance_query_geodesic(double lat_deg, double lon_deg,
                                            const std::string& provider_id,
                                            const std::filesystem::path& shp_path);
 
-// “Does the backend load?” (Windows: loads plugin + calls ping; POSIX: always true)
+// Compiles the coastline index for `shp_path` (see coast_index.h); queries use
+// it automatically while it is fresh.
+void build_coast_index(const std::filesystem::path& shp_path,
+                       const std::filesystem::path& index_path);
+
+// Writes the shapefile's GDAL spatial index (.qix, see
+// shapefile_spatial_index_path); the shapefile fallback needs it to avoid
+// scanning every feature per query.
+void build_spatial_index(const std::filesystem::path& shp_path);
+
+// “Does the backend load?” (GDAL plugin builds: loads it; otherwise always true)
 bool distance_backend_selftest(std::string* out_error = nullptr);
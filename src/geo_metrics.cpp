@@ -0,0 +1,119 @@
+#include "geo_metrics.h"
+#include "util.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+static constexpr double kPi = 3.141592653589793238462643383279502884;
+static double deg2rad(double d) { return d * (kPi / 180.0); }
+
+static double wrap_pi(double x) {
+  while (x >  kPi) x -= 2.0 * kPi;
+  while (x < -kPi) x += 2.0 * kPi;
+  return x;
+}
+
+double central_angle_rad(double lat1, double lon1, double lat2, double lon2) {
+  const double sdlat = std::sin(0.5 * (lat2 - lat1));
+  const double sdlon = std::sin(0.5 * (lon2 - lon1));
+  const double h = sdlat * sdlat + std::cos(lat1) * std::cos(lat2) * sdlon * sdlon;
+  return 2.0 * std::asin(std::sqrt(std::min(1.0, h)));
+}
+
+// Inside the box's longitude range the nearest point is straight north or
+// south; otherwise it lies on one of the two bounding meridians.
+double box_distance_lower_bound_m(double lat, double lon, const double* box_deg) {
+  const double lat0 = deg2rad(box_deg[1]), lat1 = deg2rad(box_deg[3]);
+  const double lon0 = deg2rad(box_deg[0]), lon1 = deg2rad(box_deg[2]);
+
+  // Eastward offset of the point from the box's west edge, in [0, 2pi).
+  const double dlon0 = std::fmod(lon - lon0 + 4.0 * kPi, 2.0 * kPi);
+  if (dlon0 <= lon1 - lon0 + 1e-12) {
+    const double d = lat < lat0 ? lat0 - lat : (lat > lat1 ? lat - lat1 : 0.0);
+    return d * kGeodesicLowerBoundRadiusM;
+  }
+
+  auto to_meridian = [&](double lon_e) {
+    const double dl = lon - lon_e;
+    double best = std::min(central_angle_rad(lat, lon, lat0, lon_e),
+                           central_angle_rad(lat, lon, lat1, lon_e));
+    // Foot of the perpendicular on the meridian's great circle.
+    const double c = std::cos(dl);
+    if (c > 0.0) {
+      const double foot = std::atan(std::tan(lat) / c);
+      if (foot > lat0 && foot < lat1) best = std::min(best, central_angle_rad(lat, lon, foot, lon_e));
+    }
+    return best;
+  };
+  return std::min(to_meridian(lon0), to_meridian(lon1)) * kGeodesicLowerBoundRadiusM;
+}
+
+double chord_distance_wgs84_m(double lat1_deg, double lon1_deg,
+                              double lat2_deg, double lon2_deg) {
+  // WGS84 ellipsoid
+  constexpr double a = 6378137.0;
+  constexpr double f = 1.0 / 298.257223563;
+  constexpr double e2 = f * (2.0 - f);
+
+  auto ecef = [&](double lat_deg, double lon_deg) {
+    const double lat = deg2rad(lat_deg);
+    const double lon = deg2rad(lon_deg);
+    const double sl = std::sin(lat), cl = std::cos(lat);
+    const double so = std::sin(lon), co = std::cos(lon);
+    const double N = a / std::sqrt(1.0 - e2 * sl * sl);
+    const double x = (N) * cl * co;
+    const double y = (N) * cl * so;
+    const double z = (N * (1.0 - e2)) * sl;
+    return std::array<double, 3>{x, y, z};
+  };
+
+  auto p1 = ecef(lat1_deg, lon1_deg);
+  auto p2 = ecef(lat2_deg, lon2_deg);
+  const double dx = p2[0] - p1[0];
+  const double dy = p2[1] - p1[1];
+  const double dz = p2[2] - p1[2];
+  return std::sqrt(dx*dx + dy*dy + dz*dz);
+}
+
+double rhumb_distance_sphere_m(double lat1_deg, double lon1_deg,
+                               double lat2_deg, double lon2_deg) {
+  // Spherical rhumb-line approximation
+  constexpr double R = 6371008.8; // mean Earth radius
+
+  const double phi1 = deg2rad(lat1_deg);
+  const double phi2 = deg2rad(lat2_deg);
+  const double dphi = phi2 - phi1;
+
+  const double lam1 = deg2rad(lon1_deg);
+  const double lam2 = deg2rad(lon2_deg);
+  const double dlam = wrap_pi(lam2 - lam1);
+
+  const auto merc = [](double phi) {
+    const double eps = 1e-12;
+    const double p = std::max(std::min(phi,  kPi/2 - eps), -kPi/2 + eps);
+    return std::log(std::tan(kPi/4 + p/2));
+  };
+
+  const double dpsi = merc(phi2) - merc(phi1);
+  const double q = (std::abs(dpsi) > 1e-12) ? (dphi / dpsi) : std::cos(phi1);
+
+  return std::sqrt(dphi*dphi + (q*dlam)*(q*dlam)) * R;
+}
+
+double metric_distance_m(const std::string& metric, double lat_deg, double lon_deg,
+                         const DistanceQueryResult& r) {
+  if (metric == "geodesic") return r.geodesic_m;
+  if (metric == "chord")    return chord_distance_wgs84_m(lat_deg, lon_deg, r.land_lat_deg, r.land_lon_deg);
+  if (metric == "rhumb")    return rhumb_distance_sphere_m(lat_deg, lon_deg, r.land_lat_deg, r.land_lon_deg);
+  throw std::runtime_error("Unknown --metric: " + metric + " (use geodesic|chord|rhumb)");
+}
+
+double convert_units(double meters, const std::string& units) {
+  auto u = to_lower(units);
+  if (u == "m")  return meters;
+  if (u == "km") return meters / 1000.0;
+  if (u == "nm") return meters / 1852.0;
+  throw std::runtime_error("Unknown units: " + units);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "distance_iface.h"
+#include <string>
+
+static constexpr double kEarthMeanRadiusM = 6371008.8;
+
+// Spherical distances understate or overstate WGS84 geodesics by at most
+// ~0.5%; these radii turn a central angle into a safe lower / upper bound.
+static constexpr double kGeodesicLowerBoundRadiusM = 0.99 * kEarthMeanRadiusM;
+static constexpr double kGeodesicUpperBoundRadiusM = 1.01 * kEarthMeanRadiusM;
+
+// Great-circle central angle (haversine); all angles in radians.
+double central_angle_rad(double lat1, double lon1, double lat2, double lon2);
+
+// Lower bound (m) of the geodesic distance from (lat, lon) in radians to the
+// lon/lat box {min_lon, min_lat, max_lon, max_lat} in degrees.
+double box_distance_lower_bound_m(double lat, double lon, const double* box_deg);
+
+// Alternative distance metrics between the query point and the land point
+// found by the geodesic search.
+double chord_distance_wgs84_m(double lat1_deg, double lon1_deg,
+                              double lat2_deg, double lon2_deg);
+double rhumb_distance_sphere_m(double lat1_deg, double lon1_deg,
+                               double lat2_deg, double lon2_deg);
+
+// Distance in meters for --metric (geodesic|chord|rhumb); throws on unknown metric.
+double metric_distance_m(const std::string& metric, double lat_deg, double lon_deg,
+                         const DistanceQueryResult& r);
+
+// Meters to --units (m|km|nm); throws on unknown units.
+double convert_units(double meters, const std::string& units);
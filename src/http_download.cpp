@@ -1,6 +1,14 @@
 #include "http_download.h"
+#include "util.h"
 #include <curl/curl.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
 #include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <utility>
 #include <stdexcept>
 #include <filesystem>
 #include <mutex>
@@ -9,10 +17,6 @@
   #include <windows.h>
 #endif
 
-static size_t write_file(void* ptr, size_t size, size_t nmemb, void* stream) {
-  return std::fwrite(ptr, size, nmemb, (FILE*)stream);
-}
-
 #ifdef _WIN32
 static std::filesystem::path exe_dir() {
   wchar_t buf[MAX_PATH];
@@ -22,29 +26,21 @@ static std::filesystem::path exe_dir() {
 }
 #endif
 
-DownloadResult http_download_to(const std::string& url, const std::filesystem::path& out_file) {
+static void curl_init_once() {
   static std::once_flag g_curl_init;
   std::call_once(g_curl_init, []{
     curl_global_init(CURL_GLOBAL_DEFAULT);
   });
+}
 
-  if (!out_file.parent_path().empty()) {
-    std::filesystem::create_directories(out_file.parent_path());
-  }
-
-  auto tmp = out_file;
-  tmp += ".part";
-
-  FILE* fp = std::fopen(tmp.string().c_str(), "wb");
-  if (!fp) throw std::runtime_error("Failed to open for write: " + tmp.string());
-
+// An easy handle for `url` with the options every transfer shares.
+static CURL* new_transfer(const std::string& url) {
+  curl_init_once();
   CURL* curl = curl_easy_init();
-  if (!curl) { std::fclose(fp); throw std::runtime_error("curl_easy_init failed"); }
+  if (!curl) throw std::runtime_error("curl_easy_init failed");
 
   curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_file);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "dist2land");
 
   // Reasonable timeouts
@@ -59,23 +55,693 @@ DownloadResult http_download_to(const std::string& url, const std::filesystem::p
     curl_easy_setopt(curl, CURLOPT_CAINFO, ca.string().c_str());
   }
 #endif
+  return curl;
+}
 
-  CURLcode res = curl_easy_perform(curl);
-  long code = 0;
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+static bool seek_to(FILE* fp, uint64_t pos) {
+#ifdef _WIN32
+  return _fseeki64(fp, (long long)pos, SEEK_SET) == 0;
+#else
+  return fseeko(fp, (off_t)pos, SEEK_SET) == 0;
+#endif
+}
 
-  curl_easy_cleanup(curl);
+void ContentHash::update(const void* data, std::size_t n) {
+  constexpr uint64_t prime = 1099511628211ull;
+  const auto* p = static_cast<const unsigned char*>(data);
+  uint64_t h = state;
+  for (std::size_t i = 0; i < n; ++i) h = (h ^ p[i]) * prime;
+  state = h;
+  bytes += n;
+}
+
+std::string ContentHash::hex() const {
+  char buf[32];
+  std::snprintf(buf, sizeof buf, "fnv1a64:%016" PRIx64, state);
+  return buf;
+}
+
+// Feeds `h` the bytes of `path` from h.bytes up to `upto`: the part of a
+// resumed download that arrived in an earlier run, or ranges that arrived
+// ahead of the hash.
+static void hash_from_file(ContentHash& h, const std::filesystem::path& path, uint64_t upto) {
+  if (h.bytes >= upto) return;
+  FILE* fp = std::fopen(path.string().c_str(), "rb");
+  if (!fp) return;
+  std::vector<char> buf(1 << 20);
+  if (seek_to(fp, h.bytes)) {
+    while (h.bytes < upto) {
+      const std::size_t want = (std::size_t)std::min<uint64_t>(buf.size(), upto - h.bytes);
+      const std::size_t got = std::fread(buf.data(), 1, want, fp);
+      if (got == 0) break;
+      h.update(buf.data(), got);
+    }
+  }
   std::fclose(fp);
+}
 
-  if (res != CURLE_OK) {
-    std::filesystem::remove(tmp);
-    throw std::runtime_error(std::string("Download failed: ") + curl_easy_strerror(res));
+// Picks the validators (and Accept-Ranges) out of one response header line.
+// A status line starts the next response after a redirect and clears them.
+static void parse_header(const char* buf, std::size_t n, RemoteVersion& v, bool* ranges) {
+  std::string line(buf, n);
+  while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) line.pop_back();
+  const auto colon = line.find(':');
+  const std::string name = to_lower(line.substr(0, colon));
+  if (name.rfind("http/", 0) == 0) {
+    v = RemoteVersion{};
+    if (ranges) *ranges = false;
+    return;
   }
-  if (code >= 400) {
-    std::filesystem::remove(tmp);
-    throw std::runtime_error("HTTP error code: " + std::to_string(code));
+  if (colon == std::string::npos) return;
+  std::string value = line.substr(colon + 1);
+  value.erase(0, value.find_first_not_of(" \t"));
+
+  if (name == "etag") v.etag = value;
+  else if (name == "last-modified") v.last_modified = value;
+  else if (name == "content-length") v.length = std::strtoll(value.c_str(), nullptr, 10);
+  else if (name == "accept-ranges" && ranges) *ranges = to_lower(value).find("bytes") != std::string::npos;
+}
+
+static constexpr int kMaxRetries = 5;   // per connection, for dropped transfers
+static constexpr uint64_t kMinParallelBytes = 8ull << 20;
+
+namespace {
+// What a HEAD request tells us about the download.
+struct Probe {
+  int64_t length = -1;   // -1 = unknown
+  bool ranges = false;   // Accept-Ranges: bytes
+  RemoteVersion version;
+};
+
+size_t probe_header(char* buf, size_t size, size_t nitems, void* userdata) {
+  auto* pr = static_cast<Probe*>(userdata);
+  parse_header(buf, size * nitems, pr->version, &pr->ranges);
+  return size * nitems;
+}
+
+size_t version_header(char* buf, size_t size, size_t nitems, void* userdata) {
+  parse_header(buf, size * nitems, *static_cast<RemoteVersion*>(userdata), nullptr);
+  return size * nitems;
+}
+
+// HEAD request for `url` with `extra` request headers; returns the status
+// code, or 0 if the request itself failed.
+long head(const std::string& url, Probe& pr, curl_slist* extra = nullptr) {
+  CURL* curl = new_transfer(url);
+  curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, probe_header);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &pr);
+  if (extra) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, extra);
+  long code = 0;
+  if (curl_easy_perform(curl) == CURLE_OK) {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_off_t len = -1;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &len);
+    if (code < 400) pr.length = len;
   }
+  curl_easy_cleanup(curl);
+  return code;
+}
 
+Probe probe(const std::string& url) {
+  Probe pr;
+  const long code = head(url, pr);
+  // Some servers refuse HEAD; then nothing is known and nothing is assumed.
+  if (code == 0 || code >= 400 || pr.length < 0) pr = Probe{};
+  pr.version.length = pr.length;
+  return pr;
+}
+
+// "\r  312.4 / 731.0 MB  43%  6.1 MB/s" on stderr, at most once a second.
+class ProgressLine {
+public:
+  ProgressLine(bool enabled, uint64_t total, uint64_t resumed)
+      : enabled_(enabled), total_(total), resumed_(resumed), start_(std::chrono::steady_clock::now()) {}
+
+  // True when a second has passed since the last report (also a good time
+  // to checkpoint).
+  bool due() const { return std::chrono::steady_clock::now() - last_ >= std::chrono::seconds(1); }
+
+  void report(uint64_t have, bool final = false) {
+    last_ = std::chrono::steady_clock::now();
+    if (!enabled_) return;
+    const double mb = 1024.0 * 1024.0;
+    const double rate = (double)(have - std::min(have, resumed_)) / mb / std::max(seconds(), 1e-3);
+    std::fprintf(stderr, "\r  %.1f", have / mb);
+    if (total_ > 0) std::fprintf(stderr, " / %.1f MB  %3d%%", total_ / mb, (int)(100.0 * have / total_));
+    else std::fprintf(stderr, " MB");
+    std::fprintf(stderr, "  %.1f MB/s ", rate);
+    if (final) std::fprintf(stderr, "\n");
+    std::fflush(stderr);
+  }
+
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+private:
+  bool enabled_;
+  uint64_t total_, resumed_;
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point last_{};
+};
+
+// ---- resume note ----
+
+struct Range {
+  uint64_t begin = 0, end = 0;   // [begin, end)
+  uint64_t done = 0;             // bytes of the range already on disk
+  int failures = 0;
+  CURL* curl = nullptr;
+  bool checked = false;          // response code verified
+  bool bad_status = false;       // server answered without 206
+  FILE* fp = nullptr;
+  ContentHash* hash = nullptr;   // fed directly while this range is where it stands
+};
+
+// <out>.part.ranges: what an interrupted download had done, so the next run
+// can carry on. Written before the first byte of the .part and rewritten
+// atomically once a second; a .part without one is never resumed.
+//   <total> <hashed bytes> <hash state>
+//   <If-Range validator, may be empty>
+//   <begin> <end> <done>          one line per range (parallel downloads only)
+struct PartNote {
+  uint64_t total = 0;           // 0 = length unknown
+  std::string validator;
+  ContentHash hash;             // over the first hash.bytes bytes of the .part
+  std::vector<Range> ranges;
+};
+
+std::filesystem::path note_path_for(const std::filesystem::path& tmp) {
+  auto p = tmp;
+  p += ".ranges";
+  return p;
+}
+
+// If-Range wants a strong ETag or a date.
+std::string if_range_value(const RemoteVersion& v) {
+  if (!v.etag.empty() && v.etag.rfind("W/", 0) != 0) return v.etag;
+  return v.last_modified;
+}
+
+uint64_t remaining(const std::vector<Range>& ranges) {
+  uint64_t n = 0;
+  for (const auto& r : ranges) n += (r.end - r.begin) - r.done;
+  return n;
+}
+
+// End of the data on disk that follows `pos` without a gap. Everything
+// before the first range was there when the ranges were laid out.
+uint64_t contiguous_end(const std::vector<Range>& ranges, uint64_t pos) {
+  uint64_t end = ranges.empty() ? pos : std::max(pos, ranges.front().begin);
+  for (const auto& r : ranges) {
+    if (r.end <= end) continue;
+    if (r.begin > end) break;
+    end = r.begin + r.done;
+    if (r.done < r.end - r.begin) break;
+  }
+  return end;
+}
+
+bool load_note(const std::filesystem::path& path, PartNote& note) {
+  note = PartNote{};
+  std::ifstream f(path);
+  std::string line;
+  if (!(f >> note.total >> note.hash.bytes >> note.hash.state) || !std::getline(f, line) ||
+      !std::getline(f, note.validator)) {
+    note = PartNote{};
+    return false;
+  }
+  Range r;
+  while (f >> r.begin >> r.end >> r.done) {
+    if (r.begin > r.end || r.end > note.total || r.done > r.end - r.begin ||
+        (!note.ranges.empty() && r.begin != note.ranges.back().end)) {
+      break;
+    }
+    note.ranges.push_back(r);
+  }
+  if (!f.eof() || (!note.ranges.empty() && note.hash.bytes > contiguous_end(note.ranges, 0))) {
+    note = PartNote{};
+    return false;
+  }
+  return true;
+}
+
+// Returns false if the note could not be written.
+bool save_note(const std::filesystem::path& path, const PartNote& note) {
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::trunc);
+    f << note.total << " " << note.hash.bytes << " " << note.hash.state << "\n" << note.validator << "\n";
+    for (const auto& r : note.ranges) f << r.begin << " " << r.end << " " << r.done << "\n";
+    if (!f) return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  return !ec;
+}
+
+// ---- single connection ----
+
+struct SingleSink {
+  FILE* fp;
+  CURL* curl;
+  std::filesystem::path path, note_path;
+  bool resuming;       // asked for a Range; a 200 means the server ignored it
+  bool checked = false;
+  uint64_t have;
+  PartNote* note;      // note->hash runs over the file as it is written
+  ProgressLine* progress;
+};
+
+size_t single_write(char* ptr, size_t size, size_t nmemb, void* userdata) {
+  auto* s = static_cast<SingleSink*>(userdata);
+  if (!s->checked) {
+    s->checked = true;
+    long code = 0;
+    curl_easy_getinfo(s->curl, CURLINFO_RESPONSE_CODE, &code);
+    if (s->resuming && code == 200) {
+      // Full body instead of the rest (or the file changed): start over.
+      s->fp = std::freopen(s->path.string().c_str(), "wb", s->fp);
+      if (!s->fp) return 0;
+      s->have = 0;
+      s->note->hash = ContentHash{};
+    }
+  }
+  const size_t n = std::fwrite(ptr, size, nmemb, s->fp);
+  s->have += n * size;
+  s->note->hash.update(ptr, n * size);
+  return n * size;
+}
+
+int single_progress(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+  auto* s = static_cast<SingleSink*>(userdata);
+  if (s->progress->due()) {
+    std::fflush(s->fp);
+    save_note(s->note_path, *s->note);
+    s->progress->report(s->have);
+  }
+  return 0;
+}
+
+// ---- parallel ranges ----
+
+size_t range_write(char* ptr, size_t size, size_t nmemb, void* userdata) {
+  auto* r = static_cast<Range*>(userdata);
+  if (!r->checked) {
+    r->checked = true;
+    long code = 0;
+    curl_easy_getinfo(r->curl, CURLINFO_RESPONSE_CODE, &code);
+    if (code != 206) {
+      r->bad_status = true;
+      return 0;
+    }
+  }
+  const size_t n = size * nmemb;
+  if (n > r->end - r->begin - r->done) return 0;   // more than we asked for
+  if (!seek_to(r->fp, r->begin + r->done) || std::fwrite(ptr, 1, n, r->fp) != n) return 0;
+  if (r->hash->bytes == r->begin + r->done) r->hash->update(ptr, n);
+  r->done += n;
+  return n;
+}
+} // namespace
+
+static void start_range(const std::string& url, CURLM* multi, curl_slist* headers, Range& r) {
+  r.curl = new_transfer(url);
+  r.checked = false;
+  const std::string spec = std::to_string(r.begin + r.done) + "-" + std::to_string(r.end - 1);
+  curl_easy_setopt(r.curl, CURLOPT_RANGE, spec.c_str());   // copied by libcurl
+  curl_easy_setopt(r.curl, CURLOPT_WRITEFUNCTION, range_write);
+  curl_easy_setopt(r.curl, CURLOPT_WRITEDATA, &r);
+  curl_easy_setopt(r.curl, CURLOPT_PRIVATE, &r);
+  curl_easy_setopt(r.curl, CURLOPT_FAILONERROR, 1L);
+  if (headers) curl_easy_setopt(r.curl, CURLOPT_HTTPHEADER, headers);
+  curl_multi_add_handle(multi, r.curl);
+}
+
+static void stop_range(CURLM* multi, Range& r) {
+  if (!r.curl) return;
+  curl_multi_remove_handle(multi, r.curl);
+  curl_easy_cleanup(r.curl);
+  r.curl = nullptr;
+}
+
+// If-Range makes the server send the whole (new) file instead of a range
+// of a file that changed since the .part was started.
+static curl_slist* if_range_header(const std::string& validator) {
+  if (validator.empty()) return nullptr;
+  return curl_slist_append(nullptr, ("If-Range: " + validator).c_str());
+}
+
+// Fetches the unfinished parts of `note.ranges` into `tmp`, one connection
+// per range. Returns false if the server turned out not to honour ranges.
+static bool fetch_ranges(const std::string& url, const std::filesystem::path& tmp,
+                         const std::filesystem::path& note_path, PartNote& note, ProgressLine& progress) {
+  FILE* fp = std::fopen(tmp.string().c_str(), std::filesystem::exists(tmp) ? "r+b" : "wb");
+  if (!fp) throw std::runtime_error("Failed to open for write: " + tmp.string());
+  CURLM* multi = curl_multi_init();
+  if (!multi) {
+    std::fclose(fp);
+    throw std::runtime_error("curl_multi_init failed");
+  }
+  curl_slist* headers = if_range_header(note.validator);
+  auto& ranges = note.ranges;
+
+  // Ranges that finished ahead of the hash are read back while the page
+  // cache still has them.
+  auto checkpoint = [&] {
+    std::fflush(fp);
+    hash_from_file(note.hash, tmp, contiguous_end(ranges, note.hash.bytes));
+    save_note(note_path, note);
+  };
+  auto cleanup = [&] {
+    for (auto& r : ranges) stop_range(multi, r);
+    curl_multi_cleanup(multi);
+    curl_slist_free_all(headers);
+  };
+
+  // The ranges go on record before any of them writes: a parallel .part is
+  // sparse, and without its note it would pass for a finished prefix (or,
+  // over an older single-connection note, for a longer one).
+  if (!save_note(note_path, note)) {
+    cleanup();
+    std::fclose(fp);
+    throw std::runtime_error("Failed to write " + note_path.string());
+  }
+
+  bool ranges_ok = true;
+  try {
+    int active = 0;
+    for (auto& r : ranges) {
+      r.fp = fp;
+      r.hash = &note.hash;
+      if (r.done < r.end - r.begin) {
+        start_range(url, multi, headers, r);
+        ++active;
+      }
+    }
+
+    while (active > 0) {
+      int running = 0;
+      if (curl_multi_perform(multi, &running) != CURLM_OK) {
+        throw std::runtime_error("Download failed: curl_multi_perform");
+      }
+      int queued = 0;
+      while (CURLMsg* m = curl_multi_info_read(multi, &queued)) {
+        if (m->msg != CURLMSG_DONE) continue;
+        Range* r = nullptr;
+        curl_easy_getinfo(m->easy_handle, CURLINFO_PRIVATE, (char**)&r);
+        const CURLcode res = m->data.result;
+        long code = 0;
+        curl_easy_getinfo(r->curl, CURLINFO_RESPONSE_CODE, &code);
+        stop_range(multi, *r);
+        --active;
+
+        if (r->bad_status) {
+          ranges_ok = false;
+          continue;
+        }
+        if (res == CURLE_OK && r->done == r->end - r->begin) continue;
+        if (code >= 400) throw std::runtime_error("HTTP error code: " + std::to_string(code));
+        if (++r->failures > kMaxRetries) {
+          throw std::runtime_error(std::string("Download failed: ") + curl_easy_strerror(res));
+        }
+        // Dropped connection: pick the range up where it stopped.
+        start_range(url, multi, headers, *r);
+        ++active;
+      }
+      if (!ranges_ok) break;
+
+      if (progress.due()) {
+        checkpoint();
+        progress.report(note.total - remaining(ranges));
+      }
+      if (active > 0) curl_multi_poll(multi, nullptr, 0, 500, nullptr);
+    }
+  } catch (...) {
+    cleanup();
+    checkpoint();   // keep what we have for the next attempt
+    std::fclose(fp);
+    throw;
+  }
+
+  cleanup();
+  if (std::fclose(fp) != 0) throw std::runtime_error("Failed to write " + tmp.string());
+  if (ranges_ok) hash_from_file(note.hash, tmp, note.total);
+  progress.report(note.total - remaining(ranges), true);
+  return ranges_ok;
+}
+
+// Plain GET into `tmp`, resuming from its current size if `resume`.
+// Validators the GET reports fill in what `version` lacks.
+static long fetch_single(const std::string& url, const std::filesystem::path& tmp,
+                         const std::filesystem::path& note_path, bool resume, PartNote& note,
+                         RemoteVersion& version, ProgressLine& progress) {
+  std::error_code ec;
+  for (int attempt = 0;; ++attempt) {
+    uint64_t have = resume && std::filesystem::exists(tmp, ec) ? std::filesystem::file_size(tmp, ec) : 0;
+    if (ec) have = 0;
+    if (note.hash.bytes > have) note.hash = ContentHash{};
+    hash_from_file(note.hash, tmp, have);
+    if (note.hash.bytes != have) {
+      note.hash = ContentHash{};
+      have = 0;
+    }
+
+    FILE* fp = std::fopen(tmp.string().c_str(), have ? "ab" : "wb");
+    if (!fp) throw std::runtime_error("Failed to open for write: " + tmp.string());
+    if (resume) save_note(note_path, note);
+
+    CURL* curl = new_transfer(url);
+    SingleSink sink{fp, curl, tmp, note_path, have > 0, false, have, &note, &progress};
+    RemoteVersion got;
+    curl_slist* headers = have > 0 ? if_range_header(note.validator) : nullptr;
+    // A plain Range rather than CURLOPT_RESUME_FROM: libcurl fails a resume
+    // that gets a 200, while single_write wants that 200 to start over.
+    const std::string range = std::to_string(have) + "-";
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, single_write);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, version_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &got);
+    if (have > 0) curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, single_progress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &sink);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    if (headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    const CURLcode res = curl_easy_perform(curl);
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_cleanup(curl);
+    curl_slist_free_all(headers);
+    const bool closed = sink.fp && std::fclose(sink.fp) == 0;
+
+    if (code >= 400) {
+      // 416 after a complete earlier run is handled by the caller's size check.
+      throw std::runtime_error("HTTP error code: " + std::to_string(code));
+    }
+    if (res == CURLE_OK && closed) {
+      progress.report(sink.have, true);
+      if (version.etag.empty() && version.last_modified.empty()) {
+        version.etag = got.etag;
+        version.last_modified = got.last_modified;
+      }
+      return code;
+    }
+    if (resume) save_note(note_path, note);
+    if (attempt >= kMaxRetries) {
+      throw std::runtime_error(std::string("Download failed: ") + curl_easy_strerror(res));
+    }
+  }
+}
+
+bool http_remote_changed(const std::string& url, const RemoteVersion& known, RemoteVersion* now) {
+  curl_slist* headers = nullptr;
+  if (!known.etag.empty()) headers = curl_slist_append(headers, ("If-None-Match: " + known.etag).c_str());
+  if (!known.last_modified.empty()) {
+    headers = curl_slist_append(headers, ("If-Modified-Since: " + known.last_modified).c_str());
+  }
+  Probe pr;
+  const long code = head(url, pr, headers);
+  curl_slist_free_all(headers);
+  if (code == 0 || code >= 400) {
+    throw std::runtime_error("Update check failed for " + url +
+                             (code ? ": HTTP error code " + std::to_string(code) : std::string()));
+  }
+  pr.version.length = pr.length;
+  if (code == 304) {
+    if (now) *now = known;
+    return false;
+  }
+  if (now) *now = pr.version;
+
+  // The server ignored the conditions (or there were none): compare.
+  if (!known.etag.empty() && !pr.version.etag.empty()) return known.etag != pr.version.etag;
+  if (!known.last_modified.empty() && !pr.version.last_modified.empty()) {
+    return known.last_modified != pr.version.last_modified ||
+           (known.length >= 0 && pr.version.length >= 0 && known.length != pr.version.length);
+  }
+  return true;
+}
+
+DownloadResult http_download_to(const std::string& url, const std::filesystem::path& out_file,
+                                const DownloadOptions& opt) {
+  if (!out_file.parent_path().empty()) {
+    std::filesystem::create_directories(out_file.parent_path());
+  }
+
+  auto tmp = out_file;
+  tmp += ".part";
+  const auto note_path = note_path_for(tmp);
+
+  const Probe pr = probe(url);
+  const uint64_t total = pr.length > 0 ? (uint64_t)pr.length : 0;
+  const std::string validator = if_range_value(pr.version);
+
+  // Carry on with an earlier .part only if it is of the same file, and only
+  // with its note: both fetches write the note before any data, so a .part
+  // without one may be a sparse parallel download. A note without ranges is
+  // from a single-connection run, whose .part is a contiguous prefix.
+  std::error_code ec;
+  uint64_t have = std::filesystem::exists(tmp, ec) ? std::filesystem::file_size(tmp, ec) : 0;
+  PartNote note;
+  const bool noted = load_note(note_path, note);
+  bool resume = !ec && have > 0 && pr.ranges && (total == 0 || have <= total) && noted;
+  if (noted && (note.total != total || note.validator != validator)) resume = false;
+  if (!resume) {
+    std::filesystem::remove(tmp, ec);
+    std::filesystem::remove(note_path, ec);
+    have = 0;
+    note = PartNote{};
+  }
+  note.total = total;
+  note.validator = validator;
+  if (note.ranges.empty() && note.hash.bytes > have) note.hash = ContentHash{};
+
+  DownloadResult out;
+  out.file_path = out_file;
+  out.version = pr.version;
+  long code = 200;
+
+  // Once a download is split into ranges it stays split.
+  bool parallel = pr.ranges && total > 0 &&
+                  (!note.ranges.empty() || (total >= kMinParallelBytes && opt.connections > 1));
+  if (parallel) {
+    if (note.ranges.empty()) {
+      // An earlier single-connection .part is a finished prefix.
+      const uint64_t step = (total - have + opt.connections - 1) / std::max(1u, opt.connections);
+      for (uint64_t b = have; b < total; b += step) {
+        Range r;
+        r.begin = b;
+        r.end = std::min(total, b + step);
+        note.ranges.push_back(r);
+      }
+    }
+    out.resumed_bytes = total - remaining(note.ranges);
+    ProgressLine progress(opt.progress, total, out.resumed_bytes);
+    parallel = fetch_ranges(url, tmp, note_path, note, progress);
+    out.seconds = progress.seconds();
+    code = 206;
+    if (!parallel) {
+      // The server ignored a Range request: start over on one connection.
+      std::filesystem::remove(tmp, ec);
+      have = 0;
+      note = PartNote{};
+      note.total = total;
+      note.validator = validator;
+    }
+  }
+  if (!parallel) {
+    if (total > 0 && have == total) {
+      hash_from_file(note.hash, tmp, total);   // complete already; just not renamed
+    } else {
+      out.resumed_bytes = have;
+      ProgressLine progress(opt.progress, total, have);
+      code = fetch_single(url, tmp, note_path, pr.ranges, note, out.version, progress);
+      out.seconds = progress.seconds();
+    }
+  }
+
+  out.bytes = std::filesystem::file_size(tmp);
+  if (total > 0 && out.bytes != total) {
+    throw std::runtime_error("Download incomplete: got " + std::to_string(out.bytes) + " of " +
+                             std::to_string(total) + " bytes (run again to resume)");
+  }
+  hash_from_file(note.hash, tmp, out.bytes);
+  out.content_hash = note.hash.hex();
+  out.version.length = (int64_t)out.bytes;
+
+  std::filesystem::remove(note_path, ec);
+  std::filesystem::remove(out_file, ec);   // Windows rename does not replace
   std::filesystem::rename(tmp, out_file);
-  return DownloadResult{out_file, code};
+  out.http_code = code;
+  return out;
+}
+
+// ------------------------- streaming -------------------------
+
+size_t HttpStream::on_data(char* ptr, size_t size, size_t nmemb, void* self) {
+  auto* s = static_cast<HttpStream*>(self);
+  s->pending_.insert(s->pending_.end(), ptr, ptr + size * nmemb);
+  s->hash_.update(ptr, size * nmemb);
+  return size * nmemb;
+}
+
+size_t HttpStream::on_header(char* buf, size_t size, size_t nitems, void* self) {
+  parse_header(buf, size * nitems, static_cast<HttpStream*>(self)->version_, nullptr);
+  return size * nitems;
+}
+
+HttpStream::HttpStream(const std::string& url) {
+  easy_ = new_transfer(url);
+  multi_ = curl_multi_init();
+  if (!multi_) {
+    curl_easy_cleanup(easy_);
+    throw std::runtime_error("curl_multi_init failed");
+  }
+  curl_easy_setopt(easy_, CURLOPT_WRITEFUNCTION, &HttpStream::on_data);
+  curl_easy_setopt(easy_, CURLOPT_WRITEDATA, this);
+  curl_easy_setopt(easy_, CURLOPT_HEADERFUNCTION, &HttpStream::on_header);
+  curl_easy_setopt(easy_, CURLOPT_HEADERDATA, this);
+  curl_easy_setopt(easy_, CURLOPT_FAILONERROR, 1L);   // no error page in the body
+  curl_multi_add_handle(multi_, easy_);
+}
+
+HttpStream::~HttpStream() {
+  curl_multi_remove_handle(multi_, easy_);
+  curl_easy_cleanup(easy_);
+  curl_multi_cleanup(multi_);
+}
+
+std::size_t HttpStream::next(const void** data) {
+  current_.clear();
+  while (pending_.empty() && !done_) {
+    int running = 0;
+    if (curl_multi_perform(multi_, &running) != CURLM_OK) {
+      throw std::runtime_error("Download failed: curl_multi_perform");
+    }
+
+    int queued = 0;
+    while (CURLMsg* m = curl_multi_info_read(multi_, &queued)) {
+      if (m->msg != CURLMSG_DONE) continue;
+      done_ = true;
+      if (m->data.result != CURLE_OK) {
+        long code = 0;
+        curl_easy_getinfo(easy_, CURLINFO_RESPONSE_CODE, &code);
+        if (code >= 400) throw std::runtime_error("HTTP error code: " + std::to_string(code));
+        throw std::runtime_error(std::string("Download failed: ") + curl_easy_strerror(m->data.result));
+      }
+    }
+    if (!pending_.empty() || done_) break;
+    if (running == 0) done_ = true;   // finished without a DONE message
+    else curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+  }
+  if (done_) version_.length = (int64_t)hash_.bytes;
+
+  // Hand out everything received so far; the caller is done with it by the
+  // next call, when the buffer is reused.
+  std::swap(current_, pending_);
+  *data = current_.data();
+  return current_.size();
 }
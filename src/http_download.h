@@ -1,10 +1,85 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <filesystem>
+#include <vector>
+
+// Identifies one version of a remote file, as far as the server tells.
+struct RemoteVersion {
+  std::string etag;            // ETag header, quotes included
+  std::string last_modified;   // Last-Modified header
+  int64_t length = -1;         // Content-Length, -1 = unknown
+};
+
+// FNV-1a (64-bit) over the bytes of a download, fed as they arrive.
+struct ContentHash {
+  uint64_t state = 14695981039346656037ull;
+  uint64_t bytes = 0;
+
+  void update(const void* data, std::size_t n);
+  std::string hex() const;   // "fnv1a64:<16 hex digits>"
+};
+
+struct DownloadOptions {
+  unsigned connections = 4;   // parallel byte ranges when the server allows them
+  bool progress = true;       // progress and throughput line on stderr
+};
 
 struct DownloadResult {
   std::filesystem::path file_path;
   long http_code = 0;
+  uint64_t bytes = 0;           // size of the file
+  uint64_t resumed_bytes = 0;   // taken over from an earlier, interrupted run
+  double seconds = 0.0;
+  RemoteVersion version;
+  std::string content_hash;     // ContentHash::hex() of the whole file
 };
 
-DownloadResult http_download_to(const std::string& url, const std::filesystem::path& out_file);
+// Checks whether `url` still is `known` with one conditional HEAD request
+// (If-None-Match / If-Modified-Since). Servers that ignore the conditions are
+// compared on the validators they send back; with none to compare the file
+// counts as changed. `now` receives what the server reported. Throws if the
+// request fails.
+bool http_remote_changed(const std::string& url, const RemoteVersion& known, RemoteVersion* now = nullptr);
+
+// Downloads `url` to `out_file` via <out_file>.part. An interrupted download
+// leaves the .part (plus a .part.ranges note for parallel downloads) behind
+// and the next call resumes it with HTTP Range requests, as long as the
+// server supports them; then the remaining bytes are also fetched as several
+// ranges in parallel. Dropped connections are retried a few times in place.
+// The content hash is computed while the data arrives.
+DownloadResult http_download_to(const std::string& url, const std::filesystem::path& out_file,
+                                const DownloadOptions& opt = {});
+
+// Response body of a GET, pulled chunk by chunk as it arrives, so it can be
+// consumed (e.g. extracted) without ever being stored. Throws
+// std::runtime_error on transfer failures and HTTP errors.
+class HttpStream {
+public:
+  explicit HttpStream(const std::string& url);
+  ~HttpStream();
+
+  HttpStream(const HttpStream&) = delete;
+  HttpStream& operator=(const HttpStream&) = delete;
+
+  // Blocks until more of the body is available and points `data` at it;
+  // returns its size, 0 at the end. `data` stays valid until the next call.
+  std::size_t next(const void** data);
+
+  // Response validators, known once the first data has arrived.
+  const RemoteVersion& version() const { return version_; }
+  // Hash of everything received so far (all of it once next() returned 0).
+  std::string content_hash() const { return hash_.hex(); }
+
+private:
+  void* easy_ = nullptr;    // CURL*
+  void* multi_ = nullptr;   // CURLM*
+  bool done_ = false;
+  std::vector<char> pending_, current_;
+  RemoteVersion version_;
+  ContentHash hash_;
+
+  static std::size_t on_data(char* ptr, std::size_t size, std::size_t nmemb, void* self);
+  static std::size_t on_header(char* buf, std::size_t size, std::size_t nitems, void* self);
+};
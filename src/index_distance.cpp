@@ -0,0 +1,943 @@
+#include "index_distance.h"
+#include "geo_metrics.h"
+#include "segment_kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+static constexpr double kPi = 3.141592653589793238462643383279502884;
+static double deg2rad(double d) { return d * (kPi / 180.0); }
+
+// z-component of (b - a) x (c - a); > 0 when c is left of a->b.
+static double cross(double ax, double ay, double bx, double by, double cx, double cy) {
+  return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+IndexDistanceEngine::IndexDistanceEngine(const std::filesystem::path& index_path)
+    : index_(index_path) {
+  // The grid is only an accelerator: ignore it if it is unreadable or stale.
+  const auto grid_path = land_grid_path(index_path);
+  std::error_code ec;
+  if (std::filesystem::exists(grid_path, ec)) {
+    try {
+      grid_ = std::make_unique<LandGrid>(grid_path);
+      if (!grid_->matches(index_.header())) grid_.reset();
+    } catch (const std::exception&) {
+      grid_.reset();
+    }
+  }
+  const auto bounds_path = bound_grid_path(index_path);
+  if (std::filesystem::exists(bounds_path, ec)) {
+    try {
+      bounds_ = std::make_unique<BoundGrid>(bounds_path);
+      if (!bounds_->matches(index_.header())) bounds_.reset();
+    } catch (const std::exception&) {
+      bounds_.reset();
+    }
+  }
+}
+
+IndexDistanceEngine::~IndexDistanceEngine() = default;
+
+DistanceQueryResult IndexDistanceEngine::query(double lat_deg, double lon_deg) {
+  ++stats_.queries;
+  return search(lat_deg, lon_deg, nullptr);
+}
+
+DistanceQueryResult IndexDistanceEngine::query_near(double lat_deg, double lon_deg, TrackHint& hint) {
+  ++stats_.queries;
+  return search(lat_deg, lon_deg, &hint);
+}
+
+// Collects the leaves within radius_m of (lat, lon) into near_pos_, unless
+// there are too many for a linear scan to beat the tree; returns whether
+// the neighbourhood is usable.
+bool IndexDistanceEngine::refresh_neighbourhood(double qlat, double qlon, double radius_m) {
+  near_pos_.clear();
+  near_radius_m_ = -1.0;
+  stack_.clear();
+  stack_.push_back(index_.root_pos());
+  while (!stack_.empty()) {
+    const std::size_t pos = stack_.back();
+    stack_.pop_back();
+    if (box_distance_lower_bound_m(qlat, qlon, index_.node_box(pos)) > radius_m) continue;
+    if (pos < index_.chunk_count()) {
+      if (near_pos_.size() == kNeighbourhoodMaxChunks) return false;
+      near_pos_.push_back(pos);
+      continue;
+    }
+    const std::size_t first = index_.node_index(pos);
+    const std::size_t end = std::min(first + index_.node_size(), index_.level_end_of(first));
+    for (std::size_t i = first; i < end; ++i) stack_.push_back(i);
+  }
+  near_lat_ = qlat;
+  near_lon_ = qlon;
+  near_radius_m_ = radius_m;
+  return true;
+}
+
+DistanceQueryResult IndexDistanceEngine::search(double lat_deg, double lon_deg, TrackHint* hint,
+                                                bool use_bounds) {
+  DistanceQueryResult out;
+  PhaseTimer timer(profile_);
+  ++stats_.passes;
+
+  bool known_water = false;
+  double lower_m = 0.0;
+  if (grid_) {
+    const auto hit = grid_->lookup(lat_deg, lon_deg);
+    if (hit.cell == LandCell::Land) {
+      out.geodesic_m = 0.0;
+      out.land_lat_deg = lat_deg;
+      out.land_lon_deg = lon_deg;
+      out.in_land = true;
+      timer.mark(&QueryProfile::setup_ms);
+      return out;
+    }
+    if (hit.cell == LandCell::Water) {
+      known_water = true;
+      lower_m = hit.clearance_m;
+    }
+  }
+
+  aeqd_.set_center(lat_deg, lon_deg);
+
+  // In AEQD the query point is the origin, so a segment's distance to the
+  // origin is the geodesic distance (exact at the nearest point, which is
+  // what we keep; the nearest point itself is found in the plane).
+  const double* lon = index_.lon();
+  const double* lat = index_.lat();
+  const uint8_t* vflags = index_.vflags();
+
+  double best = std::numeric_limits<double>::infinity();
+  double best_x = 0.0, best_y = 0.0;
+  uint32_t best_chunk = kNoChunk;
+  auto& ties = ties_;
+  ties.clear();
+
+  // A hint caps the search radius (nothing beyond it can be nearest) and
+  // names the chunk that was nearest last time, which is scanned first. The
+  // bound grid caps it too, and coastline found at its lower bound ends the
+  // search; a positive lower bound also means the point is in water.
+  double cap = hint ? hint->upper_bound_m : std::numeric_limits<double>::infinity();
+  if (bounds_ && use_bounds) {
+    const auto b = bounds_->lookup(lat_deg, lon_deg);
+    cap = std::min(cap, (double)b.upper_m);
+    if (b.lower_m > 0.0f) {
+      known_water = true;
+      lower_m = std::max(lower_m, (double)b.lower_m);
+    }
+  }
+  uint32_t seed = kNoChunk;
+  if (hint && hint->feature >= 0 && hint->feature < (int64_t)index_.chunk_count()) {
+    seed = (uint32_t)hint->feature;
+  }
+
+  // Distances within this of the best count as ties.
+  auto tol = [&] { return std::isfinite(best) ? 1e-7 * best + 1e-6 : 0.0; };
+  // Nodes and chunks farther than this cannot matter.
+  auto limit = [&] { return std::min(best, cap) + tol(); };
+
+  auto scanChunk = [&](uint32_t c) {
+    const uint32_t first = index_.chunk_first(c);
+    const uint32_t nseg = index_.chunk_nseg(c);
+    const std::size_t n = (std::size_t)nseg + 1;
+    ++stats_.features;
+    stats_.vertices += n;
+    // Spherical projection and kernel first; most chunks end here. Each
+    // vertex is within kAeqdSphereError * rmax of its exact position, and so
+    // is every point of the segments between them.
+    xs_.assign(lon + first, lon + first + n);
+    ys_.assign(lat + first, lat + first + n);
+    const double rmax = aeqd_.forward_sphere(n, xs_.data(), ys_.data());
+    const auto rough = nearest_segment(0.0, 0.0, xs_.data(), ys_.data(), nseg, vflags + first);
+    if (rough.index == static_cast<std::size_t>(-1)) return;
+    if (std::sqrt(rough.dist2) - kAeqdSphereError * rmax > limit()) return;
+
+    xs_.assign(lon + first, lon + first + n);
+    ys_.assign(lat + first, lat + first + n);
+    stats_.vertices += n;
+    aeqd_.forward(n, xs_.data(), ys_.data());
+    const auto near = nearest_segment(0.0, 0.0, xs_.data(), ys_.data(), nseg, vflags + first);
+    if (std::sqrt(near.dist2) > limit()) return;
+
+    // The chunk improves on (or ties) the best: collect its candidates.
+    for (uint32_t s = 0; s < nseg; ++s) {
+      if (vflags[first + s] & kSegArtificial) continue;
+      const double ax = xs_[s], ay = ys_[s];
+      const double bx = xs_[s + 1], by = ys_[s + 1];
+      double px, py;
+      const double t = closest_on_segment(0.0, 0.0, ax, ay, bx, by, px, py);
+      const double d = std::hypot(px, py);
+
+      if (d < best - tol()) {
+        best = d;
+        best_x = px;
+        best_y = py;
+        best_chunk = c;
+        ties.clear();
+      } else if (d > best + tol()) {
+        continue;
+      }
+      ties.push_back({index_.chunk_ring(c), first + s, t, ax, ay, bx, by});
+    }
+  };
+
+  const double qlat = deg2rad(lat_deg), qlon = deg2rad(lon_deg);
+  auto done = [&] {
+    return best == 0.0 || (known_water && best <= lower_m);   // nothing can be closer
+  };
+
+  timer.mark(&QueryProfile::setup_ms);
+  if (seed != kNoChunk) scanChunk(seed);
+
+  // With a finite cap, a neighbourhood collected around an earlier nearby
+  // query can stand in for the tree: any chunk within `cap` of this point is
+  // within cap + (distance between the two points) of that one. The radius
+  // is padded so consecutive track fixes keep reusing it.
+  bool use_neighbourhood = false;
+  if (hint && std::isfinite(cap) && !done()) {
+    if (near_radius_m_ >= 0.0) {
+      const double moved = central_angle_rad(near_lat_, near_lon_, qlat, qlon) * kGeodesicUpperBoundRadiusM;
+      use_neighbourhood = cap + moved <= near_radius_m_;
+    }
+    if (!use_neighbourhood) use_neighbourhood = refresh_neighbourhood(qlat, qlon, cap * 1.25 + 1000.0);
+  }
+
+  if (use_neighbourhood) {
+    ++stats_.windows;
+    for (const std::size_t pos : near_pos_) {
+      if (done()) break;
+      const uint32_t c = index_.node_index(pos);
+      if (c == seed) continue;
+      if (box_distance_lower_bound_m(qlat, qlon, index_.node_box(pos)) > limit()) continue;
+      scanChunk(c);
+    }
+  } else if (!done()) {
+    // Best-first branch and bound over the R-tree: pop the node with the
+    // smallest distance lower bound, stop once that bound exceeds the best
+    // distance found. Every chunk is projected at most once.
+    auto farther = [](const QueueEntry& a, const QueueEntry& b) { return a.bound > b.bound; };
+    ++stats_.windows;
+
+    heap_.clear();
+    const std::size_t root = index_.root_pos();
+    heap_.push_back({box_distance_lower_bound_m(qlat, qlon, index_.node_box(root)), root});
+
+    while (!heap_.empty()) {
+      std::pop_heap(heap_.begin(), heap_.end(), farther);
+      const QueueEntry e = heap_.back();
+      heap_.pop_back();
+      if (e.bound > limit()) break;
+
+      if (e.pos < index_.chunk_count()) {
+        const uint32_t c = index_.node_index(e.pos);
+        if (c != seed) scanChunk(c);
+        if (done()) break;
+        continue;
+      }
+
+      const std::size_t first = index_.node_index(e.pos);
+      const std::size_t end = std::min(first + index_.node_size(), index_.level_end_of(first));
+      for (std::size_t i = first; i < end; ++i) {
+        const double lb = box_distance_lower_bound_m(qlat, qlon, index_.node_box(i));
+        if (lb > limit()) continue;
+        heap_.push_back({lb, i});
+        std::push_heap(heap_.begin(), heap_.end(), farther);
+      }
+    }
+  }
+
+  timer.mark(&QueryProfile::search_ms);
+
+  if (!std::isfinite(best) && std::isfinite(cap)) {
+    // The cap was too tight after all (it comes from rounded distances):
+    // search without it.
+    if (hint) hint->upper_bound_m = std::numeric_limits<double>::infinity();
+    return search(lat_deg, lon_deg, hint, false);
+  }
+  if (hint) hint->feature = best_chunk == kNoChunk ? -1 : (int64_t)best_chunk;
+
+  if (!std::isfinite(best)) {
+    throw std::runtime_error("No distance computed (bad index?)");
+  }
+
+  // Projects a single index vertex.
+  auto project = [&](uint32_t v, double& x, double& y) {
+    x = lon[v];
+    y = lat[v];
+    aeqd_.forward(1, &x, &y);
+  };
+
+  // Land is on the left of every ring. A point closest to the interior of a
+  // segment is on land iff it is left of it; a point closest to a vertex is on
+  // land iff it lies inside the wedge of its two edges (left of both for a
+  // convex corner, left of either for a reflex one). When several segments
+  // tie, any of them voting "land" wins: seams between split polygons are not
+  // indexed, so only land points can see such ambiguous ties.
+  auto landSide = [&](const Candidate& k) -> bool {
+    if (k.t > 0.0 && k.t < 1.0) return cross(k.ax, k.ay, k.bx, k.by, 0.0, 0.0) > 0.0;
+
+    const uint32_t rb = index_.ring_begin(k.ring);
+    const uint32_t re = index_.ring_end(k.ring);   // ring is stored closed: re-1 repeats rb
+    double px, py, cx, cy, nx, ny;
+    if (k.t <= 0.0) {
+      const uint32_t prev = k.vertex == rb ? re - 2 : k.vertex - 1;
+      project(prev, px, py);
+      cx = k.ax; cy = k.ay;
+      nx = k.bx; ny = k.by;
+    } else {
+      const uint32_t next = k.vertex + 2 >= re ? rb + 1 : k.vertex + 2;
+      px = k.ax; py = k.ay;
+      cx = k.bx; cy = k.by;
+      project(next, nx, ny);
+    }
+
+    const bool left_in = cross(px, py, cx, cy, 0.0, 0.0) > 0.0;
+    const bool left_out = cross(cx, cy, nx, ny, 0.0, 0.0) > 0.0;
+    const bool convex = cross(px, py, cx, cy, nx, ny) > 0.0;
+    return convex ? (left_in && left_out) : (left_in || left_out);
+  };
+
+  bool in_land = best == 0.0;
+  for (const auto& k : ties) {
+    if (in_land || known_water) break;
+    in_land = landSide(k);
+  }
+
+  double land_lon = lon_deg, land_lat = lat_deg;
+  if (!in_land) aeqd_.inverse(best_x, best_y, land_lon, land_lat);
+
+  out.geodesic_m = in_land ? 0.0 : best;
+  out.land_lat_deg = land_lat;
+  out.land_lon_deg = land_lon;
+  out.in_land = in_land;
+  timer.mark(&QueryProfile::finish_ms);
+  return out;
+}
+
+void IndexDistanceEngine::nearby(double lat_deg, double lon_deg, const NearbyQuery& q,
+                                 std::vector<CoastPoint>& out) {
+  out.clear();
+  if (q.k == 0 && !std::isfinite(q.radius_m)) {
+    throw std::runtime_error("nearby: give a point count or a finite radius");
+  }
+  PhaseTimer timer(profile_);
+  ++stats_.queries;
+  ++stats_.passes;
+  ++stats_.windows;
+
+  aeqd_.set_center(lat_deg, lon_deg);
+  const double qlat = deg2rad(lat_deg), qlon = deg2rad(lon_deg);
+  const double* lon = index_.lon();
+  const double* lat = index_.lat();
+  const uint8_t* vflags = index_.vflags();
+  const std::size_t k = q.k ? q.k : std::numeric_limits<std::size_t>::max();
+  nearby_polys_.clear();
+
+  // One best-first walk over the R-tree. A leaf popped off the queue pushes
+  // its segments back with their exact distances, so entries come off in
+  // distance order and every segment popped is the nearest one left: results
+  // are produced sorted and the walk stops at the k-th or past the radius.
+  auto farther = [](const NearbyEntry& a, const NearbyEntry& b) { return a.dist > b.dist; };
+  auto& heap = nearby_heap_;
+  heap.clear();
+  const std::size_t root = index_.root_pos();
+  heap.push_back({box_distance_lower_bound_m(qlat, qlon, index_.node_box(root)), root, 0, false, 0.0, 0.0});
+  timer.mark(&QueryProfile::setup_ms);
+
+  double last_x = 0.0, last_y = 0.0;
+  while (!heap.empty() && out.size() < k) {
+    std::pop_heap(heap.begin(), heap.end(), farther);
+    const NearbyEntry e = heap.back();
+    heap.pop_back();
+    if (e.dist > q.radius_m) break;
+
+    if (e.segment) {
+      if (q.per_polygon) {
+        // The first segment of a polygon to come off is its nearest.
+        const uint32_t poly = index_.ring_poly(e.ring);
+        auto it = std::lower_bound(nearby_polys_.begin(), nearby_polys_.end(), poly);
+        if (it != nearby_polys_.end() && *it == poly) continue;
+        nearby_polys_.insert(it, poly);
+      } else if (!out.empty() && e.dist - out.back().geodesic_m <= 1e-7 * e.dist + 1e-6 &&
+                 std::hypot(e.px - last_x, e.py - last_y) <= 1e-6) {
+        continue;   // the vertex the previous segment ended on
+      }
+      CoastPoint p;
+      p.geodesic_m = e.dist;
+      aeqd_.inverse(e.px, e.py, p.lon_deg, p.lat_deg);
+      p.polygon = index_.ring_poly(e.ring);
+      out.push_back(p);
+      last_x = e.px;
+      last_y = e.py;
+      continue;
+    }
+
+    if (e.pos < index_.chunk_count()) {
+      const uint32_t c = index_.node_index(e.pos);
+      const uint32_t first = index_.chunk_first(c);
+      const uint32_t nseg = index_.chunk_nseg(c);
+      const std::size_t n = (std::size_t)nseg + 1;
+      ++stats_.features;
+      stats_.vertices += n;
+      xs_.assign(lon + first, lon + first + n);
+      ys_.assign(lat + first, lat + first + n);
+      aeqd_.forward(n, xs_.data(), ys_.data());
+      for (uint32_t s = 0; s < nseg; ++s) {
+        if (vflags[first + s] & kSegArtificial) continue;
+        double px, py;
+        closest_on_segment(0.0, 0.0, xs_[s], ys_[s], xs_[s + 1], ys_[s + 1], px, py);
+        const double d = std::hypot(px, py);
+        if (d > q.radius_m) continue;
+        heap.push_back({d, first + s, index_.chunk_ring(c), true, px, py});
+        std::push_heap(heap.begin(), heap.end(), farther);
+      }
+      continue;
+    }
+
+    const std::size_t first = index_.node_index(e.pos);
+    const std::size_t end = std::min(first + index_.node_size(), index_.level_end_of(first));
+    for (std::size_t i = first; i < end; ++i) {
+      const double lb = box_distance_lower_bound_m(qlat, qlon, index_.node_box(i));
+      if (lb > q.radius_m) continue;
+      heap.push_back({lb, i, 0, false, 0.0, 0.0});
+      std::push_heap(heap.begin(), heap.end(), farther);
+    }
+  }
+  timer.mark(&QueryProfile::search_ms);
+}
+
+// Distance along the ray t*(dx, dy), t >= 0, to where it meets segment a-b,
+// or a negative value if it misses.
+static double ray_segment_hit(double dx, double dy, double ax, double ay, double bx, double by) {
+  const double ex = bx - ax, ey = by - ay;
+  const double denom = dx * ey - dy * ex;
+  const double scale = std::max(std::hypot(ax, ay), std::hypot(bx, by));
+  if (std::fabs(denom) <= 1e-12 * std::hypot(ex, ey)) {
+    // Parallel: only a segment lying on the ray's line can meet it.
+    if (std::fabs(ax * dy - ay * dx) > 1e-9 * scale + 1e-6) return -1.0;
+    const double ta = ax * dx + ay * dy, tb = bx * dx + by * dy;
+    if (ta < 0.0 && tb < 0.0) return -1.0;
+    return (ta < 0.0 || tb < 0.0) ? 0.0 : std::min(ta, tb);
+  }
+  const double t = (ax * ey - ay * ex) / denom;
+  const double u = (ax * dy - ay * dx) / denom;
+  if (t < 0.0 || u < 0.0 || u > 1.0) return -1.0;
+  return t;
+}
+
+RayHit IndexDistanceEngine::ray(double lat_deg, double lon_deg, double bearing_deg, double max_m) {
+  ++stats_.queries;
+  max_m = std::min(max_m, kRayMaxRangeM);
+  if (!(max_m >= 0.0)) throw std::runtime_error("ray: the range must not be negative");
+
+  // The nearest-coastline search settles whether the start is on land, and
+  // its distance is ground the ray can skip: no coastline is any closer.
+  RayHit out;
+  out.lat_deg = lat_deg;
+  out.lon_deg = lon_deg;
+  const DistanceQueryResult here = search(lat_deg, lon_deg, nullptr);
+  if (here.in_land || here.geodesic_m == 0.0) {
+    out.hit = true;
+    out.in_land = here.in_land;
+    return out;
+  }
+  if (here.geodesic_m > max_m) return out;
+
+  // In AEQD centred on the start, the geodesic leaving it at azimuth `az` is
+  // the straight ray t*(sin az, cos az), with t the distance along it. The
+  // ray is followed in steps; each step's lon/lat box picks the chunks it can
+  // cross out of the tree, so only the cells along the ray are visited. A
+  // crossing found by the end of a step is the first: every nearer chunk was
+  // picked by an earlier step.
+  PhaseTimer timer(profile_);
+  aeqd_.set_center(lat_deg, lon_deg);
+  const double az = deg2rad(bearing_deg);
+  const double dx = std::sin(az), dy = std::cos(az);
+  const double* lon = index_.lon();
+  const double* lat = index_.lat();
+  const uint8_t* vflags = index_.vflags();
+  ray_mark_.resize(index_.chunk_count(), 0);
+  if (++ray_gen_ == 0) {
+    std::fill(ray_mark_.begin(), ray_mark_.end(), 0);
+    ray_gen_ = 1;
+  }
+
+  double best = std::numeric_limits<double>::infinity();
+  auto testChunk = [&](uint32_t c) {
+    if (ray_mark_[c] == ray_gen_) return;
+    ray_mark_[c] = ray_gen_;
+    const uint32_t first = index_.chunk_first(c);
+    const uint32_t nseg = index_.chunk_nseg(c);
+    const std::size_t n = (std::size_t)nseg + 1;
+    ++stats_.features;
+    stats_.vertices += n;
+    xs_.assign(lon + first, lon + first + n);
+    ys_.assign(lat + first, lat + first + n);
+    aeqd_.forward(n, xs_.data(), ys_.data());
+    for (uint32_t s = 0; s < nseg; ++s) {
+      if (vflags[first + s] & kSegArtificial) continue;
+      const double t = ray_segment_hit(dx, dy, xs_[s], ys_[s], xs_[s + 1], ys_[s + 1]);
+      if (t >= 0.0 && t < best) best = t;
+    }
+  };
+
+  // Visits the chunks whose boxes meet a lon/lat rectangle; min_lon may be
+  // below -180 and max_lon above 180, which wraps round the antimeridian.
+  auto visitBox = [&](double min_lon, double min_lat, double max_lon, double max_lat) {
+    if (max_lon - min_lon >= 360.0) {
+      min_lon = -180.0;
+      max_lon = 180.0;
+    }
+    auto walk = [&](double x0, double x1) {
+      stack_.clear();
+      stack_.push_back(index_.root_pos());
+      while (!stack_.empty()) {
+        const std::size_t pos = stack_.back();
+        stack_.pop_back();
+        const double* b = index_.node_box(pos);
+        if (b[2] < x0 || b[3] < min_lat || b[0] > x1 || b[1] > max_lat) continue;
+        if (pos < index_.chunk_count()) {
+          testChunk(index_.node_index(pos));
+          continue;
+        }
+        const std::size_t first = index_.node_index(pos);
+        const std::size_t end = std::min(first + index_.node_size(), index_.level_end_of(first));
+        for (std::size_t i = first; i < end; ++i) stack_.push_back(i);
+      }
+    };
+    if (min_lon < -180.0) walk(min_lon + 360.0, 180.0);
+    if (max_lon > 180.0) walk(-180.0, max_lon - 360.0);
+    walk(std::max(min_lon, -180.0), std::min(max_lon, 180.0));
+  };
+  timer.mark(&QueryProfile::setup_ms);
+
+  // Steps are short enough that the geodesic between their ends strays from
+  // the straight lon/lat line by far less than the padding (except by the
+  // poles, where a step takes every longitude).
+  constexpr double kStepM = 10'000.0;
+  constexpr double kPadDeg = 0.01;
+  double s0 = std::max(0.0, here.geodesic_m * (1.0 - 1e-7) - 1.0);
+  double lon0, lat0;
+  aeqd_.inverse(s0 * dx, s0 * dy, lon0, lat0);
+  while (s0 < max_m && best > s0) {
+    const double s1 = std::min(max_m, s0 + kStepM);
+    double lon1, lat1;
+    aeqd_.inverse(s1 * dx, s1 * dy, lon1, lat1);
+    if (lon1 - lon0 > 180.0) lon1 -= 360.0;
+    else if (lon0 - lon1 > 180.0) lon1 += 360.0;
+    ++stats_.windows;
+
+    const double min_lat = std::max(-90.0, std::min(lat0, lat1) - kPadDeg);
+    const double max_lat = std::min(90.0, std::max(lat0, lat1) + kPadDeg);
+    const double cos_lat = std::cos(deg2rad(std::max(std::fabs(min_lat), std::fabs(max_lat))));
+    if (cos_lat < 0.01) {
+      visitBox(-180.0, min_lat, 180.0, max_lat);
+    } else {
+      const double pad_lon = kPadDeg / cos_lat;
+      visitBox(std::min(lon0, lon1) - pad_lon, min_lat, std::max(lon0, lon1) + pad_lon, max_lat);
+    }
+
+    s0 = s1;
+    lon0 = lon1 > 180.0 ? lon1 - 360.0 : (lon1 < -180.0 ? lon1 + 360.0 : lon1);
+    lat0 = lat1;
+  }
+  timer.mark(&QueryProfile::search_ms);
+
+  if (best <= max_m) {
+    out.hit = true;
+    out.geodesic_m = best;
+    aeqd_.inverse(best * dx, best * dy, out.lon_deg, out.lat_deg);
+  }
+  timer.mark(&QueryProfile::finish_ms);
+  return out;
+}
+
+// Closest points p (on a-b) and q (on c-d) of two segments in the plane;
+// returns their distance, 0 with p = q at the crossing when they cross.
+static double segment_segment_distance(double ax, double ay, double bx, double by,
+                                       double cx, double cy, double dx, double dy,
+                                       double& px, double& py, double& qx, double& qy) {
+  const double c_ab = cross(ax, ay, bx, by, cx, cy), d_ab = cross(ax, ay, bx, by, dx, dy);
+  const double a_cd = cross(cx, cy, dx, dy, ax, ay), b_cd = cross(cx, cy, dx, dy, bx, by);
+  if (((c_ab > 0.0 && d_ab < 0.0) || (c_ab < 0.0 && d_ab > 0.0)) &&
+      ((a_cd > 0.0 && b_cd < 0.0) || (a_cd < 0.0 && b_cd > 0.0))) {
+    const double t = c_ab / (c_ab - d_ab);
+    px = qx = cx + t * (dx - cx);
+    py = qy = cy + t * (dy - cy);
+    return 0.0;
+  }
+  // Otherwise the closest pair has an endpoint on one side.
+  double best = std::numeric_limits<double>::infinity();
+  auto consider = [&](double ux, double uy, double vx, double vy) {
+    const double d = std::hypot(ux - vx, uy - vy);
+    if (d < best) {
+      best = d;
+      px = ux; py = uy;
+      qx = vx; qy = vy;
+    }
+  };
+  double x, y;
+  closest_on_segment(cx, cy, ax, ay, bx, by, x, y);
+  consider(x, y, cx, cy);
+  closest_on_segment(dx, dy, ax, ay, bx, by, x, y);
+  consider(x, y, dx, dy);
+  closest_on_segment(ax, ay, cx, cy, dx, dy, x, y);
+  consider(ax, ay, x, y);
+  closest_on_segment(bx, by, cx, cy, dx, dy, x, y);
+  consider(bx, by, x, y);
+  return best;
+}
+
+void IndexDistanceEngine::route(std::size_t n, const double* lat_deg, const double* lon_deg, bool per_leg,
+                                std::vector<RouteClearance>& out) {
+  out.clear();
+  if (n < 2) throw std::runtime_error("route: needs at least two waypoints");
+  PhaseTimer timer(profile_);
+  ++stats_.queries;
+  ++stats_.passes;
+  const double* lon = index_.lon();
+  const double* lat = index_.lat();
+  const uint8_t* vflags = index_.vflags();
+
+  // Legs are cut into steps of at most kStepM. In AEQD centred on a step's
+  // start the step is a straight segment from the origin (a geodesic through
+  // the centre), so it is measured segment against segment with the coastline.
+  // Distances away from the origin are off by a few parts in 10^4 at most over
+  // a step's reach; kSlack keeps the pruning from trusting them further, and
+  // the closest point found is measured exactly at the end.
+  constexpr double kStepM = 25'000.0;
+  constexpr double kSlack = 1e-3;
+
+  // The closest approach so far: of the route, or of the current leg.
+  double best = std::numeric_limits<double>::infinity();
+  double best_lat = lat_deg[0], best_lon = lon_deg[0];
+  std::size_t best_leg = 0;
+  // Tree position of the chunk that held it; the next step tests it first,
+  // which usually leaves little to search.
+  std::size_t seed = kNoPos;
+  auto limit = [&] { return best * (1.0 + kSlack) + kSlack; };
+
+  double qx = 0.0, qy = 0.0;   // the current step's end; its start is the origin
+  double step_m = 0.0;         // and its length
+  std::size_t leg = 0;
+  auto testChunk = [&](std::size_t pos) {
+    const uint32_t c = index_.node_index(pos);
+    const uint32_t first = index_.chunk_first(c);
+    const uint32_t nseg = index_.chunk_nseg(c);
+    const std::size_t nv = (std::size_t)nseg + 1;
+    ++stats_.features;
+    stats_.vertices += nv;
+    // As in search(): the spherical projection rules most chunks out. No
+    // point of the step is nearer to the chunk than its start less step_m.
+    xs_.assign(lon + first, lon + first + nv);
+    ys_.assign(lat + first, lat + first + nv);
+    const double rmax = aeqd_.forward_sphere(nv, xs_.data(), ys_.data());
+    const auto rough = nearest_segment(0.0, 0.0, xs_.data(), ys_.data(), nseg, vflags + first);
+    if (rough.index == static_cast<std::size_t>(-1)) return;
+    if (std::sqrt(rough.dist2) - kAeqdSphereError * rmax - step_m > limit()) return;
+
+    xs_.assign(lon + first, lon + first + nv);
+    ys_.assign(lat + first, lat + first + nv);
+    stats_.vertices += nv;
+    aeqd_.forward(nv, xs_.data(), ys_.data());
+    for (uint32_t s = 0; s < nseg; ++s) {
+      if (vflags[first + s] & kSegArtificial) continue;
+      double px, py, cx, cy;
+      const double d = segment_segment_distance(0.0, 0.0, qx, qy, xs_[s], ys_[s], xs_[s + 1], ys_[s + 1],
+                                                px, py, cx, cy);
+      if (d >= best) continue;
+      best = d;
+      best_leg = leg;
+      seed = pos;
+      aeqd_.inverse(px, py, best_lon, best_lat);
+    }
+  };
+
+  // A minimum found; finished below (geodesic_m holds the planar estimate).
+  auto record = [&] {
+    RouteClearance r;
+    r.geodesic_m = best;
+    r.lat_deg = best_lat;
+    r.lon_deg = best_lon;
+    r.leg = best_leg;
+    out.push_back(r);
+  };
+  timer.mark(&QueryProfile::setup_ms);
+
+  for (leg = 0; leg + 1 < n; ++leg) {
+    const double alat = lat_deg[leg], alon = lon_deg[leg];
+    aeqd_.set_center(alat, alon);
+    double bx = lon_deg[leg + 1], by = lat_deg[leg + 1];
+    aeqd_.forward(1, &bx, &by);
+    const double len = std::hypot(bx, by);
+    const std::size_t steps = std::max<std::size_t>(1, (std::size_t)std::ceil(len / kStepM));
+    route_lat_.resize(steps + 1);
+    route_lon_.resize(steps + 1);
+    route_lat_[0] = alat;
+    route_lon_[0] = alon;
+    for (std::size_t j = 1; j < steps; ++j) {
+      const double f = (double)j / (double)steps;
+      aeqd_.inverse(f * bx, f * by, route_lon_[j], route_lat_[j]);
+    }
+    route_lat_[steps] = lat_deg[leg + 1];
+    route_lon_[steps] = lon_deg[leg + 1];
+
+    if (per_leg) {
+      best = std::numeric_limits<double>::infinity();
+      best_lat = alat;
+      best_lon = alon;
+      best_leg = leg;
+    }
+    // Adjacent steps share an end, and with it its bound grid lookup.
+    double lower_a = 0.0;
+    if (bounds_) lower_a = bounds_->lookup(route_lat_[0], route_lon_[0]).lower_m;
+    for (std::size_t j = 0; j < steps && best > 0.0; ++j) {
+      step_m = len / (double)steps;
+      // Every point of the step is within step_m of both ends, so it is at
+      // least (lower_a + lower_b - step_m) / 2 from land.
+      double lower_b = 0.0;
+      if (bounds_) lower_b = bounds_->lookup(route_lat_[j + 1], route_lon_[j + 1]).lower_m;
+      const bool skip = bounds_ && (lower_a + lower_b - step_m) / 2.0 > limit();
+      lower_a = lower_b;
+      if (skip) continue;
+
+      ++stats_.windows;
+      const double plat = route_lat_[j], plon = route_lon_[j];
+      aeqd_.set_center(plat, plon);
+      qx = route_lon_[j + 1];
+      qy = route_lat_[j + 1];
+      aeqd_.forward(1, &qx, &qy);
+      // A chunk's distance from the step is at least its distance from the
+      // step's start less the step's length.
+      const double rlat = deg2rad(plat), rlon = deg2rad(plon);
+      auto lower = [&](std::size_t pos) {
+        return box_distance_lower_bound_m(rlat, rlon, index_.node_box(pos)) - step_m;
+      };
+      const std::size_t tested = seed;
+      if (seed != kNoPos && lower(seed) <= limit()) testChunk(seed);
+
+      // Consecutive steps share a neighbourhood of leaves (as hinted queries
+      // do) while it still covers everything within reach; otherwise the
+      // tree is searched best-first.
+      bool use_neighbourhood = false;
+      if (std::isfinite(best) && best > 0.0) {
+        const double reach = limit() + step_m;
+        if (near_radius_m_ >= 0.0) {
+          const double moved = central_angle_rad(near_lat_, near_lon_, rlat, rlon) * kGeodesicUpperBoundRadiusM;
+          use_neighbourhood = reach + moved <= near_radius_m_;
+        }
+        if (!use_neighbourhood) use_neighbourhood = refresh_neighbourhood(rlat, rlon, reach * 1.25 + kStepM);
+      }
+      if (use_neighbourhood) {
+        for (const std::size_t pos : near_pos_) {
+          if (best == 0.0) break;
+          if (pos != tested && lower(pos) <= limit()) testChunk(pos);
+        }
+        continue;
+      }
+
+      auto farther = [](const QueueEntry& a, const QueueEntry& b) { return a.bound > b.bound; };
+      heap_.clear();
+      const std::size_t root = index_.root_pos();
+      heap_.push_back({lower(root), root});
+      while (!heap_.empty() && best > 0.0) {
+        std::pop_heap(heap_.begin(), heap_.end(), farther);
+        const QueueEntry e = heap_.back();
+        heap_.pop_back();
+        if (e.bound > limit()) break;
+        if (e.pos < index_.chunk_count()) {
+          if (e.pos != tested) testChunk(e.pos);
+          continue;
+        }
+        const std::size_t first = index_.node_index(e.pos);
+        const std::size_t end = std::min(first + index_.node_size(), index_.level_end_of(first));
+        for (std::size_t i = first; i < end; ++i) {
+          const double lb = lower(i);
+          if (lb > limit()) continue;
+          heap_.push_back({lb, i});
+          std::push_heap(heap_.begin(), heap_.end(), farther);
+        }
+      }
+    }
+    if (per_leg) record();
+    else if (best == 0.0) break;   // the route crosses the coastline
+  }
+  if (!per_leg) record();
+  timer.mark(&QueryProfile::search_ms);
+
+  // Each minimum is measured exactly from the route point it names (this
+  // also tells whether that point is on land). A crossing stays at 0 and
+  // counts as on land: the route reaches land there, and a side test against
+  // the segment through the point could go either way. Leg
+  // minima follow one another like the fixes of a track and are searched
+  // the same way, each bounding the next. The searches charge their own
+  // phases to the profile.
+  TrackHint hint;
+  for (std::size_t i = 0; i < out.size(); ++i) {
+    RouteClearance& r = out[i];
+    if (i > 0) {
+      const RouteClearance& p = out[i - 1];
+      const double moved = central_angle_rad(deg2rad(p.lat_deg), deg2rad(p.lon_deg),
+                                             deg2rad(r.lat_deg), deg2rad(r.lon_deg)) *
+                           kGeodesicUpperBoundRadiusM;
+      hint.upper_bound_m = (p.geodesic_m + moved) * (1.0 + 1e-9) + 1e-3;
+    }
+    const DistanceQueryResult q = search(r.lat_deg, r.lon_deg, &hint);
+    const bool crossing = r.geodesic_m == 0.0;
+    r.geodesic_m = crossing ? 0.0 : q.geodesic_m;
+    r.land_lat_deg = crossing ? r.lat_deg : q.land_lat_deg;
+    r.land_lon_deg = crossing ? r.lon_deg : q.land_lon_deg;
+    r.in_land = crossing || q.in_land;
+  }
+}
+
+// ------------------------- land grid builder -------------------------
+
+// Liang-Barsky: does segment a-b touch the rectangle?
+static bool segment_hits_box(double ax, double ay, double bx, double by,
+                             double x0, double y0, double x1, double y1) {
+  double t0 = 0.0, t1 = 1.0;
+  const double dx = bx - ax, dy = by - ay;
+  const double p[4] = {-dx, dx, -dy, dy};
+  const double q[4] = {ax - x0, x1 - ax, ay - y0, y1 - ay};
+  for (int i = 0; i < 4; ++i) {
+    if (p[i] == 0.0) {
+      if (q[i] < 0.0) return false;
+      continue;
+    }
+    const double r = q[i] / p[i];
+    if (p[i] < 0.0) t0 = std::max(t0, r);
+    else t1 = std::min(t1, r);
+    if (t0 > t1) return false;
+  }
+  return true;
+}
+
+namespace {
+struct LandGridBuilder {
+  IndexDistanceEngine& engine;
+  const CoastIndex& index;
+  std::vector<uint32_t> nodes;
+  std::vector<float> clearance;
+
+  // True if a real coastline segment passes through the cell. The cell is
+  // grown by 2% so segments that bend just past its edge after projection
+  // still make it mixed.
+  bool has_coast(double x0, double y0, double w, double h) const {
+    const double mx = 0.02 * w, my = 0.02 * h;
+    const double bx0 = x0 - mx, by0 = y0 - my, bx1 = x0 + w + mx, by1 = y0 + h + my;
+    bool hit = false;
+    index.search(bx0, by0, bx1, by1, [&](uint32_t c) {
+      if (hit) return;
+      const uint32_t first = index.chunk_first(c);
+      for (uint32_t s = 0; s < index.chunk_nseg(c) && !hit; ++s) {
+        const uint32_t v = first + s;
+        if (index.vflags()[v] & kSegArtificial) continue;
+        hit = segment_hits_box(index.lon()[v], index.lat()[v], index.lon()[v + 1], index.lat()[v + 1],
+                               bx0, by0, bx1, by1);
+      }
+    });
+    return hit;
+  }
+
+  void fill(std::size_t pos, double x0, double y0, double w, double h, uint32_t depth) {
+    if (!has_coast(x0, y0, w, h)) {
+      // One query at the centre classifies the whole cell.
+      const double cx = x0 + 0.5 * w, cy = y0 + 0.5 * h;
+      const auto r = engine.query(cy, cx);
+      if (r.in_land) {
+        nodes[pos] = kLandGridLand;
+        return;
+      }
+      double half_diag = 0.0;
+      for (double x : {x0, x0 + w}) {
+        for (double y : {y0, y0 + h}) {
+          half_diag = std::max(half_diag, central_angle_rad(deg2rad(cy), deg2rad(cx), deg2rad(y), deg2rad(x)));
+        }
+      }
+      const double c = r.geodesic_m - half_diag * kGeodesicUpperBoundRadiusM;
+      nodes[pos] = kLandGridWater;
+      clearance[pos] = c > 0.0 ? std::nextafter((float)c, 0.0f) : 0.0f;
+      return;
+    }
+    if (depth == kLandGridMaxDepth) {
+      nodes[pos] = kLandGridMixed;
+      return;
+    }
+
+    const std::size_t first = nodes.size();
+    nodes.resize(first + 4, kLandGridMixed);
+    clearance.resize(first + 4, 0.0f);
+    nodes[pos] = (uint32_t)first;
+    w *= 0.5;
+    h *= 0.5;
+    fill(first + 0, x0,     y0,     w, h, depth + 1);   // SW
+    fill(first + 1, x0 + w, y0,     w, h, depth + 1);   // SE
+    fill(first + 2, x0,     y0 + h, w, h, depth + 1);   // NW
+    fill(first + 3, x0 + w, y0 + h, w, h, depth + 1);   // NE
+  }
+};
+} // namespace
+
+void build_land_grid(const std::filesystem::path& index_path) {
+  // Drop any previous grid first so the engine below answers from geometry.
+  const auto grid_path = land_grid_path(index_path);
+  std::error_code ec;
+  std::filesystem::remove(grid_path, ec);
+
+  IndexDistanceEngine engine(index_path);
+  LandGridBuilder b{engine, engine.index(), {kLandGridMixed}, {0.0f}};
+  b.fill(0, -180.0, -90.0, 360.0, 180.0, 0);
+
+  write_land_grid(grid_path, engine.index().header(), b.nodes, b.clearance);
+}
+
+void build_bound_grid(const std::filesystem::path& index_path) {
+  // Drop any previous grid first so the engine below is not capped by it.
+  const auto path = bound_grid_path(index_path);
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+
+  IndexDistanceEngine engine(index_path);
+  const double cell = kBoundGridCellDeg;
+  const uint32_t cols = (uint32_t)std::lround(360.0 / cell);
+  const uint32_t rows = (uint32_t)std::lround(180.0 / cell);
+  const float inf = std::numeric_limits<float>::infinity();
+  std::vector<BoundGridCell> cells((std::size_t)cols * rows);
+
+  for (uint32_t r = 0; r < rows; ++r) {
+    const double cy = -90.0 + (r + 0.5) * cell;
+    // Every point of a cell is within half_diag of its centre; neighbouring
+    // centres are `step` apart, so each row is walked as a track.
+    double half_diag = 0.0;
+    for (double y : {cy - 0.5 * cell, cy + 0.5 * cell}) {
+      half_diag = std::max(half_diag, central_angle_rad(deg2rad(cy), 0.0, deg2rad(y), deg2rad(0.5 * cell)));
+    }
+    half_diag *= kGeodesicUpperBoundRadiusM;
+    const double step = central_angle_rad(deg2rad(cy), 0.0, deg2rad(cy), deg2rad(cell)) * kGeodesicUpperBoundRadiusM;
+
+    TrackHint hint;
+    for (uint32_t c = 0; c < cols; ++c) {
+      const double cx = -180.0 + (c + 0.5) * cell;
+      const auto q = engine.query_near(cy, cx, hint);
+      hint.upper_bound_m = (q.geodesic_m + step) * (1.0 + 1e-9) + 1e-3;
+
+      BoundGridCell& out = cells[(std::size_t)r * cols + c];
+      if (q.in_land) {
+        out = {0.0f, inf};
+        continue;
+      }
+      const double pad = half_diag + 1e-7 * q.geodesic_m + 1.0;
+      const double lo = q.geodesic_m - pad;
+      out.lower_m = lo > 0.0 ? std::nextafter((float)lo, 0.0f) : 0.0f;
+      out.upper_m = std::nextafter((float)(q.geodesic_m + pad), inf);
+    }
+  }
+
+  write_bound_grid(path, engine.index().header(), cols, rows, cells);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "aeqd.h"
+#include "bound_grid.h"
+#include "coast_index.h"
+#include "distance_backend.h"
+#include "land_grid.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Answers queries from a compiled coastline index (see coast_index.h) instead
+// of the shapefile. A best-first search over the index R-tree projects only
+// the chunks that can still beat the nearest segment found so far; in_land is
+// decided by which side of the nearest coastline segment the point lies on.
+// When a matching land grid (land_grid.h) exists, points in fully-land cells
+// are answered without any geometry, and water cells skip the side test. A
+// matching bound grid (bound_grid.h) caps the search radius of every query.
+class IndexDistanceEngine : public DistanceBackend {
+public:
+  explicit IndexDistanceEngine(const std::filesystem::path& index_path);
+  ~IndexDistanceEngine() override;
+
+  IndexDistanceEngine(const IndexDistanceEngine&) = delete;
+  IndexDistanceEngine& operator=(const IndexDistanceEngine&) = delete;
+
+  DistanceQueryResult query(double lat_deg, double lon_deg) override;
+  const char* name() const override { return "index"; }
+  DistanceQueryResult query_near(double lat_deg, double lon_deg, TrackHint& hint) override;
+  void nearby(double lat_deg, double lon_deg, const NearbyQuery& q, std::vector<CoastPoint>& out) override;
+  RayHit ray(double lat_deg, double lon_deg, double bearing_deg, double max_m) override;
+  void route(std::size_t n, const double* lat_deg, const double* lon_deg, bool per_leg,
+             std::vector<RouteClearance>& out) override;
+
+  const CoastIndex& index() const { return index_; }
+
+private:
+  CoastIndex index_;
+  std::unique_ptr<LandGrid> grid_;   // null if missing or built for another index
+  std::unique_ptr<BoundGrid> bounds_;   // likewise
+  AeqdProjection aeqd_;
+
+  // A segment at (near) minimal distance from the query point.
+  struct Candidate {
+    uint32_t ring;
+    uint32_t vertex;   // first vertex of the segment
+    double t;          // closest point parameter along the segment
+    double ax, ay, bx, by;
+  };
+
+  struct QueueEntry {
+    double bound;      // distance lower bound (m)
+    std::size_t pos;   // tree position
+  };
+
+  static constexpr uint32_t kNoChunk = 0xFFFFFFFFu;
+  static constexpr std::size_t kNoPos = static_cast<std::size_t>(-1);
+  // Above this many leaves the tree search beats scanning a neighbourhood.
+  static constexpr std::size_t kNeighbourhoodMaxChunks = 4096;
+
+  // Leaves within near_radius_m_ of (near_lat_, near_lon_) (radians), kept
+  // between hinted queries; near_radius_m_ < 0 when there is none.
+  std::vector<std::size_t> near_pos_;
+  double near_lat_ = 0.0, near_lon_ = 0.0;
+  double near_radius_m_ = -1.0;
+
+  // nearby()'s queue: tree nodes keyed by a distance lower bound and
+  // segments keyed by their exact distance.
+  struct NearbyEntry {
+    double dist;       // m
+    std::size_t pos;   // tree position, or first vertex of the segment
+    uint32_t ring;     // segments only
+    bool segment;
+    double px, py;     // segments: nearest point (AEQD m)
+  };
+
+  DistanceQueryResult search(double lat_deg, double lon_deg, TrackHint* hint, bool use_bounds = true);
+  bool refresh_neighbourhood(double qlat, double qlon, double radius_m);
+
+  // per-query scratch
+  std::vector<QueueEntry> heap_;
+  std::vector<std::size_t> stack_;
+  std::vector<Candidate> ties_;
+  std::vector<double> xs_, ys_;
+  std::vector<NearbyEntry> nearby_heap_;
+  std::vector<uint32_t> nearby_polys_;   // sorted polygons already returned
+  // ray(): chunk c was tested in this ray iff ray_mark_[c] == ray_gen_
+  std::vector<uint32_t> ray_mark_;
+  uint32_t ray_gen_ = 0;
+  std::vector<double> route_lat_, route_lon_;   // route(): one leg's step ends
+};
+
+// Builds the land/water grid for a freshly written index (land_grid_path).
+void build_land_grid(const std::filesystem::path& index_path);
+
+// Builds the distance bound grid for a freshly written index (bound_grid_path).
+void build_bound_grid(const std::filesystem::path& index_path);
@@ -0,0 +1,231 @@
+#pragma once
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+
+// Just enough JSON to pull scalar members out of one flat object per line
+// (and to walk nested objects and arrays one level at a time).
+class JsonObjectScanner {
+public:
+  explicit JsonObjectScanner(const std::string& s) : s_(s) {}
+
+  // Calls fn(key, raw_value) for each top-level member; false on syntax error.
+  template <class Fn>
+  bool for_each_member(Fn&& fn) {
+    skip_ws();
+    if (!eat('{')) return false;
+    skip_ws();
+    if (eat('}')) return at_end();
+    while (true) {
+      skip_ws();
+      std::string key;
+      if (!read_string(&key)) return false;
+      skip_ws();
+      if (!eat(':')) return false;
+      skip_ws();
+      const std::size_t b = i_;
+      if (!skip_value()) return false;
+      fn(key, s_.substr(b, i_ - b));
+      skip_ws();
+      if (eat(',')) continue;
+      if (eat('}')) return at_end();
+      return false;
+    }
+  }
+
+  // Calls fn(raw_value) for each element of a top-level array; false on
+  // syntax error.
+  template <class Fn>
+  bool for_each_element(Fn&& fn) {
+    skip_ws();
+    if (!eat('[')) return false;
+    skip_ws();
+    if (eat(']')) return at_end();
+    while (true) {
+      skip_ws();
+      const std::size_t b = i_;
+      if (!skip_value()) return false;
+      fn(s_.substr(b, i_ - b));
+      skip_ws();
+      if (eat(',')) continue;
+      if (eat(']')) return at_end();
+      return false;
+    }
+  }
+
+  // The whole input as one JSON string, escapes decoded; false if it is not one.
+  bool string_value(std::string& out) {
+    skip_ws();
+    return read_string(&out) && at_end();
+  }
+
+  // The whole input as one JSON number; false if it is not one.
+  bool number_value(double& out) {
+    skip_ws();
+    const std::size_t b = i_;
+    if (!skip_number() || !at_end()) return false;
+    out = std::strtod(s_.substr(b).c_str(), nullptr);
+    return true;
+  }
+
+private:
+  const std::string& s_;
+  std::size_t i_ = 0;
+
+  void skip_ws() { while (i_ < s_.size() && std::isspace((unsigned char)s_[i_])) ++i_; }
+  bool eat(char c) { if (i_ < s_.size() && s_[i_] == c) { ++i_; return true; } return false; }
+  bool at_end() { skip_ws(); return i_ == s_.size(); }
+
+  bool read_string(std::string* out) {
+    if (!eat('"')) return false;
+    while (i_ < s_.size()) {
+      char c = s_[i_++];
+      if (c == '"') return true;
+      if (c == '\\') {
+        if (i_ >= s_.size()) return false;
+        char e = s_[i_++];
+        if (e == 'u') {
+          unsigned cp;
+          if (!read_hex4(cp)) return false;
+          if (cp >= 0xD800 && cp < 0xDC00 && s_.compare(i_, 2, "\\u") == 0) {
+            const std::size_t at = i_;
+            unsigned lo;
+            i_ += 2;
+            if (read_hex4(lo) && lo >= 0xDC00 && lo < 0xE000) cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            else i_ = at;   // a lone high surrogate; the next escape stands alone
+          }
+          if (out) append_utf8(*out, cp);
+          continue;
+        }
+        char d;
+        switch (e) {
+          case 'b': d = '\b'; break;
+          case 'f': d = '\f'; break;
+          case 'n': d = '\n'; break;
+          case 'r': d = '\r'; break;
+          case 't': d = '\t'; break;
+          case '"': case '\\': case '/': d = e; break;
+          default: return false;
+        }
+        if (out) out->push_back(d);
+        continue;
+      }
+      if ((unsigned char)c < 0x20) return false;   // control characters must be escaped
+      if (out) out->push_back(c);
+    }
+    return false;
+  }
+
+  bool read_hex4(unsigned& cp) {
+    if (i_ + 4 > s_.size()) return false;
+    cp = 0;
+    for (int k = 0; k < 4; ++k) {
+      const char h = s_[i_++];
+      if (!std::isxdigit((unsigned char)h)) return false;
+      cp = cp * 16 + (unsigned)(h <= '9' ? h - '0' : (h | 0x20) - 'a' + 10);
+    }
+    return true;
+  }
+
+  static void append_utf8(std::string& out, unsigned cp) {
+    if (cp < 0x80) {
+      out.push_back((char)cp);
+    } else if (cp < 0x800) {
+      out.push_back((char)(0xC0 | (cp >> 6)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      out.push_back((char)(0xE0 | (cp >> 12)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    } else {
+      out.push_back((char)(0xF0 | (cp >> 18)));
+      out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back((char)(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  // Skips one value, checking it is well formed; nesting deeper than
+  // kMaxDepth is rejected rather than recursed into.
+  bool skip_value(int depth = 0) {
+    if (i_ >= s_.size()) return false;
+    const char c = s_[i_];
+    if (c == '"') return read_string(nullptr);
+    if (c == '{' || c == '[') {
+      if (depth >= kMaxDepth) return false;
+      const char close = c == '{' ? '}' : ']';
+      ++i_;
+      skip_ws();
+      if (eat(close)) return true;
+      while (true) {
+        skip_ws();
+        if (c == '{') {
+          if (!read_string(nullptr)) return false;
+          skip_ws();
+          if (!eat(':')) return false;
+          skip_ws();
+        }
+        if (!skip_value(depth + 1)) return false;
+        skip_ws();
+        if (eat(',')) continue;
+        return eat(close);
+      }
+    }
+    return skip_literal("true") || skip_literal("false") || skip_literal("null") || skip_number();
+  }
+
+  static constexpr int kMaxDepth = 64;
+
+  bool skip_literal(const char* word) {
+    const std::size_t n = std::char_traits<char>::length(word);
+    if (s_.compare(i_, n, word) != 0) return false;
+    i_ += n;
+    return true;
+  }
+
+  // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+  bool skip_number() {
+    std::size_t j = i_;
+    auto digit = [&](std::size_t k) { return k < s_.size() && std::isdigit((unsigned char)s_[k]); };
+    if (j < s_.size() && s_[j] == '-') ++j;
+    if (!digit(j)) return false;
+    if (s_[j] == '0') ++j;
+    else while (digit(j)) ++j;
+    if (j < s_.size() && s_[j] == '.') {
+      if (!digit(++j)) return false;
+      while (digit(j)) ++j;
+    }
+    if (j < s_.size() && (s_[j] == 'e' || s_[j] == 'E')) {
+      ++j;
+      if (j < s_.size() && (s_[j] == '+' || s_[j] == '-')) ++j;
+      if (!digit(j)) return false;
+      while (digit(j)) ++j;
+    }
+    i_ = j;
+    return true;
+  }
+};
+
+// Helpers for the raw values handed out above.
+
+// The text of `raw` if it is a JSON string (escapes decoded), else `raw` as is.
+inline std::string json_unquote(const std::string& raw) {
+  std::string out;
+  return JsonObjectScanner(raw).string_value(out) ? out : raw;
+}
+
+// A number given as text: a whole (surrounding blanks aside) strtod number,
+// optionally inside double quotes, as NDJSON and CSV input may write it.
+// Stricter JSON contexts use JsonObjectScanner::number_value instead.
+inline bool parse_number(const std::string& s, double& out) {
+  std::size_t b = 0, e = s.size();
+  while (b < e && std::isspace((unsigned char)s[b])) ++b;
+  while (e > b && std::isspace((unsigned char)s[e - 1])) --e;
+  if (e - b >= 2 && s[b] == '"' && s[e - 1] == '"') { ++b; --e; }
+  if (b == e) return false;
+  const std::string t = s.substr(b, e - b);
+  char* end = nullptr;
+  out = std::strtod(t.c_str(), &end);
+  return end && *end == '\0';
+}
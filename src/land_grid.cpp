@@ -0,0 +1,106 @@
+#include "land_grid.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+static_assert(sizeof(LandGridHeader) % 8 == 0, "header must keep sections 8-byte aligned");
+
+std::filesystem::path land_grid_path(const std::filesystem::path& index_path) {
+  auto p = index_path;
+  p.replace_extension(".grid");
+  return p;
+}
+
+void write_land_grid(const std::filesystem::path& path, const CoastIndexHeader& idx,
+                     const std::vector<uint32_t>& nodes, const std::vector<float>& clearance_m) {
+  if (nodes.empty() || nodes.size() != clearance_m.size()) {
+    throw std::runtime_error("write_land_grid: inconsistent node arrays");
+  }
+
+  LandGridHeader h{};
+  std::memcpy(h.magic, kLandGridMagic, sizeof(h.magic));
+  h.version = kLandGridVersion;
+  h.header_size = sizeof(LandGridHeader);
+  h.source_size = idx.source_size;
+  h.source_mtime = idx.source_mtime;
+  h.source_hash = idx.source_hash;
+  h.vertex_count = idx.vertex_count;
+  h.node_count = nodes.size();
+  h.max_depth = kLandGridMaxDepth;
+  h.off_nodes = sizeof(LandGridHeader);
+  h.off_clearance = h.off_nodes + ((nodes.size() * 4 + 7) & ~uint64_t(7));
+
+  auto tmp = path;
+  tmp += ".tmp";
+  std::FILE* f = std::fopen(tmp.string().c_str(), "wb");
+  if (!f) throw std::runtime_error("Failed to create " + tmp.string());
+
+  static const char zeros[8] = {};
+  const std::size_t pad = (std::size_t)(h.off_clearance - h.off_nodes - nodes.size() * 4);
+  bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+            std::fwrite(nodes.data(), 4, nodes.size(), f) == nodes.size() &&
+            std::fwrite(zeros, 1, pad, f) == pad &&
+            std::fwrite(clearance_m.data(), 4, clearance_m.size(), f) == clearance_m.size();
+  ok = (std::fclose(f) == 0) && ok;
+  if (!ok) {
+    std::error_code ec;
+    std::filesystem::remove(tmp, ec);
+    throw std::runtime_error("Failed to write " + tmp.string());
+  }
+
+#ifdef _WIN32
+  std::error_code ec;
+  std::filesystem::remove(path, ec);  // Windows rename does not replace
+#endif
+  std::filesystem::rename(tmp, path);   // atomic on POSIX: readers see old or new
+}
+
+LandGrid::LandGrid(const std::filesystem::path& path) : file_(path) {
+  const auto* base = file_.data();
+  const uint64_t size = file_.size();
+  if (size < sizeof(LandGridHeader)) throw std::runtime_error("Land grid truncated: " + path.string());
+
+  hdr_ = (const LandGridHeader*)base;
+  const auto& h = *hdr_;
+  if (std::memcmp(h.magic, kLandGridMagic, sizeof(h.magic)) != 0) {
+    throw std::runtime_error("Not a dist2land land grid: " + path.string());
+  }
+  if (h.version != kLandGridVersion || h.header_size != sizeof(LandGridHeader)) {
+    throw std::runtime_error("Land grid version mismatch (rebuild with dist2land build-index): " + path.string());
+  }
+  if (h.node_count == 0 || h.off_nodes % 8 != 0 || h.off_clearance % 8 != 0 ||
+      h.off_nodes > size || h.node_count * 4 > size - h.off_nodes ||
+      h.off_clearance > size || h.node_count * 4 > size - h.off_clearance) {
+    throw std::runtime_error("Land grid truncated: " + path.string());
+  }
+  nodes_ = (const uint32_t*)(base + h.off_nodes);
+  clearance_ = (const float*)(base + h.off_clearance);
+}
+
+bool LandGrid::matches(const CoastIndexHeader& idx) const {
+  return hdr_->source_size == idx.source_size && hdr_->source_mtime == idx.source_mtime &&
+         hdr_->source_hash == idx.source_hash && hdr_->vertex_count == idx.vertex_count;
+}
+
+LandGridHit LandGrid::lookup(double lat_deg, double lon_deg) const {
+  double x0 = -180.0, y0 = -90.0, w = 360.0, hgt = 180.0;
+  uint64_t pos = 0;
+  for (uint32_t depth = 0; depth <= hdr_->max_depth; ++depth) {
+    const uint32_t v = nodes_[pos];
+    if (v == kLandGridLand) return {LandCell::Land, 0.0};
+    if (v == kLandGridWater) return {LandCell::Water, (double)clearance_[pos]};
+    if (v == kLandGridMixed || v >= hdr_->node_count) break;
+
+    w *= 0.5;
+    hgt *= 0.5;
+    const int east = lon_deg >= x0 + w;
+    const int north = lat_deg >= y0 + hgt;
+    if (east) x0 += w;
+    if (north) y0 += hgt;
+    pos = (uint64_t)v + (uint64_t)(2 * north + east);
+    if (pos >= hdr_->node_count) break;
+  }
+  return {};
+}
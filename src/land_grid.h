@@ -0,0 +1,74 @@
+#pragma once
+#include "coast_index.h"
+#include "mmap_file.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Land/water classification quadtree, built next to the coastline index
+// (coastline.grid). The root cell is the whole lon/lat plane; each internal
+// node has four children (SW, SE, NW, NE). Leaves no coastline segment passes
+// through are fully land or fully water; water leaves also store a clearance:
+// a lower bound on the distance from any point of the cell to the coast.
+// Leaves at the maximum depth that still contain coastline are "mixed".
+//
+// Layout: header | node[N] (uint32) | clearance_m[N] (float)
+// A node is kLandGridLand / kLandGridWater / kLandGridMixed, or the position
+// of its first child (children are stored consecutively).
+
+static constexpr char     kLandGridMagic[8]  = {'D', '2', 'L', 'G', 'R', 'I', 'D', '\0'};
+static constexpr uint32_t kLandGridVersion   = 1;
+static constexpr uint32_t kLandGridMaxDepth  = 11;   // 0.18 x 0.09 degree cells
+
+static constexpr uint32_t kLandGridLand  = 0xFFFFFFFDu;
+static constexpr uint32_t kLandGridWater = 0xFFFFFFFEu;
+static constexpr uint32_t kLandGridMixed = 0xFFFFFFFFu;
+
+enum class LandCell { Land, Water, Mixed };
+
+struct LandGridHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_size;
+
+  // Identity of the coastline index the grid was built from.
+  uint64_t source_size;
+  int64_t  source_mtime;
+  uint64_t source_hash;
+  uint64_t vertex_count;
+
+  uint64_t node_count;
+  uint32_t max_depth;
+  uint32_t reserved;
+  uint64_t off_nodes, off_clearance;
+};
+
+struct LandGridHit {
+  LandCell cell = LandCell::Mixed;
+  double clearance_m = 0.0;   // water cells only
+};
+
+// coastline.idx -> coastline.grid
+std::filesystem::path land_grid_path(const std::filesystem::path& index_path);
+
+// Atomically writes a grid built for the index with header `idx`.
+void write_land_grid(const std::filesystem::path& path, const CoastIndexHeader& idx,
+                     const std::vector<uint32_t>& nodes, const std::vector<float>& clearance_m);
+
+class LandGrid {
+public:
+  // Throws std::runtime_error if the file is missing, truncated or of another version.
+  explicit LandGrid(const std::filesystem::path& path);
+
+  // True if the grid was built from exactly this index.
+  bool matches(const CoastIndexHeader& idx) const;
+
+  LandGridHit lookup(double lat_deg, double lon_deg) const;
+
+private:
+  MappedFile file_;
+  const LandGridHeader* hdr_ = nullptr;
+  const uint32_t* nodes_ = nullptr;
+  const float* clearance_ = nullptr;
+};
@@ -1,21 +1,31 @@
 #include "util.h"
+#include "alloc_counter.h"
 #include "providers.h"
 #include "app_paths.h"
 #include "http_download.h"
 #include "archive_extract.h"
 #include "distance_iface.h"
+#include "geo_metrics.h"
+#include "result_format.h"
+#include "batch.h"
+#include "route.h"
+#include "serve.h"
+#include "json_scan.h"
+#include "coast_index.h"
 #include "win_runtime.h"
 
 #include <iostream>
+#include <fstream>
 #include <filesystem>
 #include <stdexcept>
+#include <chrono>
 #include <cmath>
-#include <iomanip>
+#include <cstdio>
 #include <limits>
-#include <array>
 #include <algorithm>
-#include <sstream>
-#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
 
 static void print_usage() {
   std::cout <<
@@ -24,18 +34,48 @@ R"(dist2land
 Commands:
   dist2land help
   dist2land providers
-  dist2land setup --provider (osm|gshhg|ne|all)
+  dist2land setup --provider (osm|gshhg|ne|all) [--stream] [--connections <n>] [--force]
+  dist2land update [--provider (osm|gshhg|ne|all)] [--stream] [--connections <n>]
+  dist2land build-index --provider (osm|gshhg|ne|all) [--force]
   dist2land distance --lat <deg> --lon <deg>
                     [--provider (auto|osm|gshhg|ne)]
                     [--units (m|km|nm)]
                     [--metric (geodesic|chord|rhumb)]
-                    [--json]
+                    [--json] [--server <socket>] [--profile]
+                    [--nearest <k>] [--within <distance>] [--per (polygon|segment)]
+                    [--bearing <deg> [--max-range <distance>]]
+  dist2land route [--input <file>|-] [--format (gpx|geojson)] [--legs]
+                  [--provider (auto|osm|gshhg|ne)]
+                  [--units (m|km|nm)]
+                  [--json] [--profile]
+  dist2land batch [--input <file>|-] [--format (csv|ndjson)] [--threads <n>]
+                  [--provider (auto|osm|gshhg|ne)]
+                  [--units (m|km|nm)]
+                  [--metric (geodesic|chord|rhumb)]
+                  [--json]
+  dist2land track [--input <file>|-] [--format (csv|ndjson)]
+                  [--provider (auto|osm|gshhg|ne)]
+                  [--units (m|km|nm)]
+                  [--metric (geodesic|chord|rhumb)]
+                  [--json]
+  dist2land serve --socket <path> [--threads <n>] [--stats-interval <s>]
+                  [--provider (auto|osm|gshhg|ne)]
+                  [--units (m|km|nm)]
+                  [--metric (geodesic|chord|rhumb)]
 
 Examples:
   dist2land setup --provider osm
   dist2land distance --lat 36.84 --lon -122.42 --provider auto
   dist2land distance --lat 0 --lon -30 --metric rhumb --units nm
   dist2land distance --lat 36.84 --lon -122.42 --json
+  dist2land distance --lat 37.5 --lon 25.3 --nearest 5 --units nm
+  dist2land distance --lat 36.84 --lon -62.42 --bearing 290 --units nm
+  dist2land route --input passage.gpx --units nm --legs
+  printf '36.84,-122.42\n0,-30\n' | dist2land batch --units nm
+  dist2land batch --input track.ndjson --json
+  dist2land track --input track.csv --units nm
+  dist2land serve --socket /run/dist2land.sock &
+  dist2land distance --lat 36.84 --lon -122.42 --server /run/dist2land.sock
 
 Output:
   <distance> <units> <land_lat_deg> <land_lon_deg>
@@ -44,26 +84,68 @@ Output:
 Notes:
   - First run: you must download a dataset:
       dist2land setup --provider osm
+    Only the provider's shapefile is extracted from the archive. With --stream the
+    download is extracted as it arrives instead of being saved as a ZIP first: about
+    half the disk space and time, but an interrupted download starts over.
+    Otherwise an interrupted download resumes where it stopped on the next setup, and
+    servers that accept Range requests are downloaded over --connections (default 4)
+    parallel connections.
+  - setup records the archive's ETag, Last-Modified and content hash (source.ini in the
+    provider cache dir). Running it again, or "dist2land update" for every installed
+    provider, first asks the server with one conditional request and only downloads,
+    extracts and re-indexes providers whose data changed (--force skips the check).
   - If your point is on land (inside polygon), distance is 0 and the reported land point
     is the query point itself.
-
-Performance (optional spatial index for faster queries):
-  dist2land uses OGR spatial filters; performance improves a lot if your shapefile has a .qix index.
-  Create it once per provider shapefile using GDAL's ogrinfo tool (produces a *.qix next to the *.shp).
-
-  1) Find the layer name (usually the shapefile base name):
-     ogrinfo -ro -so "<path-to-shapefile>.shp"
-
-  2) Create the spatial index:
-     ogrinfo -ro "<path-to-shapefile>.shp" -sql "CREATE SPATIAL INDEX ON <layer_name>"
-
-  Example (layer name matches file base name):
-     ogrinfo -ro -so "land_polygons.shp"
-     ogrinfo -ro "land_polygons.shp" -sql "CREATE SPATIAL INDEX ON land_polygons"
-
-  You can locate the provider shapefile path by running:
-     dist2land distance --lat 0 --lon 0 --provider osm
-  (it prints shp=... on stderr).
+  - distance --nearest K lists the K nearest coastline points, one per polygon (so on K
+    different islands or coasts), nearest first; --within R lists every coastline
+    segment's nearest point within R (in --units), and limits --nearest when both are
+    given. --per (polygon|segment) overrides what counts as distinct. One line per
+    point in the usual output format, or a "nearby" array with --json. Distances are to
+    the coastline, also from points on land. Needs the coastline index.
+  - distance --bearing DEG follows the geodesic leaving the point at DEG (clockwise from
+    north) and prints where it first meets the coastline and how far along it that is,
+    in the usual output format; 0 and the point itself when it is on land, "none
+    <units>" (or "hit":false with --json) when there is no coastline within
+    --max-range (in --units; default and limit 10000 km). Needs the coastline index.
+  - route reads a planned route (GPX route/track/waypoints or a GeoJSON LineString, from
+    --input or stdin) and prints the minimum distance to land along it, following the
+    geodesic between waypoints: "<distance> <units> <land_lat> <land_lon> <lat> <lon>
+    <leg>", where lat/lon is the point of the route where it occurs and leg i joins
+    waypoints i and i+1 (from 0). --legs prints one such line per leg instead, a
+    clearance profile of the route. A route that touches or crosses land gets 0 at the
+    crossing. Needs the coastline index.
+  - distance --profile adds a "profile" object to the --json output (on stderr without
+    --json): engine open time, setup/search/finish time of the query in ms, and how
+    much work it did (search passes, windows, features, projected vertices, allocations).
+  - batch reads one record per line from stdin (or --input) and writes one result line
+    per record, in input order, opening the dataset only once:
+      CSV:    lat,lon[,...]  (an optional header row selects lat/lon/id columns by name)
+      NDJSON: {"lat":..,"lon":..[,"id":..]}  ("id" is echoed back with --json)
+    The format is detected from the first record unless --format is given. Records that
+    cannot be answered print "nan <units> nan nan" (or {"line":N,"error":...} with --json).
+  - setup also compiles a coastline index (coastline.idx in the provider cache dir) that
+    queries memory-map instead of decoding the shapefile. It records the shapefile's size,
+    mtime and checksum; a stale or missing index is ignored (queries fall back to the
+    shapefile) until "dist2land build-index" rebuilds it. A land/water grid built with it
+    (coastline.grid) answers points well inside land without any geometry, and
+    coastline.bounds (distance bounds per 0.25 degree cell) sizes every search up front.
+  - batch --threads N answers records on N worker threads, each with its own dataset
+    handle (default 0 = one per core); output order always matches input order.
+  - track reads the same input as batch, but treats the records as consecutive fixes of
+    one moving point (a vessel track, a GPS log): each answer plus the distance moved
+    bounds the next one, so only nearby coastline is searched. With the coastline index
+    the distances match batch and come faster when fixes are close together; the
+    shapefile fallback may differ slightly from batch.
+  - setup also writes the shapefile's GDAL spatial index (*.qix next to the *.shp), which
+    the shapefile fallback needs to avoid scanning every polygon. distance and batch build
+    it on first use if it is missing; build-index writes it too (--force rebuilds it).
+  - serve keeps --threads engines open (default: one per core) and answers line-delimited
+    JSON on a Unix socket, one thread per client: {"lat":..,"lon":..[,"id":..][,"units":..]
+    [,"metric":..][,"format":"text"]} gets the --json object (or text line) back;
+    {"cmd":"stats"} returns request count and p50/p99 latency, which are also logged to
+    stderr every --stats-interval seconds (default 60, 0 = off) and on exit.
+    distance --server <socket> sends its query to such a server and prints the same output.
+    Not available on Windows.
 )";
 }
 
@@ -71,139 +153,394 @@ static bool has_flag(const ArgvView& av, const std::string& flag) {
   return std::find(av.args.begin(), av.args.end(), flag) != av.args.end();
 }
 
-static std::string json_escape(const std::string& s) {
-  std::string out;
-  out.reserve(s.size() + 8);
-  for (unsigned char c : s) {
-    switch (c) {
-      case '\"': out += "\\\""; break;
-      case '\\': out += "\\\\"; break;
-      case '\b': out += "\\b"; break;
-      case '\f': out += "\\f"; break;
-      case '\n': out += "\\n"; break;
-      case '\r': out += "\\r"; break;
-      case '\t': out += "\\t"; break;
-      default:
-        if (c < 0x20) {
-          char buf[7];
-          std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
-          out += buf;
-        } else {
-          out.push_back((char)c);
-        }
+static void cmd_providers() {
+  std::cout << "Providers:\n";
+  for (auto& p : all_providers()) {
+    bool indexed = false;
+    bool ok = provider_installed(p, &indexed);
+    std::string state = !ok ? "not installed" : indexed ? "installed" : "installed, no spatial index";
+    ProviderManifest m;
+    if (ok && read_provider_manifest(p, m) && m.coast_index != "fresh") {
+      state += ", coastline index " + m.coast_index;
     }
+    std::cout << "  " << p.id << "  [" << state << "]  " << p.display_name << "\n";
   }
-  return out;
 }
 
-static double convert_units(double meters, const std::string& units) {
-  auto u = to_lower(units);
-  if (u == "m")  return meters;
-  if (u == "km") return meters / 1000.0;
-  if (u == "nm") return meters / 1852.0;
-  throw std::runtime_error("Unknown units: " + units);
-}
+// Builds the shapefile's .qix if it is missing. Queries still work without
+// it (slowly), so a failure here is only a warning.
+static void ensure_spatial_index(const Provider& p, const std::filesystem::path& shp) {
+  const auto qix = shapefile_spatial_index_path(shp);
+  std::error_code ec;
+  if (std::filesystem::exists(qix, ec)) return;
 
-static void cmd_providers() {
-  std::cout << "Providers:\n";
-  for (auto& p : all_providers()) {
-    bool ok = provider_installed(p);
-    std::cout << "  " << p.id << "  [" << (ok ? "installed" : "not installed") << "]  "
-              << p.display_name << "\n";
+  std::cerr << p.id << ": spatial index missing, building " << qix.string() << "...\n";
+  try {
+    build_spatial_index(shp);
+  } catch (const std::exception& e) {
+    std::cerr << "Warning: " << e.what() << "\n"
+              << "  Queries that fall back to the shapefile will scan every polygon.\n"
+              << "  Retry with: dist2land build-index --provider " << p.id << "\n";
   }
 }
 
-static void setup_one(const Provider& p) {
+static RemoteVersion remote_version_of(const ProviderSource& s) {
+  return RemoteVersion{s.etag, s.last_modified, s.length};
+}
+
+// Replaces `dir` with `fresh` (a fully extracted sibling): the old data
+// stays usable until the new data is complete.
+static void replace_dir(const std::filesystem::path& dir, const std::filesystem::path& fresh) {
+  auto old = dir;
+  old += ".old";
+  std::error_code ec;
+  std::filesystem::remove_all(old, ec);
+  if (std::filesystem::exists(dir, ec)) std::filesystem::rename(dir, old);
+  std::filesystem::rename(fresh, dir);
+  std::filesystem::remove_all(old, ec);
+}
+
+struct SetupOptions {
+  bool stream = false;   // extract the download as it arrives, no ZIP on disk
+  bool force = false;    // download even if upstream looks unchanged
+  DownloadOptions download;
+};
+
+// Downloads, extracts and indexes one provider. An installed provider whose
+// upstream archive is unchanged (same ETag / Last-Modified, or the same
+// content hash once downloaded) is left alone. Returns whether anything was
+// replaced.
+static bool setup_one(const Provider& p, const SetupOptions& opt) {
   auto pdir = provider_dir(p.id);
-  auto ddir = downloads_dir();
   std::filesystem::create_directories(pdir);
-  std::filesystem::create_directories(ddir);
 
-  auto zip_path = ddir / (p.id + ".zip");
-  std::cout << "Downloading " << p.id << "...\n";
-  http_download_to(p.url_zip, zip_path);
+  ProviderSource known;
+  const bool have_known = provider_installed(p) && read_provider_source(p, known) && known.url == p.url_zip;
+  if (have_known && !opt.force) {
+    RemoteVersion now;
+    if (!http_remote_changed(p.url_zip, remote_version_of(known), &now)) {
+      std::cout << p.id << ": up to date\n";
+      return false;
+    }
+  }
+
+  // Only the shapefile and its sidecars are extracted, next to the current
+  // data; that is replaced once the new data is complete.
+  auto want = [&](const std::string& entry) { return provider_wants_archive_entry(p, entry); };
+  const auto out_root = provider_extract_root(p);
+  auto staging = out_root;
+  staging += ".new";
+  std::error_code ec;
+  std::filesystem::remove_all(staging, ec);
+
+  ProviderSource got;
+  got.url = p.url_zip;
+  try {
+    if (opt.stream) {
+      std::cout << "Downloading and extracting " << p.id << "...\n";
+      HttpStream body(p.url_zip);
+      extract_archive_stream([&](const void** data) { return body.next(data); }, staging, want);
+      got.etag = body.version().etag;
+      got.last_modified = body.version().last_modified;
+      got.length = body.version().length;
+      got.content_hash = body.content_hash();
+    } else {
+      auto ddir = downloads_dir();
+      std::filesystem::create_directories(ddir);
+      auto zip_path = ddir / (p.id + ".zip");
+      std::cout << "Downloading " << p.id << "...\n";
+      const auto dl = http_download_to(p.url_zip, zip_path, opt.download);
+      if (dl.resumed_bytes > 0) {
+        std::cout << "Resumed at " << dl.resumed_bytes / (1024 * 1024) << " MB of "
+                  << dl.bytes / (1024 * 1024) << " MB\n";
+      }
+      got.etag = dl.version.etag;
+      got.last_modified = dl.version.last_modified;
+      got.length = dl.version.length;
+      got.content_hash = dl.content_hash;
+
+      if (!(have_known && got.content_hash == known.content_hash)) {
+        std::cout << "Extracting to " << out_root.string() << "...\n";
+        extract_zip(zip_path, staging, want);
+      }
+    }
+  } catch (...) {
+    // A partial extraction must not look like an installed provider.
+    std::filesystem::remove_all(staging, ec);
+    throw;
+  }
 
-  auto out_root = provider_extract_root(p);
-  std::cout << "Extracting to " << out_root.string() << "...\n";
-  std::filesystem::remove_all(out_root);
-  extract_zip(zip_path, out_root);
+  // Same bytes under new validators (or a server without any): keep the data.
+  if (have_known && got.content_hash == known.content_hash) {
+    std::filesystem::remove_all(staging, ec);
+    write_provider_source(p, got);
+    std::cout << p.id << ": archive unchanged (" << got.content_hash << ")\n";
+    return false;
+  }
+  replace_dir(out_root, staging);
 
   // quick validation: locate the shapefile
   auto shp = provider_shapefile_path(p);
   std::cout << "OK: found shapefile: " << shp.string() << "\n";
+
+  // The new data is already in place, so a failed .qix (only a speed-up for
+  // the shapefile fallback) must not stop the coastline index and manifest.
+  ensure_spatial_index(p, shp);
+
+  std::cout << "Building coastline index...\n";
+  build_coast_index(shp, coast_index_path(p.id));
+  std::cout << "OK: index: " << coast_index_path(p.id).string() << "\n";
+  refresh_provider_manifest(p);
+
+  // Recorded last, so an interrupted setup is never taken for a current one.
+  write_provider_source(p, got);
   std::cout << "License note: " << p.license_hint << "\n";
+  return true;
+}
+
+static void build_index_one(const Provider& p, bool force) {
+  if (!provider_installed(p)) {
+    throw std::runtime_error("Provider '" + p.id + "' not installed. Run: dist2land setup --provider " + p.id);
+  }
+  const auto shp = provider_shapefile_path(p);
+  const auto idx = coast_index_path(p.id);
+
+  std::error_code ec;
+  if (force || !std::filesystem::exists(shapefile_spatial_index_path(shp), ec)) {
+    std::cout << p.id << ": building spatial index...\n";
+    build_spatial_index(shp);
+    std::cout << "OK: spatial index: " << shapefile_spatial_index_path(shp).string() << "\n";
+  }
+
+  const auto st = coast_index_status(idx, shp);
+  if (st == CoastIndexStatus::Fresh && !force) {
+    std::cout << p.id << ": index is up to date: " << idx.string() << "\n";
+    refresh_provider_manifest(p);
+    return;
+  }
+
+  std::cout << p.id << ": building index (" << coast_index_status_name(st) << ")...\n";
+  build_coast_index(shp, idx);
+  std::cout << "OK: index: " << idx.string() << "\n";
+  refresh_provider_manifest(p);
+}
+
+static void cmd_build_index(const ArgvView& av) {
+  auto prov = to_lower(av.get("--provider", ""));
+  if (prov.empty()) throw std::runtime_error("build-index requires --provider");
+  const bool force = has_flag(av, "--force");
+
+  if (prov == "all") {
+    for (auto& p : all_providers()) {
+      if (provider_installed(p)) build_index_one(p, force);
+    }
+    return;
+  }
+  build_index_one(provider_by_id(prov), force);
+}
+
+static SetupOptions setup_options(const ArgvView& av) {
+  SetupOptions opt;
+  opt.stream = has_flag(av, "--stream");
+  opt.force = has_flag(av, "--force");
+  const double conns = av.get_double("--connections", opt.download.connections);
+  if (conns < 1.0 || conns > 16.0 || conns != std::floor(conns)) {
+    throw std::runtime_error("--connections must be an integer from 1 to 16");
+  }
+  opt.download.connections = (unsigned)conns;
+  return opt;
 }
 
 static void cmd_setup(const ArgvView& av) {
   auto prov = to_lower(av.get("--provider", ""));
   if (prov.empty()) throw std::runtime_error("setup requires --provider");
+  const auto opt = setup_options(av);
 
   if (prov == "all") {
-    for (auto& p : all_providers()) setup_one(p);
+    for (auto& p : all_providers()) setup_one(p, opt);
     return;
   }
-  setup_one(provider_by_id(prov));
+  setup_one(provider_by_id(prov), opt);
+}
+
+// Refreshes installed providers whose upstream archive changed; unchanged
+// ones cost one conditional HEAD request each.
+static void cmd_update(const ArgvView& av) {
+  auto prov = to_lower(av.get("--provider", "all"));
+  const auto opt = setup_options(av);
+
+  std::vector<Provider> todo;
+  if (prov == "all") {
+    for (auto& p : all_providers()) {
+      if (provider_installed(p)) todo.push_back(p);
+    }
+    if (todo.empty()) throw std::runtime_error("No providers installed. Run: dist2land setup --provider osm (or gshhg/ne)");
+  } else {
+    const auto p = provider_by_id(prov);
+    if (!provider_installed(p)) {
+      throw std::runtime_error("Provider '" + p.id + "' not installed. Run: dist2land setup --provider " + p.id);
+    }
+    todo.push_back(p);
+  }
+
+  int updated = 0;
+  for (const auto& p : todo) {
+    if (setup_one(p, opt)) ++updated;
+  }
+  std::cout << updated << " of " << todo.size() << " provider(s) updated\n";
 }
 
-static constexpr double kPi = 3.141592653589793238462643383279502884;
-static double deg2rad(double d) { return d * (kPi / 180.0); }
+static Provider resolve_installed_provider(const ArgvView& av) {
+  const std::string prov = to_lower(av.get("--provider", "auto"));
+
+  Provider p;
+  if (prov == "auto") {
+    auto best = best_available_provider_id();
+    if (best.empty()) {
+      throw std::runtime_error("No providers installed. Run: dist2land setup --provider osm (or gshhg/ne)");
+    }
+    p = provider_by_id(best);
+  } else {
+    p = provider_by_id(prov);
+  }
+  if (!provider_installed(p)) {
+    throw std::runtime_error("Provider '" + p.id + "' not installed. Run: dist2land setup --provider " + p.id);
+  }
+  return p;
+}
 
-static double wrap_pi(double x) {
-  while (x >  kPi) x -= 2.0 * kPi;
-  while (x < -kPi) x += 2.0 * kPi;
-  return x;
+// --threads N, where 0 (the default) means one per core.
+static unsigned thread_count_arg(const ArgvView& av) {
+  const double threads_arg = av.get_double("--threads", 0.0);
+  if (threads_arg < 0.0 || threads_arg != std::floor(threads_arg)) {
+    throw std::runtime_error("--threads must be a non-negative integer (0 = one per core)");
+  }
+  unsigned threads = (unsigned)threads_arg;
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  return threads;
 }
 
-static double chord_distance_wgs84_m(double lat1_deg, double lon1_deg,
-                                    double lat2_deg, double lon2_deg) {
-  // WGS84 ellipsoid
-  constexpr double a = 6378137.0;
-  constexpr double f = 1.0 / 298.257223563;
-  constexpr double e2 = f * (2.0 - f);
-
-  auto ecef = [&](double lat_deg, double lon_deg) {
-    const double lat = deg2rad(lat_deg);
-    const double lon = deg2rad(lon_deg);
-    const double sl = std::sin(lat), cl = std::cos(lat);
-    const double so = std::sin(lon), co = std::cos(lon);
-    const double N = a / std::sqrt(1.0 - e2 * sl * sl);
-    const double x = (N) * cl * co;
-    const double y = (N) * cl * so;
-    const double z = (N * (1.0 - e2)) * sl;
-    return std::array<double, 3>{x, y, z};
-  };
-
-  auto p1 = ecef(lat1_deg, lon1_deg);
-  auto p2 = ecef(lat2_deg, lon2_deg);
-  const double dx = p2[0] - p1[0];
-  const double dy = p2[1] - p1[1];
-  const double dz = p2[2] - p1[2];
-  return std::sqrt(dx*dx + dy*dy + dz*dz);
+// distance --server: the same query, answered by a running `serve`.
+static void distance_via_server(const ArgvView& av, double lat, double lon) {
+  const std::string socket = av.get("--server", "");
+  const std::string units  = av.get("--units", "m");
+  const std::string metric = to_lower(av.get("--metric", "geodesic"));
+  const std::string prov   = to_lower(av.get("--provider", "auto"));
+  const bool json          = has_flag(av, "--json");
+
+  char coords[96];
+  std::snprintf(coords, sizeof(coords), "\"lat\":%.17g,\"lon\":%.17g", lat, lon);
+  const std::string request = std::string("{") + coords +
+      ",\"units\":\"" + json_escape(units) + "\",\"metric\":\"" + json_escape(metric) +
+      "\",\"provider\":\"" + json_escape(prov) + "\",\"format\":\"" + (json ? "json" : "text") + "\"}";
+
+  const std::string response = server_request(socket, request);
+
+  std::string error;
+  if (!response.empty() && response.front() == '{') {
+    JsonObjectScanner sc(response);
+    sc.for_each_member([&](const std::string& key, const std::string& raw) {
+      if (key == "error") error = json_unquote(raw);
+    });
+  }
+  if (!error.empty()) throw std::runtime_error(error);
+
+  std::cout << response << "\n";
+  std::cerr << "server=" << socket << " metric=" << metric << "\n";
 }
 
-static double rhumb_distance_sphere_m(double lat1_deg, double lon1_deg,
-                                     double lat2_deg, double lon2_deg) {
-  // Spherical rhumb-line approximation
-  constexpr double R = 6371008.8; // mean Earth radius
+// distance --nearest K / --within R: coastline points instead of one answer.
+static void distance_nearby(const ArgvView& av, double lat, double lon) {
+  const std::string units = av.get("--units", "m");
+  const bool json         = has_flag(av, "--json");
+  const bool profile_on   = has_flag(av, "--profile");
+  count_allocations(profile_on);
+  if (to_lower(av.get("--metric", "geodesic")) != "geodesic") {
+    throw std::runtime_error("--nearest/--within measure geodesic distance (no --metric)");
+  }
+
+  NearbyQuery q;
+  if (av.has("--nearest")) {
+    const double k = av.get_double("--nearest", 0.0);
+    if (k < 1.0 || k != std::floor(k)) throw std::runtime_error("--nearest must be a positive integer");
+    q.k = (std::size_t)k;
+  }
+  if (av.has("--within")) {
+    const double r = av.get_double("--within", -1.0);
+    if (!(r >= 0.0) || !std::isfinite(r)) throw std::runtime_error("--within must be a distance >= 0 (in --units)");
+    q.radius_m = r / convert_units(1.0, units);
+  }
+  // k points on k different polygons, or every segment within the radius.
+  const std::string per = to_lower(av.get("--per", av.has("--nearest") ? "polygon" : "segment"));
+  if (per != "polygon" && per != "segment") throw std::runtime_error("--per must be polygon or segment");
+  q.per_polygon = per == "polygon";
 
-  const double phi1 = deg2rad(lat1_deg);
-  const double phi2 = deg2rad(lat2_deg);
-  const double dphi = phi2 - phi1;
+  const Provider p = resolve_installed_provider(av);
+  const auto shp = provider_shapefile_path(p);
+  // Index-only (the shapefile fallback throws), so no .qix is built.
+
+  const auto open_start = std::chrono::steady_clock::now();
+  DistanceEngine engine(p.id, shp);
+  const double open_ms =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count();
+  QueryProfile profile;
+  if (profile_on) engine.set_profile(&profile);
+  const uint64_t allocs_before = alloc_count();
+  const auto points = engine.nearby(lat, lon, q);
+  const uint64_t query_allocs = alloc_count() - allocs_before;
+  const std::string profile_json =
+      profile_on ? format_profile_json(open_ms, profile, engine.stats(), query_allocs) : "";
 
-  const double lam1 = deg2rad(lon1_deg);
-  const double lam2 = deg2rad(lon2_deg);
-  const double dlam = wrap_pi(lam2 - lam1);
+  if (json) {
+    std::cout << format_nearby_json(lat, lon, units, p.id, points, profile_json);
+  } else {
+    std::cout << format_nearby_text(points, units);
+  }
+  std::cerr << "provider=" << p.id << " per=" << per << " points=" << points.size() << "\n";
+  if (profile_on && !json) std::cerr << "{" << profile_json.substr(0, profile_json.size() - 1) << "}\n";
+}
 
-  const auto merc = [](double phi) {
-    const double eps = 1e-12;
-    const double p = std::max(std::min(phi,  kPi/2 - eps), -kPi/2 + eps);
-    return std::log(std::tan(kPi/4 + p/2));
-  };
+// distance --bearing DEG: first coastline along a geodesic instead of nearest.
+static void distance_ray(const ArgvView& av, double lat, double lon) {
+  const std::string units = av.get("--units", "m");
+  const bool json         = has_flag(av, "--json");
+  const bool profile_on   = has_flag(av, "--profile");
+  count_allocations(profile_on);
+  if (to_lower(av.get("--metric", "geodesic")) != "geodesic") {
+    throw std::runtime_error("--bearing measures geodesic distance (no --metric)");
+  }
+  const double bearing = av.get_double("--bearing", std::numeric_limits<double>::quiet_NaN());
+  if (!std::isfinite(bearing)) throw std::runtime_error("--bearing must be an angle in degrees");
+  double max_m = kRayMaxRangeM;
+  if (av.has("--max-range")) {
+    const double r = av.get_double("--max-range", -1.0);
+    if (!(r >= 0.0) || !std::isfinite(r)) throw std::runtime_error("--max-range must be a distance >= 0 (in --units)");
+    max_m = std::min(max_m, r / convert_units(1.0, units));
+  }
 
-  const double dpsi = merc(phi2) - merc(phi1);
-  const double q = (std::abs(dpsi) > 1e-12) ? (dphi / dpsi) : std::cos(phi1);
+  const Provider p = resolve_installed_provider(av);
+  const auto shp = provider_shapefile_path(p);
+  // Index-only (the shapefile fallback throws), so no .qix is built.
+
+  const auto open_start = std::chrono::steady_clock::now();
+  DistanceEngine engine(p.id, shp);
+  const double open_ms =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count();
+  QueryProfile profile;
+  if (profile_on) engine.set_profile(&profile);
+  const uint64_t allocs_before = alloc_count();
+  const RayHit hit = engine.ray(lat, lon, bearing, max_m);
+  const uint64_t query_allocs = alloc_count() - allocs_before;
+  const std::string profile_json =
+      profile_on ? format_profile_json(open_ms, profile, engine.stats(), query_allocs) : "";
 
-  return std::sqrt(dphi*dphi + (q*dlam)*(q*dlam)) * R;
+  if (json) {
+    std::cout << format_ray_json(lat, lon, bearing, units, p.id, hit, profile_json);
+  } else {
+    std::cout << format_ray_text(hit, units);
+  }
+  std::cerr << "provider=" << p.id << " bearing=" << bearing << " hit=" << (hit.hit ? "yes" : "no") << "\n";
+  if (profile_on && !json) std::cerr << "{" << profile_json.substr(0, profile_json.size() - 1) << "}\n";
 }
 
 static void cmd_distance(const ArgvView& av) {
@@ -219,81 +556,193 @@ static void cmd_distance(const ArgvView& av) {
     throw std::runtime_error("--lon must be in [-180, 180] degrees");
   }
 
-  const std::string prov   = to_lower(av.get("--provider", "auto"));
+  if (av.has("--server")) {
+    if (has_flag(av, "--profile")) throw std::runtime_error("--profile cannot be combined with --server");
+    if (av.has("--nearest") || av.has("--within") || av.has("--bearing")) {
+      throw std::runtime_error("--nearest/--within/--bearing cannot be combined with --server");
+    }
+    distance_via_server(av, lat, lon);
+    return;
+  }
+  if (av.has("--bearing")) {
+    if (av.has("--nearest") || av.has("--within")) {
+      throw std::runtime_error("--bearing cannot be combined with --nearest/--within");
+    }
+    distance_ray(av, lat, lon);
+    return;
+  }
+  if (av.has("--nearest") || av.has("--within")) {
+    distance_nearby(av, lat, lon);
+    return;
+  }
+
   const std::string units  = av.get("--units", "m");
   const std::string metric = to_lower(av.get("--metric", "geodesic"));
   const bool json          = has_flag(av, "--json");
+  const bool profile_on    = has_flag(av, "--profile");
+  count_allocations(profile_on);
 
-  Provider p;
-  if (prov == "auto") {
-    auto best = best_available_provider_id();
-    if (best.empty()) {
-      throw std::runtime_error("No providers installed. Run: dist2land setup --provider osm (or gshhg/ne)");
-    }
-    p = provider_by_id(best);
-  } else {
-    p = provider_by_id(prov);
-  }
-  if (!provider_installed(p)) {
-    throw std::runtime_error("Provider '" + p.id + "' not installed. Run: dist2land setup --provider " + p.id);
-  }
+  const Provider p = resolve_installed_provider(av);
   const auto shp = provider_shapefile_path(p);
+  ensure_spatial_index(p, shp);
 
   // Find nearest land point by geodesic (AEQD) and return its coordinates.
-  auto r = distance_query_geodesic(lat, lon, p.id, shp);
-
-  double d_m = 0.0;
-  if (metric == "geodesic") {
-    d_m = r.geodesic_m;
-  } else if (metric == "chord") {
-    d_m = chord_distance_wgs84_m(lat, lon, r.land_lat_deg, r.land_lon_deg);
-  } else if (metric == "rhumb") {
-    d_m = rhumb_distance_sphere_m(lat, lon, r.land_lat_deg, r.land_lon_deg);
-  } else {
-    throw std::runtime_error("Unknown --metric: " + metric + " (use geodesic|chord|rhumb)");
-  }
-
+  // The engine is opened first so "allocs" counts the query alone.
+  const auto open_start = std::chrono::steady_clock::now();
+  DistanceEngine engine(p.id, shp);
+  const double open_ms =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count();
+  QueryProfile profile;
+  if (profile_on) engine.set_profile(&profile);
+  const uint64_t allocs_before = alloc_count();
+  auto r = engine.query(lat, lon);
+  const uint64_t query_allocs = alloc_count() - allocs_before;
+
+  const double d_m = metric_distance_m(metric, lat, lon, r);
   const double out = convert_units(d_m, units);
+  const std::string profile_json =
+      profile_on ? format_profile_json(open_ms, profile, engine.stats(), query_allocs) : "";
 
   if (json) {
-    std::ostringstream os;
-    os.setf(std::ios::fixed);
-
-    os << "{";
-    os << "\"query\":{"
-       << "\"lat_deg\":" << std::setprecision(8) << lat << ","
-       << "\"lon_deg\":" << std::setprecision(8) << lon << "},";
-
-    os << "\"result\":{";
-    os << "\"distance\":"     << std::setprecision(3) << out << ",";
-    os << "\"units\":\""      << json_escape(to_lower(units)) << "\",";
-    os << "\"metric\":\""     << json_escape(metric) << "\",";
-    os << "\"provider\":\""   << json_escape(r.provider_id) << "\",";
-    os << "\"land_lat_deg\":" << std::setprecision(8) << r.land_lat_deg << ",";
-    os << "\"land_lon_deg\":" << std::setprecision(8) << r.land_lon_deg << ",";
-    os << "\"distance_m\":"   << std::setprecision(3) << d_m << ",";
-    os << "\"geodesic_m\":"   << std::setprecision(3) << r.geodesic_m << ",";
-    os << "\"in_land\":"      << (r.in_land ? "true" : "false") << ",";
-    os << "\"shp\":\""        << json_escape(r.shp_path.string()) << "\"";
-    os << "}";
-    os << "}\n";
-
-    std::cout << os.str();
+    std::cout << format_result_json(lat, lon, out, units, metric, d_m, r, profile_json);
   } else {
     // Output: <distance> <units> <land_lat_deg> <land_lon_deg>
-    std::cout.setf(std::ios::fixed);
-    std::cout << std::setprecision(3) << out << " " << to_lower(units) << " "
-              << std::setprecision(8) << r.land_lat_deg << " "
-              << std::setprecision(8) << r.land_lon_deg
-              << "\n";
+    std::cout << format_result_text(out, units, r);
   }
 
   // Debug/trace to stderr
   std::cerr << "provider=" << r.provider_id
             << " metric=" << metric
             << " shp=" << r.shp_path.string()
+            << " backend=" << engine.backend_name()
             << " geodesic_m=" << r.geodesic_m
             << "\n";
+  if (profile_on && !json) std::cerr << "{" << profile_json.substr(0, profile_json.size() - 1) << "}\n";
+}
+
+// route: minimum clearance along a GPX/GeoJSON polyline.
+static void cmd_route(const ArgvView& av) {
+  const std::string units  = av.get("--units", "m");
+  const std::string input  = av.get("--input", "-");
+  const bool json          = has_flag(av, "--json");
+  const bool per_leg       = has_flag(av, "--legs");
+  const bool profile_on    = has_flag(av, "--profile");
+  count_allocations(profile_on);
+  convert_units(0.0, units);
+
+  std::vector<double> lat, lon;
+  if (input == "-") {
+    read_route(std::cin, av.get("--format", ""), lat, lon);
+  } else {
+    std::ifstream file(input, std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Failed to open input: " + input);
+    std::string format = av.get("--format", "");
+    if (format.empty()) {
+      const std::string ext = to_lower(std::filesystem::path(input).extension().string());
+      if (ext == ".gpx") format = "gpx";
+      else if (ext == ".geojson" || ext == ".json") format = "geojson";
+    }
+    read_route(file, format, lat, lon);
+  }
+
+  const Provider p = resolve_installed_provider(av);
+  const auto shp = provider_shapefile_path(p);
+  // Index-only (the shapefile fallback throws), so no .qix is built.
+
+  const auto open_start = std::chrono::steady_clock::now();
+  DistanceEngine engine(p.id, shp);
+  const double open_ms =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count();
+  QueryProfile profile;
+  if (profile_on) engine.set_profile(&profile);
+  const uint64_t allocs_before = alloc_count();
+  std::vector<RouteClearance> legs;
+  const RouteClearance min = engine.route(lat.size(), lat.data(), lon.data(), per_leg ? &legs : nullptr);
+  const uint64_t query_allocs = alloc_count() - allocs_before;
+  const std::string profile_json =
+      profile_on ? format_profile_json(open_ms, profile, engine.stats(), query_allocs) : "";
+
+  if (json) {
+    std::cout << format_route_json(units, p.id, lat.size(), min, per_leg ? &legs : nullptr, profile_json);
+  } else if (per_leg) {
+    for (const auto& leg : legs) std::cout << format_route_text(leg, units);
+  } else {
+    std::cout << format_route_text(min, units);
+  }
+  std::cerr << "provider=" << p.id << " waypoints=" << lat.size() << " min_leg=" << min.leg
+            << " geodesic_m=" << min.geodesic_m << "\n";
+  if (profile_on && !json) std::cerr << "{" << profile_json.substr(0, profile_json.size() - 1) << "}\n";
+}
+
+// batch, or track (one engine; consecutive records bound each other).
+static void cmd_batch(const ArgvView& av, bool track) {
+  BatchOptions opt;
+  opt.format = av.get("--format", "");
+  opt.units  = av.get("--units", "m");
+  opt.metric = to_lower(av.get("--metric", "geodesic"));
+  opt.json   = has_flag(av, "--json");
+  const std::string input = av.get("--input", "-");
+
+  if (track && av.has("--threads")) {
+    throw std::runtime_error("track answers records in order on one thread (no --threads)");
+  }
+  const unsigned threads = track ? 1 : thread_count_arg(av);
+
+  const Provider p = resolve_installed_provider(av);
+  const auto shp = provider_shapefile_path(p);
+  ensure_spatial_index(p, shp);
+
+  std::ios::sync_with_stdio(false);
+
+  std::ifstream file;
+  std::istream* in = &std::cin;
+  if (input != "-") {
+    file.open(input);
+    if (!file.is_open()) throw std::runtime_error("Failed to open input: " + input);
+    in = &file;
+  }
+
+  // One engine (and dataset handle) per worker thread; OGR layers are not thread-safe.
+  std::vector<std::unique_ptr<DistanceEngine>> engines;
+  std::vector<DistanceEngine*> workers;
+  for (unsigned i = 0; i < threads; ++i) {
+    engines.push_back(std::make_unique<DistanceEngine>(p.id, shp));
+    workers.push_back(engines.back().get());
+  }
+  const auto sum = track ? run_track(*workers[0], *in, std::cout, opt)
+                         : run_batch(workers, *in, std::cout, opt);
+
+  std::cerr << "provider=" << p.id
+            << " metric=" << opt.metric
+            << " shp=" << shp.string()
+            << " threads=" << threads
+            << " records=" << sum.records
+            << " errors=" << sum.errors
+            << "\n";
+}
+
+static void cmd_serve(const ArgvView& av) {
+  ServeOptions opt;
+  opt.socket_path = av.get("--socket", "");
+  if (opt.socket_path.empty()) throw std::runtime_error("serve requires --socket");
+  opt.threads = thread_count_arg(av);
+  opt.units   = av.get("--units", "m");
+  opt.metric  = to_lower(av.get("--metric", "geodesic"));
+  convert_units(0.0, opt.units);
+  if (opt.metric != "geodesic" && opt.metric != "chord" && opt.metric != "rhumb") {
+    throw std::runtime_error("Unknown --metric: " + opt.metric + " (use geodesic|chord|rhumb)");
+  }
+  const double interval = av.get_double("--stats-interval", 60.0);
+  if (interval < 0.0 || interval != std::floor(interval)) {
+    throw std::runtime_error("--stats-interval must be a non-negative integer (seconds, 0 = off)");
+  }
+  opt.stats_interval_s = (unsigned)interval;
+
+  const Provider p = resolve_installed_provider(av);
+  const auto shp = provider_shapefile_path(p);
+  ensure_spatial_index(p, shp);
+
+  run_server(p.id, shp, opt);
 }
 
 int main(int argc, char** argv) {
@@ -306,7 +755,13 @@ int main(int argc, char** argv) {
     if (cmd == "help" || cmd == "-h" || cmd == "--help") { print_usage(); return 0; }
     if (cmd == "providers") { cmd_providers(); return 0; }
     if (cmd == "setup")     { cmd_setup(av);   return 0; }
+    if (cmd == "update")    { cmd_update(av);  return 0; }
     if (cmd == "distance")  { cmd_distance(av); return 0; }
+    if (cmd == "batch")     { cmd_batch(av, false); return 0; }
+    if (cmd == "track")     { cmd_batch(av, true);  return 0; }
+    if (cmd == "route")     { cmd_route(av);    return 0; }
+    if (cmd == "serve")     { cmd_serve(av);    return 0; }
+    if (cmd == "build-index") { cmd_build_index(av); return 0; }
 
     print_usage();
     return 2;
@@ -0,0 +1,98 @@
+#include "mmap_file.h"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& o) noexcept { *this = std::move(o); }
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+  if (this != &o) {
+    close();
+    data_ = std::exchange(o.data_, nullptr);
+    size_ = std::exchange(o.size_, 0);
+#ifdef _WIN32
+    file_ = std::exchange(o.file_, nullptr);
+    mapping_ = std::exchange(o.mapping_, nullptr);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+
+void MappedFile::open(const std::filesystem::path& path) {
+  close();
+  HANDLE f = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                         nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (f == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open: " + path.string());
+
+  LARGE_INTEGER sz;
+  if (!GetFileSizeEx(f, &sz) || sz.QuadPart == 0) {
+    CloseHandle(f);
+    throw std::runtime_error("Empty or unreadable file: " + path.string());
+  }
+
+  HANDLE m = CreateFileMappingW(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m) { CloseHandle(f); throw std::runtime_error("CreateFileMapping failed: " + path.string()); }
+
+  void* p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+  if (!p) {
+    CloseHandle(m);
+    CloseHandle(f);
+    throw std::runtime_error("MapViewOfFile failed: " + path.string());
+  }
+
+  file_ = f;
+  mapping_ = m;
+  data_ = (const unsigned char*)p;
+  size_ = (std::size_t)sz.QuadPart;
+}
+
+void MappedFile::close() {
+  if (data_) UnmapViewOfFile(data_);
+  if (mapping_) CloseHandle((HANDLE)mapping_);
+  if (file_) CloseHandle((HANDLE)file_);
+  data_ = nullptr;
+  size_ = 0;
+  file_ = nullptr;
+  mapping_ = nullptr;
+}
+
+#else
+
+void MappedFile::open(const std::filesystem::path& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("Failed to open: " + path.string());
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    throw std::runtime_error("Empty or unreadable file: " + path.string());
+  }
+
+  void* p = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd); // the mapping keeps its own reference
+  if (p == MAP_FAILED) throw std::runtime_error("mmap failed: " + path.string());
+
+  data_ = (const unsigned char*)p;
+  size_ = (std::size_t)st.st_size;
+}
+
+void MappedFile::close() {
+  if (data_) ::munmap((void*)data_, size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file. Pages are faulted in on demand
+// and shared through the OS page cache between processes mapping the same file.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::filesystem::path& path) { open(path); }
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& o) noexcept;
+  MappedFile& operator=(MappedFile&& o) noexcept;
+
+  // Throws std::runtime_error on failure.
+  void open(const std::filesystem::path& path);
+  void close();
+
+  bool is_open() const { return data_ != nullptr; }
+  const unsigned char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  const unsigned char* data_ = nullptr;
+  std::size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
@@ -1,10 +1,19 @@
 #include "ogr_distance.h"
+#include "aeqd.h"
+#include "coast_index.h"
+#include "geo_metrics.h"
+#include "index_distance.h"
+#include "segment_kernel.h"
+#include "shapefile.h"
 #include <gdal.h>
 #include <ogrsf_frmts.h>
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <mutex>
 #include <stdexcept>
+#include <vector>
 
 static constexpr double kPi = 3.141592653589793238462643383279502884;
 static double deg2rad(double d) { return d * (kPi / 180.0); }
@@ -17,45 +26,13 @@ static void metersToDegWindow(double lat_deg, double radius_m, double& dlat_deg,
   dlon_deg = radius_m / (meters_per_deg_lat * coslat);
 }
 
-static void update_best_on_lines(const OGRGeometry* geom,
-                                 const OGRPoint& p_xy,
-                                 double& best_dist_m,
-                                 OGRPoint& best_pt_xy) {
-  if (!geom) return;
-
-  const auto gt = wkbFlatten(geom->getGeometryType());
-
-  if (gt == wkbLineString || gt == wkbLinearRing) {
-    const auto* ls = dynamic_cast<const OGRLineString*>(geom);
-    if (!ls || ls->getNumPoints() < 2) return;
-
-    const double s = ls->Project(&p_xy);
-    OGRPoint cp;
-    ls->Value(s, &cp);
-
-    const double d = cp.Distance(&p_xy);
-    if (d < best_dist_m) {
-      best_dist_m = d;
-      best_pt_xy = cp;
-    }
-    return;
-  }
-
-  if (gt == wkbMultiLineString || gt == wkbGeometryCollection) {
-    const auto* coll = dynamic_cast<const OGRGeometryCollection*>(geom);
-    if (!coll) return;
-    const int n = coll->getNumGeometries();
-    for (int i = 0; i < n; ++i) {
-      update_best_on_lines(coll->getGeometryRef(i), p_xy, best_dist_m, best_pt_xy);
-    }
-    return;
-  }
+static void gdal_register_once() {
+  static std::once_flag g_gdal_init;
+  std::call_once(g_gdal_init, [] { GDALAllRegister(); });
 }
 
-DistanceQueryResult distance_query_geodesic_ogr(double lat_deg, double lon_deg,
-                                               const std::string& provider_id,
-                                               const std::filesystem::path& shp_path) {
-  GDALAllRegister();
+static GDALDataset* open_shapefile_or_throw(const std::filesystem::path& shp_path, OGRLayer*& layer) {
+  gdal_register_once();
 
   GDALDataset* ds = (GDALDataset*)GDALOpenEx(
       shp_path.string().c_str(),
@@ -64,83 +41,321 @@ DistanceQueryResult distance_query_geodesic_ogr(double lat_deg, double lon_deg,
 
   if (!ds) throw std::runtime_error("Failed to open shapefile: " + shp_path.string());
 
-  OGRLayer* layer = ds->GetLayer(0);
+  layer = ds->GetLayer(0);
   if (!layer) { GDALClose(ds); throw std::runtime_error("No layer in shapefile"); }
 
-  OGRSpatialReference wgs84;
-  wgs84.importFromEPSG(4326);
-
-  OGRSpatialReference aeqd;
-  {
-    std::string proj4 = "+proj=aeqd +lat_0=" + std::to_string(lat_deg) +
-                        " +lon_0=" + std::to_string(lon_deg) +
-                        " +datum=WGS84 +units=m +no_defs";
-    aeqd.importFromProj4(proj4.c_str());
-  }
-
-  OGRCoordinateTransformation* toAEQD = OGRCreateCoordinateTransformation(&wgs84, &aeqd);
-  OGRCoordinateTransformation* toWGS  = OGRCreateCoordinateTransformation(&aeqd, &wgs84);
-  if (!toAEQD || !toWGS) {
-    if (toAEQD) OCTDestroyCoordinateTransformation(toAEQD);
-    if (toWGS)  OCTDestroyCoordinateTransformation(toWGS);
-    GDALClose(ds);
-    throw std::runtime_error("Failed to create coordinate transformations (WGS84 <-> AEQD)");
+  // We only ever look at geometry; skip decoding the DBF attributes.
+  OGRFeatureDefn* defn = layer->GetLayerDefn();
+  std::vector<const char*> ignored;
+  for (int i = 0; defn && i < defn->GetFieldCount(); ++i) {
+    ignored.push_back(defn->GetFieldDefn(i)->GetNameRef());
   }
+  ignored.push_back("OGR_STYLE");
+  ignored.push_back(nullptr);
+  layer->SetIgnoredFields(ignored.data());
+  return ds;
+}
 
-  OGRPoint p_wgs(lon_deg, lat_deg);
-  OGRPoint p_xy = p_wgs;
-  if (p_xy.transform(toAEQD) != OGRERR_NONE) {
-    OCTDestroyCoordinateTransformation(toAEQD);
-    OCTDestroyCoordinateTransformation(toWGS);
-    GDALClose(ds);
-    throw std::runtime_error("Failed to transform query point to AEQD");
-  }
+namespace {
+// Ring view over an OGR ring, with the ShpRing interface.
+struct OgrRing {
+  const OGRLinearRing* r;
+  std::size_t size() const { return r ? (std::size_t)r->getNumPoints() : 0; }
+  double x(std::size_t i) const { return r->getX((int)i); }
+  double y(std::size_t i) const { return r->getY((int)i); }
+};
+
+// Measures feature geometry in place: no clone(), transform() or Boundary()
+// copies. Polygons and rings whose lon/lat envelope cannot beat the current
+// best are rejected before any vertex is projected; the rest are projected
+// onto the sphere into the engine's reusable scratch arrays and run through
+// the segment kernel, and only segments the spherical distances cannot rule
+// out get the exact ellipsoidal projection. The query point is the AEQD
+// origin. in_land comes from a point-in-polygon test on the raw lon/lat rings.
+struct CandidateScan {
+  const AeqdProjection& aeqd;
+  double lat_deg, lon_deg;
+  double qlat, qlon;   // radians
+  std::vector<double>& xs;
+  std::vector<double>& ys;
 
   double best = std::numeric_limits<double>::infinity();
-  OGRPoint best_pt_xy;
+  double best_x = 0.0, best_y = 0.0;
   bool in_land = false;
+  long long fid = -1;        // feature being measured
+  long long best_fid = -1;   // feature holding the best so far
+  uint64_t vertices = 0;     // projected, for QueryStats
+
+  CandidateScan(const AeqdProjection& proj, double lat, double lon,
+                   std::vector<double>& xs_scratch, std::vector<double>& ys_scratch)
+      : aeqd(proj), lat_deg(lat), lon_deg(lon), qlat(deg2rad(lat)), qlon(deg2rad(lon)),
+        xs(xs_scratch), ys(ys_scratch) {}
+
+  double lower_bound_m(const double* box) const { return box_distance_lower_bound_m(qlat, qlon, box); }
+  double lower_bound_m(const OGREnvelope& e) const {
+    const double box[4] = {e.MinX, e.MinY, e.MaxX, e.MaxY};
+    return lower_bound_m(box);
+  }
 
-  double radius_m = 10'000.0;
-  const double max_radius_m = 20'000'000.0;
+  // Crossing-number test in lon/lat. Rings are OgrRing or ShpRing views.
+  template <class Ring>
+  bool ring_contains(const Ring& ring) const {
+    const std::size_t n = ring.size();
+    bool inside = false;
+    for (std::size_t i = 0, j = n - 1; i < n; j = i++) {
+      const double xi = ring.x(i), yi = ring.y(i);
+      const double xj = ring.x(j), yj = ring.y(j);
+      if ((yi > lat_deg) != (yj > lat_deg) &&
+          lon_deg < (xj - xi) * (lat_deg - yi) / (yj - yi) + xi) {
+        inside = !inside;
+      }
+    }
+    return inside;
+  }
 
-  auto scanWindow = [&](double xmin, double ymin, double xmax, double ymax) {
-    layer->SetSpatialFilterRect(xmin, ymin, xmax, ymax);
-    layer->ResetReading();
+  template <class Ring>
+  void ring(const Ring& r) {
+    const std::size_t n = r.size();
+    if (n < 2) return;
+    double env[4] = {r.x(0), r.y(0), r.x(0), r.y(0)};
+    for (std::size_t i = 1; i < n; ++i) {
+      env[0] = std::min(env[0], r.x(i));
+      env[1] = std::min(env[1], r.y(i));
+      env[2] = std::max(env[2], r.x(i));
+      env[3] = std::max(env[3], r.y(i));
+    }
+    if (lower_bound_m(env) > best) return;
 
-    OGRFeature* feat = nullptr;
-    while ((feat = layer->GetNextFeature()) != nullptr) {
-      OGRGeometry* g = feat->GetGeometryRef();
-      if (!g) { OGRFeature::DestroyFeature(feat); continue; }
-
-      OGRGeometry* g_xy = g->clone();
-      if (g_xy->transform(toAEQD) != OGRERR_NONE) {
-        OGRGeometryFactory::destroyGeometry(g_xy);
-        OGRFeature::DestroyFeature(feat);
-        continue;
+    xs.resize(n);
+    ys.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      xs[i] = r.x(i);
+      ys[i] = r.y(i);
+    }
+    const double rmax = aeqd.forward_sphere(n, xs.data(), ys.data());
+    vertices += n;
+    const auto rough = nearest_segment(0.0, 0.0, xs.data(), ys.data(), n - 1, nullptr);
+    if (std::sqrt(rough.dist2) - kAeqdSphereError * rmax > best) return;
+
+    std::size_t exact_at = n;   // vertex whose exact projection is in (ex, ey)
+    double ex = 0.0, ey = 0.0;
+    for (std::size_t a = 0; a + 1 < n; ++a) {
+      const std::size_t b = a + 1;
+      double cx, cy;
+      closest_on_segment(0.0, 0.0, xs[a], ys[a], xs[b], ys[b], cx, cy);
+      const double reach = std::max(std::hypot(xs[a], ys[a]), std::hypot(xs[b], ys[b]));
+      if (std::hypot(cx, cy) - kAeqdSphereError * reach > best) continue;
+
+      double ax = r.x(a), ay = r.y(a);
+      if (exact_at == a) {
+        ax = ex;
+        ay = ey;
+      } else {
+        aeqd.forward(1, &ax, &ay);
+        ++vertices;
       }
+      double bx = r.x(b), by = r.y(b);
+      aeqd.forward(1, &bx, &by);
+      ++vertices;
+      exact_at = b;
+      ex = bx;
+      ey = by;
+
+      closest_on_segment(0.0, 0.0, ax, ay, bx, by, cx, cy);
+      const double d = std::hypot(cx, cy);
+      if (d < best) {
+        best = d;
+        best_x = cx;
+        best_y = cy;
+        best_fid = fid;
+      }
+    }
+  }
 
-      const double d_poly = p_xy.Distance(g_xy);
-      if (d_poly == 0.0) {
+  // A native shapefile record: rings are not grouped into polygons, so the
+  // containment test is even-odd over all of them.
+  void record(const ShpPolygon& p) {
+    if (in_land) return;
+    if (lon_deg >= p.box[0] && lon_deg <= p.box[2] && lat_deg >= p.box[1] && lat_deg <= p.box[3]) {
+      bool inside = false;
+      for (uint32_t k = 0; k < p.num_parts; ++k) {
+        const ShpRing r = p.ring(k);
+        if (r.size() >= 2 && ring_contains(r)) inside = !inside;
+      }
+      if (inside) {
+        in_land = true;
         best = 0.0;
-        best_pt_xy = p_xy;
+        best_fid = fid;
+        return;
+      }
+    }
+    if (lower_bound_m(p.box) > best) return;
+    for (uint32_t k = 0; k < p.num_parts; ++k) ring(p.ring(k));
+  }
+
+  void polygon(const OGRPolygon* poly) {
+    const OGRLinearRing* outer = poly ? poly->getExteriorRing() : nullptr;
+    if (!outer) return;
+
+    OGREnvelope env;
+    outer->getEnvelope(&env);
+    if (lon_deg >= env.MinX && lon_deg <= env.MaxX && lat_deg >= env.MinY && lat_deg <= env.MaxY &&
+        ring_contains(OgrRing{outer})) {
+      bool in_hole = false;
+      for (int i = 0; i < poly->getNumInteriorRings() && !in_hole; ++i) {
+        in_hole = ring_contains(OgrRing{poly->getInteriorRing(i)});
+      }
+      if (!in_hole) {
         in_land = true;
-        OGRGeometryFactory::destroyGeometry(g_xy);
-        OGRFeature::DestroyFeature(feat);
+        best = 0.0;
+        best_fid = fid;
         return;
       }
+    }
+    if (lower_bound_m(env) > best) return;   // holes lie inside the exterior
+
+    ring(OgrRing{outer});
+    for (int i = 0; i < poly->getNumInteriorRings(); ++i) ring(OgrRing{poly->getInteriorRing(i)});
+  }
+
+  void geometry(const OGRGeometry* g) {
+    if (!g || in_land) return;
+    const auto gt = wkbFlatten(g->getGeometryType());
+    if (gt == wkbPolygon) {
+      polygon(dynamic_cast<const OGRPolygon*>(g));
+      return;
+    }
+    if (gt == wkbMultiPolygon || gt == wkbGeometryCollection) {
+      const auto* coll = dynamic_cast<const OGRGeometryCollection*>(g);
+      if (!coll) return;
+      for (int i = 0; i < coll->getNumGeometries() && !in_land; ++i) geometry(coll->getGeometryRef(i));
+    }
+  }
+};
+} // namespace
+
+OgrDistanceEngine::OgrDistanceEngine(const std::filesystem::path& shp_path,
+                                     const std::filesystem::path& bounds_path) {
+  // Plain polygon shapefiles are read natively on little-endian hosts; GDAL
+  // handles anything else.
+  try {
+    shp_ = std::make_unique<ShapefileReader>(shp_path);
+  } catch (const std::exception&) {
+    ds_ = open_shapefile_or_throw(shp_path, layer_);
+  }
+
+  // Optional, like the index engine's grids: ignore it unless it was built
+  // from this very shapefile.
+  std::error_code ec;
+  if (!bounds_path.empty() && std::filesystem::exists(bounds_path, ec)) {
+    try {
+      bounds_ = std::make_unique<BoundGrid>(bounds_path);
+      if (!bounds_->matches(shp_path)) bounds_.reset();
+    } catch (const std::exception&) {
+      bounds_.reset();
+    }
+  }
+}
+
+OgrDistanceEngine::~OgrDistanceEngine() {
+  if (ds_) GDALClose(ds_);
+}
 
-      OGRGeometry* bnd = g_xy->Boundary();
-      if (bnd) {
-        update_best_on_lines(bnd, p_xy, best, best_pt_xy);
-        OGRGeometryFactory::destroyGeometry(bnd);
+DistanceQueryResult OgrDistanceEngine::query(double lat_deg, double lon_deg) {
+  return search(lat_deg, lon_deg, nullptr);
+}
+
+DistanceQueryResult OgrDistanceEngine::query_near(double lat_deg, double lon_deg, TrackHint& hint) {
+  return search(lat_deg, lon_deg, &hint);
+}
+
+DistanceQueryResult OgrDistanceEngine::search(double lat_deg, double lon_deg, TrackHint* hint) {
+  PhaseTimer timer(profile_);
+  aeqd_.set_center(lat_deg, lon_deg);
+  ++stats_.queries;
+
+  OGRLayer* layer = layer_;
+  CandidateScan scan(aeqd_, lat_deg, lon_deg, xs_, ys_);
+  double& best = scan.best;
+
+  // The answer lies within the hint's and the bound grid's upper bounds, so
+  // the first window only needs to reach that far (the windows still grow if
+  // a bound was too tight). Coastline found at the grid's lower bound cannot
+  // be beaten.
+  double cap = hint ? hint->upper_bound_m : std::numeric_limits<double>::infinity();
+  double lower_m = 0.0;
+  if (bounds_) {
+    const auto b = bounds_->lookup(lat_deg, lon_deg);
+    cap = std::min(cap, (double)b.upper_m);
+    lower_m = b.lower_m;
+  }
+  auto done = [&] { return scan.in_land || (lower_m > 0.0 && best <= lower_m); };
+  double radius_m = std::isfinite(cap) ? std::max(cap, 100.0) : 10'000.0;
+  const double max_radius_m = 20'000'000.0;
+
+  // Features already measured in a smaller window (sorted FIDs); growing the
+  // window must not measure them again.
+  seen_.clear();
+  timer.mark(&QueryProfile::setup_ms);
+
+  // The feature that was nearest last time usually still is: measuring it
+  // first tightens `best` before the window scan.
+  ShpPolygon rec;
+  if (hint && hint->feature >= 0 && shp_) {
+    if (shp_->record((std::size_t)hint->feature, rec)) {
+      seen_.push_back(hint->feature);
+      ++stats_.features;
+      scan.fid = hint->feature;
+      scan.record(rec);
+    }
+  } else if (hint && hint->feature >= 0) {
+    if (OGRFeature* feat = layer->GetFeature((GIntBig)hint->feature)) {
+      seen_.push_back(feat->GetFID());
+      ++stats_.features;
+      scan.fid = feat->GetFID();
+      scan.geometry(feat->GetGeometryRef());
+      OGRFeature::DestroyFeature(feat);
+    }
+  }
+
+  auto scanWindow = [&](double xmin, double ymin, double xmax, double ymax) {
+    ++stats_.windows;
+    if (shp_) {
+      shp_->search(xmin, ymin, xmax, ymax, ids_);
+      for (const uint32_t id : ids_) {
+        auto it = std::lower_bound(seen_.begin(), seen_.end(), (long long)id);
+        if (it != seen_.end() && *it == id) continue;
+        seen_.insert(it, id);
+
+        if (!shp_->record(id, rec)) continue;
+        ++stats_.features;
+        scan.fid = id;
+        scan.record(rec);
+        if (done()) return;
       }
+      return;
+    }
 
-      OGRGeometryFactory::destroyGeometry(g_xy);
+    layer->SetSpatialFilterRect(xmin, ymin, xmax, ymax);
+    layer->ResetReading();
+
+    OGRFeature* feat = nullptr;
+    while ((feat = layer->GetNextFeature()) != nullptr) {
+      const GIntBig fid = feat->GetFID();
+      auto it = std::lower_bound(seen_.begin(), seen_.end(), fid);
+      if (it != seen_.end() && *it == fid) { OGRFeature::DestroyFeature(feat); continue; }
+      seen_.insert(it, fid);
+
+      ++stats_.features;
+      scan.fid = fid;
+      scan.geometry(feat->GetGeometryRef());
       OGRFeature::DestroyFeature(feat);
+      if (done()) return;
     }
   };
 
-  while (radius_m <= max_radius_m) {
+  while (!done() && radius_m <= max_radius_m) {
+    ++stats_.passes;
     double dlat, dlon;
     metersToDegWindow(lat_deg, radius_m, dlat, dlon);
 
@@ -151,54 +366,125 @@ DistanceQueryResult distance_query_geodesic_ogr(double lat_deg, double lon_deg,
 
     if (xmin < -180.0) {
       scanWindow(xmin + 360.0, ymin, 180.0, ymax);
-      if (best == 0.0) break;
+      if (best == 0.0 || done()) break;
       scanWindow(-180.0, ymin, xmax, ymax);
     } else if (xmax > 180.0) {
       scanWindow(xmin, ymin, 180.0, ymax);
-      if (best == 0.0) break;
+      if (best == 0.0 || done()) break;
       scanWindow(-180.0, ymin, xmax - 360.0, ymax);
     } else {
       scanWindow(xmin, ymin, xmax, ymax);
     }
 
-    layer->SetSpatialFilter(nullptr);
+    if (layer) layer->SetSpatialFilter(nullptr);
 
-    if (best == 0.0) break;
+    if (best == 0.0 || done()) break;
     if (std::isfinite(best) && best <= radius_m * 1.2) break;
 
     radius_m *= 2.0;
   }
 
-  layer->SetSpatialFilter(nullptr);
+  if (layer) layer->SetSpatialFilter(nullptr);
+  if (hint) hint->feature = scan.best_fid;
+  stats_.vertices += scan.vertices;
+  timer.mark(&QueryProfile::search_ms);
 
   if (!std::isfinite(best)) {
-    OCTDestroyCoordinateTransformation(toAEQD);
-    OCTDestroyCoordinateTransformation(toWGS);
-    GDALClose(ds);
     throw std::runtime_error("No distance computed (bad dataset?)");
   }
 
-  OGRPoint land_wgs = best_pt_xy;
-  if (land_wgs.transform(toWGS) != OGRERR_NONE) {
-    OCTDestroyCoordinateTransformation(toAEQD);
-    OCTDestroyCoordinateTransformation(toWGS);
-    GDALClose(ds);
-    throw std::runtime_error("Failed to transform nearest land point back to WGS84");
-  }
-
-  const double land_lon = land_wgs.getX();
-  const double land_lat = land_wgs.getY();
-
-  OCTDestroyCoordinateTransformation(toAEQD);
-  OCTDestroyCoordinateTransformation(toWGS);
-  GDALClose(ds);
+  const bool in_land = scan.in_land;
+  double land_lon = lon_deg, land_lat = lat_deg;
+  if (!in_land) aeqd_.inverse(scan.best_x, scan.best_y, land_lon, land_lat);
 
   DistanceQueryResult out;
-  out.provider_id = provider_id;
-  out.shp_path = shp_path;
   out.geodesic_m = best;
   out.land_lat_deg = land_lat;
   out.land_lon_deg = land_lon;
   out.in_land = in_land;
+  timer.mark(&QueryProfile::finish_ms);
   return out;
 }
+
+DistanceQueryResult distance_query_geodesic_ogr(double lat_deg, double lon_deg,
+                                               const std::string& provider_id,
+                                               const std::filesystem::path& shp_path) {
+  OgrDistanceEngine engine(shp_path);
+  auto r = engine.query(lat_deg, lon_deg);
+  r.provider_id = provider_id;
+  r.shp_path = shp_path;
+  return r;
+}
+
+// Feeds every polygon ring of `g` to the index writer.
+static void add_polygons(const OGRGeometry* g, CoastIndexWriter& w, std::vector<double>& xy) {
+  if (!g) return;
+  const auto gt = wkbFlatten(g->getGeometryType());
+
+  auto add_ring = [&](const OGRLinearRing* ring, bool exterior) {
+    if (!ring) return;
+    const int n = ring->getNumPoints();
+    xy.resize(2 * (size_t)n);
+    for (int i = 0; i < n; ++i) {
+      xy[2 * (size_t)i] = ring->getX(i);
+      xy[2 * (size_t)i + 1] = ring->getY(i);
+    }
+    w.add_ring(xy.data(), (size_t)n, exterior);
+  };
+
+  if (gt == wkbPolygon) {
+    const auto* poly = dynamic_cast<const OGRPolygon*>(g);
+    if (!poly) return;
+    w.begin_polygon();
+    add_ring(poly->getExteriorRing(), true);
+    for (int i = 0; i < poly->getNumInteriorRings(); ++i) add_ring(poly->getInteriorRing(i), false);
+    return;
+  }
+
+  if (gt == wkbMultiPolygon || gt == wkbGeometryCollection) {
+    const auto* coll = dynamic_cast<const OGRGeometryCollection*>(g);
+    if (!coll) return;
+    for (int i = 0; i < coll->getNumGeometries(); ++i) add_polygons(coll->getGeometryRef(i), w, xy);
+  }
+}
+
+void build_coast_index_ogr(const std::filesystem::path& shp_path,
+                           const std::filesystem::path& index_path) {
+  OGRLayer* layer = nullptr;
+  GDALDataset* ds = open_shapefile_or_throw(shp_path, layer);
+
+  try {
+    CoastIndexWriter w(index_path);
+    std::vector<double> xy;
+
+    layer->ResetReading();
+    OGRFeature* feat = nullptr;
+    while ((feat = layer->GetNextFeature()) != nullptr) {
+      add_polygons(feat->GetGeometryRef(), w, xy);
+      OGRFeature::DestroyFeature(feat);
+    }
+
+    w.finish(coast_index_source_of(shp_path, true));
+  } catch (...) {
+    GDALClose(ds);
+    throw;
+  }
+  GDALClose(ds);
+
+  build_land_grid(index_path);
+  build_bound_grid(index_path);
+}
+
+void build_spatial_index_ogr(const std::filesystem::path& shp_path) {
+  OGRLayer* layer = nullptr;
+  GDALDataset* ds = open_shapefile_or_throw(shp_path, layer);
+
+  // Same as: ogrinfo <shp> -sql "CREATE SPATIAL INDEX ON <layer>"; the
+  // shapefile driver writes <name>.qix next to the .shp.
+  const std::string sql = std::string("CREATE SPATIAL INDEX ON \"") + layer->GetName() + "\"";
+  if (OGRLayer* rs = ds->ExecuteSQL(sql.c_str(), nullptr, nullptr)) ds->ReleaseResultSet(rs);
+  const bool ok = layer->TestCapability(OLCFastSpatialFilter) != 0;
+  GDALClose(ds);
+
+  if (!ok) throw std::runtime_error("Failed to create spatial index for " + shp_path.string());
+}
@@ -1,9 +1,60 @@
 #pragma once
-#include "distance_iface.h"
+#include "aeqd.h"
+#include "bound_grid.h"
+#include "distance_backend.h"
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <string>
+#include <vector>
 
-// Direct GDAL/OGR implementation used on POSIX and inside the Windows plugin.
+class GDALDataset;
+class OGRLayer;
+class ShapefileReader;
+
+// Shapefile implementation used on POSIX and inside the GDAL plugin when
+// there is no fresh coastline index. Polygon shapefiles are memory-mapped and
+// read natively (shapefile.h); other inputs go through GDAL/OGR. Opens the
+// shapefile once and serves any number of queries; OGR layers are not
+// thread-safe, so use one engine per thread.
+class OgrDistanceEngine : public DistanceBackend {
+public:
+  // `bounds_path` optionally names a bound grid (bound_grid.h); it is used
+  // only if it was built from this shapefile.
+  explicit OgrDistanceEngine(const std::filesystem::path& shp_path,
+                             const std::filesystem::path& bounds_path = {});
+  ~OgrDistanceEngine() override;
+
+  OgrDistanceEngine(const OgrDistanceEngine&) = delete;
+  OgrDistanceEngine& operator=(const OgrDistanceEngine&) = delete;
+
+  DistanceQueryResult query(double lat_deg, double lon_deg) override;
+  const char* name() const override { return "shapefile"; }
+  DistanceQueryResult query_near(double lat_deg, double lon_deg, TrackHint& hint) override;
+
+private:
+  std::unique_ptr<ShapefileReader> shp_;   // null when reading through OGR
+  GDALDataset* ds_ = nullptr;
+  OGRLayer* layer_ = nullptr;
+  AeqdProjection aeqd_;
+  std::unique_ptr<BoundGrid> bounds_;
+  // per-query scratch, reused so queries do not allocate once warm
+  std::vector<double> xs_, ys_;
+  std::vector<long long> seen_;
+  std::vector<uint32_t> ids_;
+
+  DistanceQueryResult search(double lat_deg, double lon_deg, TrackHint* hint);
+};
+
+// One-shot query: opens the shapefile, answers, closes it again.
 DistanceQueryResult distance_query_geodesic_ogr(double lat_deg, double lon_deg,
                                                const std::string& provider_id,
                                                const std::filesystem::path& shp_path);
+
+// Reads every polygon of the shapefile and writes a compiled coastline index.
+void build_coast_index_ogr(const std::filesystem::path& shp_path,
+                           const std::filesystem::path& index_path);
+
+// Writes the shapefile's .qix spatial index, without which every OGR spatial
+// filter scans all features.
+void build_spatial_index_ogr(const std::filesystem::path& shp_path);
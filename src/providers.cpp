@@ -1,5 +1,6 @@
 #include "providers.h"
 #include "app_paths.h"
+#include "coast_index.h"
 #include "util.h"
 
 #include <stdexcept>
@@ -227,23 +228,175 @@ static bool any_shp_matches(const std::filesystem::path& root, const Provider& p
   return false;
 }
 
-bool provider_installed(const Provider& p) {
+// key=value lines; unknown keys are skipped.
+static std::vector<std::pair<std::string, std::string>> read_key_values(const std::filesystem::path& path) {
+  std::vector<std::pair<std::string, std::string>> out;
+  std::ifstream f(path);
+  std::string line;
+  while (std::getline(f, line)) {
+    auto eq = line.find('=');
+    if (eq == std::string::npos) continue;
+    out.emplace_back(trim_copy(line.substr(0, eq)), trim_copy(line.substr(eq + 1)));
+  }
+  return out;
+}
+
+// Written next to `path` and renamed over it, so readers never see half a file.
+static void write_file_atomic(const std::filesystem::path& path, const std::string& text) {
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::trunc);
+    f << text;
+    if (!f) throw std::runtime_error("Failed to write " + tmp.string());
+  }
+  std::filesystem::rename(tmp, path);
+}
+
+// Size and mtime of the provider's coastline index; false if it is missing.
+static bool coast_index_file_stamp(const Provider& p, uint64_t& size, int64_t& mtime) {
+  const auto path = coast_index_path(p.id);
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if (ec) return false;
+  const auto t = std::filesystem::last_write_time(path, ec);
+  if (ec) return false;
+  mtime = (int64_t)t.time_since_epoch().count();
+  return true;
+}
+
+bool read_provider_manifest(const Provider& p, ProviderManifest& out) {
+  out = ProviderManifest{};
+  for (const auto& [key, val] : read_key_values(provider_manifest_path(p.id))) {
+    if (key == "shp") out.shp = std::filesystem::path(val);
+    else if (key == "shp_size") out.shp_size = std::strtoull(val.c_str(), nullptr, 10);
+    else if (key == "shp_mtime") out.shp_mtime = std::strtoll(val.c_str(), nullptr, 10);
+    else if (key == "coast_index") out.coast_index = val;
+    else if (key == "index_size") { out.index_present = true; out.index_size = std::strtoull(val.c_str(), nullptr, 10); }
+    else if (key == "index_mtime") out.index_mtime = std::strtoll(val.c_str(), nullptr, 10);
+  }
+  if (out.shp.empty()) return false;
+
+  uint64_t index_size = 0;
+  int64_t index_mtime = 0;
+  const bool index_present = coast_index_file_stamp(p, index_size, index_mtime);
+  if (index_present != out.index_present) return false;
+  if (index_present && (index_size != out.index_size || index_mtime != out.index_mtime)) return false;
+
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(out.shp, ec);
+  if (ec || size != out.shp_size) return false;
+  const auto mtime = std::filesystem::last_write_time(out.shp, ec);
+  return !ec && (int64_t)mtime.time_since_epoch().count() == out.shp_mtime;
+}
+
+bool refresh_provider_manifest(const Provider& p) {
+  const auto path = provider_manifest_path(p.id);
+  std::error_code ec;
+  std::filesystem::path shp;
+  if (!any_shp_matches(provider_extract_root(p), p, shp)) {
+    std::filesystem::remove(path, ec);
+    return false;
+  }
+
+  const auto src = coast_index_source_of(shp, false);
+  const auto status = coast_index_status(coast_index_path(p.id), shp);
+  std::ostringstream oss;
+  oss << "shp=" << shp.string() << "\n"
+      << "shp_size=" << src.size << "\n"
+      << "shp_mtime=" << src.mtime << "\n"
+      << "coast_index=" << coast_index_status_name(status) << "\n";
+  // Stamped after the status check, which may rewrite the index header.
+  uint64_t index_size = 0;
+  int64_t index_mtime = 0;
+  if (coast_index_file_stamp(p, index_size, index_mtime)) {
+    oss << "index_size=" << index_size << "\n"
+        << "index_mtime=" << index_mtime << "\n";
+  }
+  try {
+    write_file_atomic(path, oss.str());
+  } catch (const std::exception&) {
+    // Read-only cache: lookups keep scanning, which is only slower.
+  }
+  return true;
+}
+
+// The manifest's shapefile if it is current, otherwise a fresh scan.
+static bool locate_shapefile(const Provider& p, std::filesystem::path& out) {
+  ProviderManifest m;
+  if (!read_provider_manifest(p, m)) {
+    if (!refresh_provider_manifest(p)) return false;
+    // An unwritable cache leaves no manifest: scan without one.
+    if (!read_provider_manifest(p, m)) return any_shp_matches(provider_extract_root(p), p, out);
+  }
+  out = m.shp;
+  return true;
+}
+
+bool provider_installed(const Provider& p, bool* has_spatial_index) {
+  if (has_spatial_index) *has_spatial_index = false;
   if (p.id == "auto") return false;
   std::filesystem::path shp;
-  return any_shp_matches(provider_extract_root(p), p, shp);
+  if (!locate_shapefile(p, shp)) return false;
+  if (has_spatial_index) {
+    std::error_code ec;
+    *has_spatial_index = std::filesystem::exists(shapefile_spatial_index_path(shp), ec);
+  }
+  return true;
 }
 
 std::filesystem::path provider_shapefile_path(const Provider& p) {
   if (p.id == "auto") throw std::runtime_error("auto has no direct shapefile");
-  auto root = provider_extract_root(p);
   std::filesystem::path shp;
-  if (!any_shp_matches(root, p, shp)) {
+  if (!locate_shapefile(p, shp)) {
     throw std::runtime_error("Provider not installed or shapefile not found: " + p.id +
                              "\nRun: dist2land setup --provider " + p.id);
   }
   return shp;
 }
 
+bool provider_wants_archive_entry(const Provider& p, const std::string& entry_path) {
+  // The shapefile and its sidecars (.shx, .dbf, .prj, ...) share its stem.
+  const auto stem = to_lower(std::filesystem::path(entry_path).stem().string());
+  if (stem.empty()) return false;
+  if (!p.explicit_shp.empty()) {
+    return stem == to_lower(std::filesystem::path(p.explicit_shp).stem().string());
+  }
+  for (auto& pat : p.shp_name_contains) {
+    if (stem.find(to_lower(pat)) != std::string::npos) return true;
+  }
+  return false;
+}
+
+bool read_provider_source(const Provider& p, ProviderSource& out) {
+  out = ProviderSource{};
+  for (const auto& [key, val] : read_key_values(provider_source_path(p.id))) {
+    if (key == "url") out.url = val;
+    else if (key == "etag") out.etag = val;
+    else if (key == "last_modified") out.last_modified = val;
+    else if (key == "length") out.length = std::strtoll(val.c_str(), nullptr, 10);
+    else if (key == "content_hash") out.content_hash = val;
+  }
+  return !out.url.empty();
+}
+
+void write_provider_source(const Provider& p, const ProviderSource& s) {
+  std::ostringstream oss;
+  oss << "url=" << s.url << "\n"
+      << "etag=" << s.etag << "\n"
+      << "last_modified=" << s.last_modified << "\n"
+      << "length=" << s.length << "\n"
+      << "content_hash=" << s.content_hash << "\n";
+  write_file_atomic(provider_source_path(p.id), oss.str());
+}
+
+std::filesystem::path shapefile_spatial_index_path(const std::filesystem::path& shp) {
+  auto qix = shp;
+  // Match the case of the .shp extension, as GDAL does.
+  qix.replace_extension(shp.extension() == ".SHP" ? ".QIX" : ".qix");
+  return qix;
+}
+
 std::string best_available_provider_id() {
   // Preference order is the order in the config file.
   for (const auto& p : providers_cached()) {
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <filesystem>
@@ -19,6 +20,50 @@ std::vector<Provider> all_providers();
 Provider provider_by_id(const std::string& id);
 std::string best_available_provider_id(); // auto selection based on installed data
 
-bool provider_installed(const Provider& p);
+// True once the provider's shapefile is extracted. If `has_spatial_index` is
+// given it is set to whether the shapefile's .qix spatial index exists.
+bool provider_installed(const Provider& p, bool* has_spatial_index = nullptr);
 std::filesystem::path provider_extract_root(const Provider& p);
 std::filesystem::path provider_shapefile_path(const Provider& p);
+
+// Where a provider's shapefile was found (manifest.ini in its cache dir), so
+// lookups cost one stat instead of a walk over the extracted tree. Written by
+// setup and build-index, and again whenever a lookup had to scan.
+struct ProviderManifest {
+  std::filesystem::path shp;
+  uint64_t shp_size = 0;
+  int64_t shp_mtime = 0;      // filesystem clock ticks, as in the coastline index
+  std::string coast_index;    // coastline index status when written ("fresh", ...)
+  bool index_present = false; // the index file as that status was judged
+  uint64_t index_size = 0;
+  int64_t index_mtime = 0;
+};
+
+// False if the manifest is missing, unreadable or no longer matches the
+// shapefile on disk (moved, resized or touched), or the coastline index has
+// since appeared, gone or changed, so that its status would be out of date.
+bool read_provider_manifest(const Provider& p, ProviderManifest& out);
+// Scans the extracted tree and rewrites the manifest. False (and no
+// manifest) if the shapefile is not there.
+bool refresh_provider_manifest(const Provider& p);
+
+// True for the archive entries setup needs to extract: the provider's
+// shapefile and the files next to it with the same name (.shx, .dbf, ...).
+bool provider_wants_archive_entry(const Provider& p, const std::string& entry_path);
+
+// What setup last downloaded for a provider (source.ini in its cache dir), so
+// setup and update can skip datasets that have not changed upstream.
+struct ProviderSource {
+  std::string url;
+  std::string etag;
+  std::string last_modified;
+  int64_t length = -1;
+  std::string content_hash;   // of the downloaded archive
+};
+
+// False if the provider has no (readable) source record.
+bool read_provider_source(const Provider& p, ProviderSource& out);
+void write_provider_source(const Provider& p, const ProviderSource& s);
+
+// GDAL's shapefile spatial index (.qix) that belongs next to `shp`.
+std::filesystem::path shapefile_spatial_index_path(const std::filesystem::path& shp);
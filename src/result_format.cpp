@@ -0,0 +1,213 @@
+#include "result_format.h"
+#include "geo_metrics.h"
+#include "util.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+std::string json_escape(const std::string& s) {
+  std::string out;
+  out.reserve(s.size() + 8);
+  for (unsigned char c : s) {
+    switch (c) {
+      case '\"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char buf[7];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+          out += buf;
+        } else {
+          out.push_back((char)c);
+        }
+    }
+  }
+  return out;
+}
+
+std::string format_result_text(double distance, const std::string& units,
+                               const DistanceQueryResult& r) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+  os << std::setprecision(3) << distance << " " << to_lower(units) << " "
+     << std::setprecision(8) << r.land_lat_deg << " "
+     << std::setprecision(8) << r.land_lon_deg
+     << "\n";
+  return os.str();
+}
+
+std::string format_result_json(double lat_deg, double lon_deg,
+                               double distance, const std::string& units,
+                               const std::string& metric, double distance_m,
+                               const DistanceQueryResult& r,
+                               const std::string& extra_json) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+
+  os << "{" << extra_json;
+  os << "\"query\":{"
+     << "\"lat_deg\":" << std::setprecision(8) << lat_deg << ","
+     << "\"lon_deg\":" << std::setprecision(8) << lon_deg << "},";
+
+  os << "\"result\":{";
+  os << "\"distance\":"     << std::setprecision(3) << distance << ",";
+  os << "\"units\":\""      << json_escape(to_lower(units)) << "\",";
+  os << "\"metric\":\""     << json_escape(metric) << "\",";
+  os << "\"provider\":\""   << json_escape(r.provider_id) << "\",";
+  os << "\"land_lat_deg\":" << std::setprecision(8) << r.land_lat_deg << ",";
+  os << "\"land_lon_deg\":" << std::setprecision(8) << r.land_lon_deg << ",";
+  os << "\"distance_m\":"   << std::setprecision(3) << distance_m << ",";
+  os << "\"geodesic_m\":"   << std::setprecision(3) << r.geodesic_m << ",";
+  os << "\"in_land\":"      << (r.in_land ? "true" : "false") << ",";
+  os << "\"shp\":\""        << json_escape(r.shp_path.string()) << "\"";
+  os << "}";
+  os << "}\n";
+  return os.str();
+}
+
+std::string format_nearby_text(const std::vector<CoastPoint>& points, const std::string& units) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+  for (const auto& p : points) {
+    os << std::setprecision(3) << convert_units(p.geodesic_m, units) << " " << to_lower(units) << " "
+       << std::setprecision(8) << p.lat_deg << " " << p.lon_deg << "\n";
+  }
+  return os.str();
+}
+
+std::string format_nearby_json(double lat_deg, double lon_deg, const std::string& units,
+                               const std::string& provider_id,
+                               const std::vector<CoastPoint>& points,
+                               const std::string& extra_json) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+
+  os << "{" << extra_json;
+  os << "\"query\":{"
+     << "\"lat_deg\":" << std::setprecision(8) << lat_deg << ","
+     << "\"lon_deg\":" << std::setprecision(8) << lon_deg << "},";
+  os << "\"provider\":\"" << json_escape(provider_id) << "\",";
+  os << "\"units\":\"" << json_escape(to_lower(units)) << "\",";
+  os << "\"nearby\":[";
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    const auto& p = points[i];
+    os << (i ? "," : "") << "{"
+       << "\"distance\":"   << std::setprecision(3) << convert_units(p.geodesic_m, units) << ","
+       << "\"lat_deg\":"    << std::setprecision(8) << p.lat_deg << ","
+       << "\"lon_deg\":"    << std::setprecision(8) << p.lon_deg << ","
+       << "\"geodesic_m\":" << std::setprecision(3) << p.geodesic_m << ","
+       << "\"polygon\":"    << p.polygon << "}";
+  }
+  os << "]}\n";
+  return os.str();
+}
+
+std::string format_ray_text(const RayHit& hit, const std::string& units) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+  if (!hit.hit) {
+    os << "none " << to_lower(units) << "\n";
+    return os.str();
+  }
+  os << std::setprecision(3) << convert_units(hit.geodesic_m, units) << " " << to_lower(units) << " "
+     << std::setprecision(8) << hit.lat_deg << " " << hit.lon_deg << "\n";
+  return os.str();
+}
+
+std::string format_ray_json(double lat_deg, double lon_deg, double bearing_deg,
+                            const std::string& units, const std::string& provider_id,
+                            const RayHit& hit, const std::string& extra_json) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+
+  os << "{" << extra_json;
+  os << "\"query\":{"
+     << "\"lat_deg\":" << std::setprecision(8) << lat_deg << ","
+     << "\"lon_deg\":" << std::setprecision(8) << lon_deg << ","
+     << "\"bearing_deg\":" << std::setprecision(8) << bearing_deg << "},";
+  os << "\"result\":{";
+  os << "\"hit\":"        << (hit.hit ? "true" : "false") << ",";
+  os << "\"units\":\""     << json_escape(to_lower(units)) << "\",";
+  os << "\"provider\":\""  << json_escape(provider_id) << "\"";
+  if (hit.hit) {
+    os << ",\"distance\":"   << std::setprecision(3) << convert_units(hit.geodesic_m, units);
+    os << ",\"land_lat_deg\":" << std::setprecision(8) << hit.lat_deg;
+    os << ",\"land_lon_deg\":" << std::setprecision(8) << hit.lon_deg;
+    os << ",\"geodesic_m\":" << std::setprecision(3) << hit.geodesic_m;
+    os << ",\"in_land\":"    << (hit.in_land ? "true" : "false");
+  }
+  os << "}}\n";
+  return os.str();
+}
+
+std::string format_route_text(const RouteClearance& c, const std::string& units) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+  os << std::setprecision(3) << convert_units(c.geodesic_m, units) << " " << to_lower(units) << " "
+     << std::setprecision(8) << c.land_lat_deg << " " << c.land_lon_deg << " "
+     << c.lat_deg << " " << c.lon_deg << " " << c.leg << "\n";
+  return os.str();
+}
+
+static void route_clearance_json(std::ostream& os, const RouteClearance& c, const std::string& units) {
+  os << "{"
+     << "\"distance\":"     << std::setprecision(3) << convert_units(c.geodesic_m, units) << ","
+     << "\"leg\":"          << c.leg << ","
+     << "\"lat_deg\":"      << std::setprecision(8) << c.lat_deg << ","
+     << "\"lon_deg\":"      << std::setprecision(8) << c.lon_deg << ","
+     << "\"land_lat_deg\":" << std::setprecision(8) << c.land_lat_deg << ","
+     << "\"land_lon_deg\":" << std::setprecision(8) << c.land_lon_deg << ","
+     << "\"geodesic_m\":"   << std::setprecision(3) << c.geodesic_m << ","
+     << "\"in_land\":"      << (c.in_land ? "true" : "false") << "}";
+}
+
+std::string format_route_json(const std::string& units, const std::string& provider_id,
+                              std::size_t waypoints, const RouteClearance& min,
+                              const std::vector<RouteClearance>* legs,
+                              const std::string& extra_json) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+
+  os << "{" << extra_json;
+  os << "\"provider\":\"" << json_escape(provider_id) << "\",";
+  os << "\"units\":\"" << json_escape(to_lower(units)) << "\",";
+  os << "\"waypoints\":" << waypoints << ",";
+  os << "\"min\":";
+  route_clearance_json(os, min, units);
+  if (legs) {
+    os << ",\"legs\":[";
+    for (std::size_t i = 0; i < legs->size(); ++i) {
+      if (i) os << ",";
+      route_clearance_json(os, (*legs)[i], units);
+    }
+    os << "]";
+  }
+  os << "}\n";
+  return os.str();
+}
+
+std::string format_profile_json(double open_ms, const QueryProfile& profile,
+                                const QueryStats& stats, uint64_t allocs) {
+  const double query_ms = profile.setup_ms + profile.search_ms + profile.finish_ms;
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+  os << std::setprecision(3);
+  os << "\"profile\":{"
+     << "\"open_ms\":"    << open_ms << ","
+     << "\"setup_ms\":"   << profile.setup_ms << ","
+     << "\"search_ms\":"  << profile.search_ms << ","
+     << "\"finish_ms\":"  << profile.finish_ms << ","
+     << "\"query_ms\":"   << query_ms << ","
+     << "\"passes\":"     << stats.passes << ","
+     << "\"windows\":"    << stats.windows << ","
+     << "\"features\":"   << stats.features << ","
+     << "\"vertices\":"   << stats.vertices << ","
+     << "\"allocs\":"     << allocs << "},";
+  return os.str();
+}
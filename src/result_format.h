@@ -0,0 +1,50 @@
+#pragma once
+#include "distance_iface.h"
+#include <string>
+#include <vector>
+
+std::string json_escape(const std::string& s);
+
+// One query result as printed by `distance` (and streamed by `batch`).
+//   text: <distance> <units> <land_lat_deg> <land_lon_deg>
+//   json: {"query":{...},"result":{...}}
+// `extra_json` is spliced in front of "query" verbatim (e.g. "\"id\":42,").
+std::string format_result_text(double distance, const std::string& units,
+                               const DistanceQueryResult& r);
+std::string format_result_json(double lat_deg, double lon_deg,
+                               double distance, const std::string& units,
+                               const std::string& metric, double distance_m,
+                               const DistanceQueryResult& r,
+                               const std::string& extra_json = "");
+
+// Coastline points of DistanceEngine::nearby as printed by `distance
+// --nearest/--within`, distances converted to `units`.
+//   text: one "<distance> <units> <lat_deg> <lon_deg>" line per point
+//   json: {"query":{...},"provider":..,"nearby":[{...},...]}
+std::string format_nearby_text(const std::vector<CoastPoint>& points, const std::string& units);
+std::string format_nearby_json(double lat_deg, double lon_deg, const std::string& units,
+                               const std::string& provider_id,
+                               const std::vector<CoastPoint>& points,
+                               const std::string& extra_json = "");
+
+// DistanceEngine::ray's answer as printed by `distance --bearing`.
+//   text: "<distance> <units> <lat_deg> <lon_deg>", or "none <units>" without a hit
+//   json: {"query":{...,"bearing_deg":..},"result":{"hit":..,...}}
+std::string format_ray_text(const RayHit& hit, const std::string& units);
+std::string format_ray_json(double lat_deg, double lon_deg, double bearing_deg,
+                            const std::string& units, const std::string& provider_id,
+                            const RayHit& hit, const std::string& extra_json = "");
+
+// Route clearances of DistanceEngine::route as printed by `dist2land route`.
+//   text: "<distance> <units> <land_lat_deg> <land_lon_deg> <lat_deg> <lon_deg> <leg>"
+//   json: {"provider":..,"units":..,"waypoints":N,"min":{...}[,"legs":[{...},...]]}
+std::string format_route_text(const RouteClearance& c, const std::string& units);
+std::string format_route_json(const std::string& units, const std::string& provider_id,
+                              std::size_t waypoints, const RouteClearance& min,
+                              const std::vector<RouteClearance>* legs,
+                              const std::string& extra_json = "");
+
+// "profile":{...}, for --profile: phase timings (ms) and work counters of one
+// query, plus the engine open time and the query's allocations.
+std::string format_profile_json(double open_ms, const QueryProfile& profile,
+                                const QueryStats& stats, uint64_t allocs);
@@ -0,0 +1,159 @@
+#include "route.h"
+#include "json_scan.h"
+#include "util.h"
+
+#include <cctype>
+#include <istream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// ------------------------- GPX -------------------------
+
+// Value of attribute `name` in the start tag text `tag`, or "" if absent.
+std::string attribute(const std::string& tag, const char* name) {
+  const std::string key = name;
+  std::size_t at = 0;
+  while ((at = tag.find(key, at)) != std::string::npos) {
+    const bool starts = at > 0 && std::isspace((unsigned char)tag[at - 1]);
+    std::size_t i = at + key.size();
+    at = i;
+    if (!starts) continue;
+    while (i < tag.size() && std::isspace((unsigned char)tag[i])) ++i;
+    if (i >= tag.size() || tag[i] != '=') continue;
+    ++i;
+    while (i < tag.size() && std::isspace((unsigned char)tag[i])) ++i;
+    if (i >= tag.size() || (tag[i] != '"' && tag[i] != '\'')) continue;
+    const std::size_t end = tag.find(tag[i], i + 1);
+    if (end == std::string::npos) return "";
+    return tag.substr(i + 1, end - i - 1);
+  }
+  return "";
+}
+
+// Appends the lat/lon of every <element ...> start tag; returns how many.
+std::size_t read_gpx_points(const std::string& text, const char* element,
+                            std::vector<double>& lat, std::vector<double>& lon) {
+  const std::string open = std::string("<") + element;
+  std::size_t count = 0;
+  std::size_t at = 0;
+  while ((at = text.find(open, at)) != std::string::npos) {
+    const std::size_t name_end = at + open.size();
+    at = name_end;
+    if (name_end < text.size() && !std::isspace((unsigned char)text[name_end]) &&
+        text[name_end] != '>' && text[name_end] != '/') {
+      continue;   // a longer element name
+    }
+    const std::size_t close = text.find('>', name_end);
+    if (close == std::string::npos) throw std::runtime_error("GPX: unterminated <" + std::string(element) + ">");
+    const std::string tag = text.substr(name_end, close - name_end);
+    double la, lo;
+    if (!parse_number(attribute(tag, "lat"), la) || !parse_number(attribute(tag, "lon"), lo)) {
+      throw std::runtime_error("GPX: <" + std::string(element) + "> without numeric lat/lon");
+    }
+    lat.push_back(la);
+    lon.push_back(lo);
+    ++count;
+    at = close;
+  }
+  return count;
+}
+
+void read_gpx(const std::string& text, std::vector<double>& lat, std::vector<double>& lon) {
+  for (const char* element : {"rtept", "trkpt", "wpt"}) {
+    if (read_gpx_points(text, element, lat, lon) > 0) return;
+  }
+}
+
+// ------------------------- GeoJSON -------------------------
+
+void read_positions(const std::string& coordinates, std::vector<double>& lat, std::vector<double>& lon) {
+  JsonObjectScanner sc(coordinates);
+  const bool ok = sc.for_each_element([&](const std::string& position) {
+    JsonObjectScanner ps(position);
+    double v[2];
+    int k = 0;
+    bool good = true;
+    const bool parsed = ps.for_each_element([&](const std::string& raw) {
+      if (k < 2) good = JsonObjectScanner(raw).number_value(v[k]) && good;
+      ++k;   // a third value (altitude) is ignored
+    });
+    if (!parsed || !good || k < 2) throw std::runtime_error("GeoJSON: a position is not [lon, lat]");
+    lon.push_back(v[0]);
+    lat.push_back(v[1]);
+  });
+  if (!ok) throw std::runtime_error("GeoJSON: malformed coordinates");
+}
+
+// Reads the LineString in `object` (a geometry, Feature or
+// FeatureCollection); returns false if it has none.
+bool read_geojson_object(const std::string& object, std::vector<double>& lat, std::vector<double>& lon) {
+  std::string type, geometry, features, coordinates;
+  JsonObjectScanner sc(object);
+  const bool ok = sc.for_each_member([&](const std::string& key, const std::string& raw) {
+    if (key == "type") type = json_unquote(raw);
+    else if (key == "geometry") geometry = raw;
+    else if (key == "features") features = raw;
+    else if (key == "coordinates") coordinates = raw;
+  });
+  if (!ok) throw std::runtime_error("GeoJSON: malformed object");
+
+  if (type == "LineString") {
+    read_positions(coordinates, lat, lon);
+    return true;
+  }
+  if (type == "Feature") return geometry != "null" && !geometry.empty() && read_geojson_object(geometry, lat, lon);
+  if (type == "FeatureCollection") {
+    bool found = false;
+    JsonObjectScanner fs(features);
+    const bool fok = fs.for_each_element([&](const std::string& feature) {
+      if (!found) found = read_geojson_object(feature, lat, lon);
+    });
+    if (!fok) throw std::runtime_error("GeoJSON: malformed features array");
+    return found;
+  }
+  if (type == "MultiLineString") {
+    throw std::runtime_error("GeoJSON: MultiLineString is not supported (give one LineString per route)");
+  }
+  return false;
+}
+
+} // namespace
+
+void read_route(std::istream& in, const std::string& format,
+                std::vector<double>& lat_deg, std::vector<double>& lon_deg) {
+  lat_deg.clear();
+  lon_deg.clear();
+  const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  std::string fmt = to_lower(format);
+  if (fmt == "json") fmt = "geojson";
+  if (fmt.empty()) {
+    std::size_t i = 0;
+    while (i < text.size() && std::isspace((unsigned char)text[i])) ++i;
+    if (text.compare(i, 3, "\xEF\xBB\xBF") == 0) i += 3;   // UTF-8 BOM
+    fmt = i < text.size() && text[i] == '{' ? "geojson" : "gpx";
+  }
+
+  if (fmt == "gpx") {
+    read_gpx(text, lat_deg, lon_deg);
+  } else if (fmt == "geojson") {
+    std::size_t b = 0;
+    if (text.compare(0, 3, "\xEF\xBB\xBF") == 0) b = 3;
+    const std::string body = text.substr(b);
+    if (!read_geojson_object(body, lat_deg, lon_deg)) {
+      throw std::runtime_error("GeoJSON: no LineString geometry found");
+    }
+  } else {
+    throw std::runtime_error("Unknown --format: " + format + " (use gpx|geojson)");
+  }
+
+  if (lat_deg.size() < 2) throw std::runtime_error("route needs at least two waypoints");
+  for (std::size_t i = 0; i < lat_deg.size(); ++i) {
+    if (!(lat_deg[i] >= -90.0 && lat_deg[i] <= 90.0) || !(lon_deg[i] >= -180.0 && lon_deg[i] <= 180.0)) {
+      throw std::runtime_error("waypoint " + std::to_string(i + 1) +
+                               ": lat must be in [-90, 90] and lon in [-180, 180] degrees");
+    }
+  }
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Reads the waypoints of a planned route for `dist2land route`, in order:
+//   gpx:     the <rtept> points of the file's routes, or if it has none the
+//            <trkpt> points of its tracks (all segments, joined), or else its
+//            <wpt> points
+//   geojson: a LineString geometry, Feature or the first LineString feature
+//            of a FeatureCollection ([lon, lat] positions of bare numbers)
+// `format` is "gpx", "geojson" or "" (detect from the first character).
+// Throws std::runtime_error on malformed input, coordinates out of range or
+// fewer than two waypoints.
+void read_route(std::istream& in, const std::string& format,
+                std::vector<double>& lat_deg, std::vector<double>& lon_deg);
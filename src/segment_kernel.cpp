@@ -0,0 +1,185 @@
+#include "segment_kernel.h"
+
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define D2L_SEGMENT_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+double closest_on_segment(double px, double py, double ax, double ay, double bx, double by,
+                          double& cx, double& cy) {
+  const double dx = bx - ax, dy = by - ay;
+  const double len2 = dx * dx + dy * dy;
+  double t = len2 > 0.0 ? ((px - ax) * dx + (py - ay) * dy) / len2 : 0.0;
+  t = std::clamp(t, 0.0, 1.0);
+  cx = ax + t * dx;
+  cy = ay + t * dy;
+  return t;
+}
+
+static void scan_scalar(double px, double py, const double* x, const double* y,
+                        std::size_t from, std::size_t nseg, const uint8_t* skip,
+                        SegmentNearest& best) {
+  for (std::size_t i = from; i < nseg; ++i) {
+    if (skip && skip[i]) continue;
+    double cx, cy;
+    closest_on_segment(px, py, x[i], y[i], x[i + 1], y[i + 1], cx, cy);
+    const double d2 = (cx - px) * (cx - px) + (cy - py) * (cy - py);
+    if (d2 < best.dist2) {
+      best.dist2 = d2;
+      best.index = i;
+    }
+  }
+}
+
+static SegmentNearest nearest_scalar(double px, double py, const double* x, const double* y,
+                                     std::size_t nseg, const uint8_t* skip) {
+  SegmentNearest best;
+  scan_scalar(px, py, x, y, 0, nseg, skip, best);
+  return best;
+}
+
+#ifdef D2L_SEGMENT_KERNEL_X86
+
+// Lane results -> overall minimum, lowest index among equal distances.
+static void reduce_lanes(const double* d2, const double* idx, int lanes, SegmentNearest& best) {
+  for (int l = 0; l < lanes; ++l) {
+    if (idx[l] < 0.0) continue;
+    const std::size_t i = (std::size_t)idx[l];
+    if (d2[l] < best.dist2 || (d2[l] == best.dist2 && i < best.index)) {
+      best.dist2 = d2[l];
+      best.index = i;
+    }
+  }
+}
+
+// Both kernels evaluate the clamped projection for several segments at once;
+// a zero-length segment gives t = NaN, which max(t, 0) turns into 0.
+
+__attribute__((target("sse2")))
+static SegmentNearest nearest_sse2(double px, double py, const double* x, const double* y,
+                                   std::size_t nseg, const uint8_t* skip) {
+  const __m128d PX = _mm_set1_pd(px), PY = _mm_set1_pd(py);
+  const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0);
+  __m128d best = _mm_set1_pd(std::numeric_limits<double>::infinity());
+  __m128d best_idx = _mm_set1_pd(-1.0);
+  __m128d idx = _mm_set_pd(1.0, 0.0);
+  const __m128d step = _mm_set1_pd(2.0);
+
+  std::size_t i = 0;
+  for (; i + 2 <= nseg; i += 2) {
+    const __m128d ax = _mm_sub_pd(_mm_loadu_pd(x + i), PX);
+    const __m128d ay = _mm_sub_pd(_mm_loadu_pd(y + i), PY);
+    const __m128d dx = _mm_sub_pd(_mm_sub_pd(_mm_loadu_pd(x + i + 1), PX), ax);
+    const __m128d dy = _mm_sub_pd(_mm_sub_pd(_mm_loadu_pd(y + i + 1), PY), ay);
+    const __m128d len2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    const __m128d dot = _mm_add_pd(_mm_mul_pd(ax, dx), _mm_mul_pd(ay, dy));
+    __m128d t = _mm_div_pd(_mm_sub_pd(zero, dot), len2);
+    t = _mm_min_pd(_mm_max_pd(t, zero), one);
+    const __m128d qx = _mm_add_pd(ax, _mm_mul_pd(t, dx));
+    const __m128d qy = _mm_add_pd(ay, _mm_mul_pd(t, dy));
+    __m128d d2 = _mm_add_pd(_mm_mul_pd(qx, qx), _mm_mul_pd(qy, qy));
+
+    if (skip) {
+      const __m128d s = _mm_cmpneq_pd(_mm_set_pd(skip[i + 1], skip[i]), zero);
+      d2 = _mm_or_pd(_mm_andnot_pd(s, d2), _mm_and_pd(s, _mm_set1_pd(std::numeric_limits<double>::infinity())));
+    }
+
+    const __m128d lt = _mm_cmplt_pd(d2, best);
+    best = _mm_or_pd(_mm_andnot_pd(lt, best), _mm_and_pd(lt, d2));
+    best_idx = _mm_or_pd(_mm_andnot_pd(lt, best_idx), _mm_and_pd(lt, idx));
+    idx = _mm_add_pd(idx, step);
+  }
+
+  alignas(16) double d2v[2], iv[2];
+  _mm_store_pd(d2v, best);
+  _mm_store_pd(iv, best_idx);
+  SegmentNearest out;
+  reduce_lanes(d2v, iv, 2, out);
+  scan_scalar(px, py, x, y, i, nseg, skip, out);
+  return out;
+}
+
+__attribute__((target("avx2")))
+static SegmentNearest nearest_avx2(double px, double py, const double* x, const double* y,
+                                   std::size_t nseg, const uint8_t* skip) {
+  const __m256d PX = _mm256_set1_pd(px), PY = _mm256_set1_pd(py);
+  const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+  const __m256d inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+  __m256d best = inf;
+  __m256d best_idx = _mm256_set1_pd(-1.0);
+  __m256d idx = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+  const __m256d step = _mm256_set1_pd(4.0);
+
+  std::size_t i = 0;
+  for (; i + 4 <= nseg; i += 4) {
+    const __m256d ax = _mm256_sub_pd(_mm256_loadu_pd(x + i), PX);
+    const __m256d ay = _mm256_sub_pd(_mm256_loadu_pd(y + i), PY);
+    const __m256d dx = _mm256_sub_pd(_mm256_sub_pd(_mm256_loadu_pd(x + i + 1), PX), ax);
+    const __m256d dy = _mm256_sub_pd(_mm256_sub_pd(_mm256_loadu_pd(y + i + 1), PY), ay);
+    const __m256d len2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    const __m256d dot = _mm256_add_pd(_mm256_mul_pd(ax, dx), _mm256_mul_pd(ay, dy));
+    __m256d t = _mm256_div_pd(_mm256_sub_pd(zero, dot), len2);
+    t = _mm256_min_pd(_mm256_max_pd(t, zero), one);
+    const __m256d qx = _mm256_add_pd(ax, _mm256_mul_pd(t, dx));
+    const __m256d qy = _mm256_add_pd(ay, _mm256_mul_pd(t, dy));
+    __m256d d2 = _mm256_add_pd(_mm256_mul_pd(qx, qx), _mm256_mul_pd(qy, qy));
+
+    if (skip) {
+      int32_t s4;
+      __builtin_memcpy(&s4, skip + i, 4);
+      const __m256i s = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(s4));
+      const __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi64(s, _mm256_setzero_si256()));
+      d2 = _mm256_blendv_pd(d2, inf, mask);
+    }
+
+    const __m256d lt = _mm256_cmp_pd(d2, best, _CMP_LT_OQ);
+    best = _mm256_blendv_pd(best, d2, lt);
+    best_idx = _mm256_blendv_pd(best_idx, idx, lt);
+    idx = _mm256_add_pd(idx, step);
+  }
+
+  alignas(32) double d2v[4], iv[4];
+  _mm256_store_pd(d2v, best);
+  _mm256_store_pd(iv, best_idx);
+  // Clear the upper YMM halves before running (non-VEX) SSE code again; the
+  // target attribute does not make the compiler do this for us.
+  _mm256_zeroupper();
+  SegmentNearest out;
+  reduce_lanes(d2v, iv, 4, out);
+  scan_scalar(px, py, x, y, i, nseg, skip, out);
+  return out;
+}
+
+#endif
+
+using NearestFn = SegmentNearest (*)(double, double, const double*, const double*, std::size_t, const uint8_t*);
+
+struct KernelChoice {
+  NearestFn fn;
+  const char* name;
+};
+
+static KernelChoice choose_kernel() {
+#ifdef D2L_SEGMENT_KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return {nearest_avx2, "avx2"};
+  if (__builtin_cpu_supports("sse2")) return {nearest_sse2, "sse2"};
+#endif
+  return {nearest_scalar, "scalar"};
+}
+
+static const KernelChoice& kernel() {
+  static const KernelChoice k = choose_kernel();
+  return k;
+}
+
+SegmentNearest nearest_segment(double px, double py, const double* x, const double* y,
+                               std::size_t nseg, const uint8_t* skip) {
+  return kernel().fn(px, py, x, y, nseg, skip);
+}
+
+const char* segment_kernel_name() {
+  return kernel().name;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+struct SegmentNearest {
+  double dist2 = std::numeric_limits<double>::infinity();   // squared distance
+  std::size_t index = static_cast<std::size_t>(-1);           // -1 if every segment was skipped
+};
+
+// Nearest of the nseg segments (x[i], y[i]) -> (x[i+1], y[i+1]) to the point
+// (px, py) in the plane; x and y hold nseg + 1 points. Segments with
+// skip[i] != 0 are ignored (skip may be null). Ties go to the lowest index.
+//
+// Runs an AVX2 or SSE2 kernel when the CPU has it (chosen once at runtime)
+// and a scalar loop otherwise.
+SegmentNearest nearest_segment(double px, double py, const double* x, const double* y,
+                               std::size_t nseg, const uint8_t* skip);
+
+// Closest point on segment a-b to p; returns the segment parameter t in [0, 1].
+double closest_on_segment(double px, double py, double ax, double ay, double bx, double by,
+                          double& cx, double& cy);
+
+// "avx2", "sse2" or "scalar".
+const char* segment_kernel_name();
@@ -0,0 +1,464 @@
+#include "serve.h"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+
+#include "distance_iface.h"
+#include "geo_metrics.h"
+#include "json_scan.h"
+#include "result_format.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+static constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+static constexpr int kSendFlags = 0;   // SIGPIPE is ignored while serving
+#endif
+
+static constexpr std::size_t kMaxRequestLine = 64 * 1024;
+
+static std::string errno_message(const std::string& what) {
+  return what + ": " + std::strerror(errno);
+}
+
+static bool fill_address(const std::filesystem::path& path, sockaddr_un& addr) {
+  const std::string s = path.string();
+  if (s.empty() || s.size() >= sizeof(addr.sun_path)) return false;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, s.c_str(), s.size() + 1);
+  return true;
+}
+
+// Connected socket, or -1 with errno set.
+static int connect_unix(const std::filesystem::path& path) {
+  sockaddr_un addr;
+  if (!fill_address(path, addr)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+    const int e = errno;
+    ::close(fd);
+    errno = e;
+    return -1;
+  }
+  return fd;
+}
+
+static bool send_all(int fd, const std::string& s) {
+  std::size_t off = 0;
+  while (off < s.size()) {
+    const ssize_t n = ::send(fd, s.data() + off, s.size() - off, kSendFlags);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    off += (std::size_t)n;
+  }
+  return true;
+}
+
+// Write end of the self-pipe that wakes the accept loop on SIGINT/SIGTERM.
+static volatile std::sig_atomic_t g_wake_fd = -1;
+
+static void on_stop_signal(int) {
+  if (g_wake_fd >= 0) {
+    const char c = 's';
+    (void)!::write(g_wake_fd, &c, 1);
+  }
+}
+
+namespace {
+
+// Latencies of the most recent requests, for p50/p99.
+class LatencyStats {
+public:
+  struct Snapshot {
+    std::uint64_t requests = 0;
+    std::uint64_t errors = 0;
+    double p50_ms = 0.0;
+    double p99_ms = 0.0;
+  };
+
+  void add(double ms, bool error) {
+    std::lock_guard<std::mutex> lk(m_);
+    ++requests_;
+    if (error) ++errors_;
+    if (samples_.size() < kWindow) samples_.push_back(ms);
+    else samples_[next_] = ms;
+    next_ = (next_ + 1) % kWindow;
+  }
+
+  Snapshot snapshot() const {
+    Snapshot s;
+    std::vector<double> v;
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      s.requests = requests_;
+      s.errors = errors_;
+      v = samples_;
+    }
+    s.p50_ms = percentile(v, 0.50);
+    s.p99_ms = percentile(v, 0.99);
+    return s;
+  }
+
+private:
+  static constexpr std::size_t kWindow = 1 << 16;
+
+  mutable std::mutex m_;
+  std::vector<double> samples_;
+  std::size_t next_ = 0;
+  std::uint64_t requests_ = 0, errors_ = 0;
+
+  static double percentile(std::vector<double>& v, double q) {
+    if (v.empty()) return 0.0;
+    const std::size_t k = std::min(v.size() - 1, (std::size_t)(q * (double)v.size()));
+    std::nth_element(v.begin(), v.begin() + (std::ptrdiff_t)k, v.end());
+    return v[k];
+  }
+};
+
+// Engines opened up front and lent to one request at a time.
+class EnginePool {
+public:
+  EnginePool(const std::string& provider_id, const std::filesystem::path& shp_path, unsigned n) {
+    for (unsigned i = 0; i < std::max(1u, n); ++i) {
+      engines_.push_back(std::make_unique<DistanceEngine>(provider_id, shp_path));
+      free_.push_back(engines_.back().get());
+    }
+  }
+
+  class Lease {
+  public:
+    explicit Lease(EnginePool& pool) : pool_(pool), engine_(pool.acquire()) {}
+    ~Lease() { pool_.release(engine_); }
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    DistanceEngine* operator->() const { return engine_; }
+
+  private:
+    EnginePool& pool_;
+    DistanceEngine* engine_;
+  };
+
+private:
+  std::vector<std::unique_ptr<DistanceEngine>> engines_;
+  std::vector<DistanceEngine*> free_;
+  std::mutex m_;
+  std::condition_variable cv_;
+
+  DistanceEngine* acquire() {
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&] { return !free_.empty(); });
+    DistanceEngine* e = free_.back();
+    free_.pop_back();
+    return e;
+  }
+
+  void release(DistanceEngine* e) {
+    {
+      std::lock_guard<std::mutex> lk(m_);
+      free_.push_back(e);
+    }
+    cv_.notify_one();
+  }
+};
+
+struct ServeRequest {
+  double lat = std::numeric_limits<double>::quiet_NaN();
+  double lon = std::numeric_limits<double>::quiet_NaN();
+  bool have_lat = false, have_lon = false;
+  std::string id_json;
+  std::string units, metric, format, cmd, provider;
+};
+
+class Server {
+public:
+  Server(const std::string& provider_id, const std::filesystem::path& shp_path, const ServeOptions& opt)
+      : provider_id_(provider_id), opt_(opt), pool_(provider_id, shp_path, opt.threads) {}
+
+  void run();
+
+private:
+  std::string provider_id_;
+  ServeOptions opt_;
+  EnginePool pool_;
+  LatencyStats stats_;
+
+  std::mutex clients_m_;
+  std::condition_variable clients_cv_;
+  std::set<int> clients_;   // open client sockets, each served by a detached thread
+
+  std::string respond(const std::string& line);
+  std::string stats_json() const;
+  void log_stats(const char* when) const;
+  void serve_client(int fd);
+};
+
+std::string Server::stats_json() const {
+  const auto s = stats_.snapshot();
+  char buf[192];
+  std::snprintf(buf, sizeof(buf),
+                "{\"requests\":%llu,\"errors\":%llu,\"p50_ms\":%.3f,\"p99_ms\":%.3f}\n",
+                (unsigned long long)s.requests, (unsigned long long)s.errors, s.p50_ms, s.p99_ms);
+  return buf;
+}
+
+void Server::log_stats(const char* when) const {
+  const auto s = stats_.snapshot();
+  char buf[192];
+  std::snprintf(buf, sizeof(buf), "serve %s: requests=%llu errors=%llu p50_ms=%.3f p99_ms=%.3f\n",
+                when, (unsigned long long)s.requests, (unsigned long long)s.errors, s.p50_ms, s.p99_ms);
+  std::cerr << buf << std::flush;
+}
+
+static std::string error_line(const std::string& id_json, const std::string& msg) {
+  std::string s = "{";
+  if (!id_json.empty()) s += "\"id\":" + id_json + ",";
+  s += "\"error\":\"" + json_escape(msg) + "\"}\n";
+  return s;
+}
+
+std::string Server::respond(const std::string& line) {
+  const auto t0 = std::chrono::steady_clock::now();
+
+  ServeRequest rq;
+  JsonObjectScanner sc(line);
+  const bool parsed = sc.for_each_member([&](const std::string& key, const std::string& raw) {
+    const auto k = to_lower(key);
+    if (k == "lat") rq.have_lat = parse_number(raw, rq.lat);
+    else if (k == "lon") rq.have_lon = parse_number(raw, rq.lon);
+    else if (k == "id") rq.id_json = raw;
+    else if (k == "units") rq.units = json_unquote(raw);
+    else if (k == "metric") rq.metric = to_lower(json_unquote(raw));
+    else if (k == "format") rq.format = to_lower(json_unquote(raw));
+    else if (k == "cmd") rq.cmd = to_lower(json_unquote(raw));
+    else if (k == "provider") rq.provider = to_lower(json_unquote(raw));
+  });
+
+  if (parsed && rq.cmd == "stats") return stats_json();
+  if (parsed && rq.cmd == "ping") return "{\"ok\":true}\n";
+
+  std::string out;
+  bool error = false;
+  try {
+    if (!parsed) throw std::runtime_error("malformed JSON object");
+    if (!rq.cmd.empty()) throw std::runtime_error("unknown cmd: " + rq.cmd);
+    if (!rq.provider.empty() && rq.provider != "auto" && rq.provider != provider_id_) {
+      throw std::runtime_error("this server answers for provider " + provider_id_);
+    }
+    if (!rq.have_lat || !rq.have_lon) throw std::runtime_error("missing or non-numeric lat/lon");
+    if (!std::isfinite(rq.lat) || rq.lat < -90.0 || rq.lat > 90.0) {
+      throw std::runtime_error("lat must be in [-90, 90] degrees");
+    }
+    if (!std::isfinite(rq.lon) || rq.lon < -180.0 || rq.lon > 180.0) {
+      throw std::runtime_error("lon must be in [-180, 180] degrees");
+    }
+    const std::string units = rq.units.empty() ? opt_.units : rq.units;
+    const std::string metric = rq.metric.empty() ? opt_.metric : rq.metric;
+    convert_units(0.0, units);   // validate before querying
+
+    DistanceQueryResult r;
+    {
+      EnginePool::Lease engine(pool_);
+      r = engine->query(rq.lat, rq.lon);
+    }
+    const double d_m = metric_distance_m(metric, rq.lat, rq.lon, r);
+    const double dist = convert_units(d_m, units);
+    if (rq.format == "text") {
+      out = format_result_text(dist, units, r);
+    } else {
+      const std::string extra = rq.id_json.empty() ? "" : "\"id\":" + rq.id_json + ",";
+      out = format_result_json(rq.lat, rq.lon, dist, units, metric, d_m, r, extra);
+    }
+  } catch (const std::exception& e) {
+    error = true;
+    out = error_line(rq.id_json, e.what());
+  }
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+  stats_.add(ms, error);
+  return out;
+}
+
+void Server::serve_client(int fd) {
+  std::string buf;
+  char chunk[4096];
+  bool open = true;
+  while (open) {
+    const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    buf.append(chunk, (std::size_t)n);
+
+    std::size_t start = 0, nl;
+    while (open && (nl = buf.find('\n', start)) != std::string::npos) {
+      std::string line = buf.substr(start, nl - start);
+      start = nl + 1;
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (line.find_first_not_of(" \t") == std::string::npos) continue;
+      open = send_all(fd, respond(line));
+    }
+    buf.erase(0, start);
+    if (buf.size() > kMaxRequestLine) {
+      send_all(fd, error_line("", "request line too long"));
+      break;
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(clients_m_);
+  clients_.erase(fd);
+  ::close(fd);
+  clients_cv_.notify_all();
+}
+
+void Server::run() {
+  const auto& path = opt_.socket_path;
+  sockaddr_un addr;
+  if (!fill_address(path, addr)) throw std::runtime_error("Socket path too long: " + path.string());
+
+  // A socket file nobody answers on is left over from an earlier run.
+  std::error_code ec;
+  if (std::filesystem::exists(path, ec)) {
+    const int probe = connect_unix(path);
+    if (probe >= 0) {
+      ::close(probe);
+      throw std::runtime_error("A server is already listening on " + path.string());
+    }
+    std::filesystem::remove(path, ec);
+  }
+
+  const int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (lfd < 0) throw std::runtime_error(errno_message("socket"));
+  ::fcntl(lfd, F_SETFD, FD_CLOEXEC);
+  if (::bind(lfd, (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(lfd, 64) != 0) {
+    const std::string msg = errno_message("Cannot listen on " + path.string());
+    ::close(lfd);
+    throw std::runtime_error(msg);
+  }
+
+  int wake[2];
+  if (::pipe(wake) != 0) {
+    ::close(lfd);
+    throw std::runtime_error(errno_message("pipe"));
+  }
+  ::fcntl(wake[1], F_SETFL, O_NONBLOCK);
+  g_wake_fd = wake[1];
+  auto old_int = std::signal(SIGINT, on_stop_signal);
+  auto old_term = std::signal(SIGTERM, on_stop_signal);
+  auto old_pipe = std::signal(SIGPIPE, SIG_IGN);
+
+  std::cerr << "serve: provider=" << provider_id_ << " socket=" << path.string()
+            << " engines=" << std::max(1u, opt_.threads) << "\n";
+
+  auto last_report = std::chrono::steady_clock::now();
+  pollfd fds[2] = {{lfd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+  while (true) {
+    const int rc = ::poll(fds, 2, 1000);
+    if (rc < 0 && errno != EINTR) break;
+    if (rc > 0 && fds[1].revents) break;
+
+    if (opt_.stats_interval_s > 0 &&
+        std::chrono::steady_clock::now() - last_report >= std::chrono::seconds(opt_.stats_interval_s)) {
+      last_report = std::chrono::steady_clock::now();
+      log_stats("stats");
+    }
+
+    if (rc > 0 && (fds[0].revents & POLLIN)) {
+      const int cfd = ::accept(lfd, nullptr, nullptr);
+      if (cfd < 0) continue;
+      ::fcntl(cfd, F_SETFD, FD_CLOEXEC);
+      {
+        std::lock_guard<std::mutex> lk(clients_m_);
+        clients_.insert(cfd);
+      }
+      std::thread([this, cfd] { serve_client(cfd); }).detach();
+    }
+  }
+
+  // Stop accepting, wake every client thread and wait for them to finish.
+  ::close(lfd);
+  std::filesystem::remove(path, ec);
+  {
+    std::unique_lock<std::mutex> lk(clients_m_);
+    for (int fd : clients_) ::shutdown(fd, SHUT_RDWR);
+    clients_cv_.wait(lk, [&] { return clients_.empty(); });
+  }
+
+  std::signal(SIGINT, old_int);
+  std::signal(SIGTERM, old_term);
+  std::signal(SIGPIPE, old_pipe);
+  g_wake_fd = -1;
+  ::close(wake[0]);
+  ::close(wake[1]);
+
+  log_stats("stopped");
+}
+
+} // namespace
+
+void run_server(const std::string& provider_id, const std::filesystem::path& shp_path,
+                const ServeOptions& opt) {
+  Server(provider_id, shp_path, opt).run();
+}
+
+std::string server_request(const std::filesystem::path& socket_path, const std::string& request) {
+  const int fd = connect_unix(socket_path);
+  if (fd < 0) throw std::runtime_error(errno_message("Cannot connect to dist2land server at " + socket_path.string()));
+
+  std::string line;
+  bool ok = send_all(fd, request + "\n");
+  char chunk[4096];
+  while (ok) {
+    const ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    line.append(chunk, (std::size_t)n);
+    const auto nl = line.find('\n');
+    if (nl != std::string::npos) {
+      line.resize(nl);
+      ::close(fd);
+      return line;
+    }
+  }
+  ::close(fd);
+  throw std::runtime_error("dist2land server at " + socket_path.string() + " closed the connection");
+}
+
+#else
+
+void run_server(const std::string&, const std::filesystem::path&, const ServeOptions&) {
+  throw std::runtime_error("serve is not supported on Windows");
+}
+
+std::string server_request(const std::filesystem::path&, const std::string&) {
+  throw std::runtime_error("distance --server is not supported on Windows");
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <filesystem>
+#include <string>
+
+struct ServeOptions {
+  std::filesystem::path socket_path;
+  unsigned threads = 1;            // engines (dataset handles) shared by all clients
+  std::string units = "m";         // defaults for requests that do not name them
+  std::string metric = "geodesic";
+  unsigned stats_interval_s = 60;  // latency line on stderr every N seconds (0 = off)
+};
+
+// Serves distance queries on a Unix stream socket until SIGINT/SIGTERM.
+//
+// Protocol: one JSON object per line in each direction.
+//   request:  {"lat":..,"lon":..[,"id":..][,"units":"nm"][,"metric":"rhumb"][,"format":"text"]}
+//   response: the `distance --json` object (with "id" echoed), or the text
+//             line for "format":"text", or {"id":..,"error":"..."}
+//   {"cmd":"stats"} -> {"requests":N,"errors":N,"p50_ms":..,"p99_ms":..}
+//   {"cmd":"ping"}  -> {"ok":true}
+// Every client connection gets its own thread; queries borrow an engine from
+// a pool of `threads` engines opened up front.
+void run_server(const std::string& provider_id, const std::filesystem::path& shp_path,
+                const ServeOptions& opt);
+
+// Sends one request line to a server and returns its response line (without
+// the trailing newline).
+std::string server_request(const std::filesystem::path& socket_path, const std::string& request);
@@ -0,0 +1,181 @@
+#include "shapefile.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+static uint32_t le32(const unsigned char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+static uint32_t be32(const unsigned char* p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static double le64f(const unsigned char* p) {
+  double v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+
+static double be64f(const unsigned char* p) {
+  unsigned char b[8];
+  for (int i = 0; i < 8; ++i) b[i] = p[7 - i];
+  return le64f(b);
+}
+
+// <name>.shp -> <name>.<ext>, upper-cased along with an upper-case .SHP.
+static std::filesystem::path sibling(const std::filesystem::path& shp, const char* ext) {
+  std::string e = std::string(".") + ext;
+  if (shp.extension() == ".SHP") {
+    for (auto& c : e) c = (char)std::toupper((unsigned char)c);
+  }
+  auto p = shp;
+  p.replace_extension(e);
+  return p;
+}
+
+static bool boxes_overlap(const double* a, const double* b) {
+  return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
+
+static constexpr uint32_t kShpPolygon  = 5;
+static constexpr uint32_t kShpPolygonZ = 15;
+static constexpr uint32_t kShpPolygonM = 25;
+static constexpr std::size_t kShpHeaderSize = 100;
+static constexpr int kQixMaxDepth = 64;   // GDAL writes at most ~12 levels
+
+ShpRing ShpPolygon::ring(uint32_t k) const {
+  ShpRing r;
+  if (k >= num_parts) return r;
+  const uint32_t first = le32(parts + 4 * (std::size_t)k);
+  const uint32_t end = k + 1 < num_parts ? le32(parts + 4 * (std::size_t)(k + 1)) : num_points;
+  if (first > end || end > num_points) return r;
+  r.points = points + 16 * (std::size_t)first;
+  r.n = end - first;
+  return r;
+}
+
+ShapefileReader::ShapefileReader(const std::filesystem::path& shp_path) {
+  // Records are read as native doubles; big-endian hosts read through GDAL.
+  if constexpr (std::endian::native != std::endian::little) {
+    throw std::runtime_error("Native shapefile reader needs a little-endian host");
+  }
+  shp_.open(shp_path);
+  shx_.open(sibling(shp_path, "shx"));
+
+  const unsigned char* h = shp_.data();
+  if (shp_.size() < kShpHeaderSize || be32(h) != 9994 || le32(h + 28) != 1000) {
+    throw std::runtime_error("Not a shapefile: " + shp_path.string());
+  }
+  const uint32_t type = le32(h + 32);
+  if (type != kShpPolygon && type != kShpPolygonZ && type != kShpPolygonM) {
+    throw std::runtime_error("Not a polygon shapefile: " + shp_path.string());
+  }
+  if (shx_.size() < kShpHeaderSize || be32(shx_.data()) != 9994) {
+    throw std::runtime_error("Bad shapefile index: " + sibling(shp_path, "shx").string());
+  }
+  record_count_ = (shx_.size() - kShpHeaderSize) / 8;
+
+  // The quadtree is only an accelerator: without it every record box is checked.
+  const auto qix_path = sibling(shp_path, "qix");
+  std::error_code ec;
+  if (std::filesystem::exists(qix_path, ec)) {
+    try {
+      qix_.open(qix_path);
+      const unsigned char* q = qix_.data();
+      if (qix_.size() < 16 || std::memcmp(q, "SQT", 3) != 0 || (q[3] != 1 && q[3] != 2)) {
+        qix_.close();
+      } else {
+        qix_swap_ = q[3] != 1;   // 1 = LSB first
+      }
+    } catch (const std::exception&) {
+      qix_.close();
+    }
+  }
+}
+
+bool ShapefileReader::record(std::size_t id, ShpPolygon& out) const {
+  if (id >= record_count_) return false;
+  const unsigned char* e = shx_.data() + kShpHeaderSize + 8 * id;
+  const uint64_t off = 2 * (uint64_t)be32(e) + 8;   // past the record header
+  const uint64_t len = 2 * (uint64_t)be32(e + 4);
+  if (off > shp_.size() || len > shp_.size() - off || len < 44) return false;
+
+  const unsigned char* c = shp_.data() + off;
+  const uint32_t type = le32(c);
+  if (type != kShpPolygon && type != kShpPolygonZ && type != kShpPolygonM) return false;
+
+  for (int i = 0; i < 4; ++i) out.box[i] = le64f(c + 4 + 8 * i);
+  out.num_parts = le32(c + 36);
+  out.num_points = le32(c + 40);
+  if (44 + 4 * (uint64_t)out.num_parts + 16 * (uint64_t)out.num_points > len) return false;
+  out.parts = c + 44;
+  out.points = out.parts + 4 * (std::size_t)out.num_parts;
+  return true;
+}
+
+// Node: uint32 subtree bytes | double box[4] | uint32 n | int32 id[n] |
+// uint32 children | children... (shapelib's SHPWriteTree layout).
+bool ShapefileReader::search_qix(std::size_t& pos, int depth, const double win[4],
+                                 std::vector<uint32_t>& ids) const {
+  const unsigned char* q = qix_.data();
+  const std::size_t size = qix_.size();
+  auto u32 = [&](std::size_t at) { return qix_swap_ ? be32(q + at) : le32(q + at); };
+  auto f64 = [&](std::size_t at) { return qix_swap_ ? be64f(q + at) : le64f(q + at); };
+
+  if (depth > kQixMaxDepth || pos > size || size - pos < 40) return false;
+  const uint32_t subtree = u32(pos);
+  const double box[4] = {f64(pos + 4), f64(pos + 12), f64(pos + 20), f64(pos + 28)};
+  const uint32_t n = u32(pos + 36);
+  pos += 40;
+  if ((uint64_t)n * 4 + 4 > size - pos) return false;
+
+  if (!boxes_overlap(box, win)) {
+    pos += (std::size_t)n * 4 + 4 + subtree;
+    return pos <= size;
+  }
+
+  for (uint32_t i = 0; i < n; ++i) ids.push_back(u32(pos + 4 * (std::size_t)i));
+  pos += (std::size_t)n * 4;
+  const uint32_t children = u32(pos);
+  pos += 4;
+  for (uint32_t i = 0; i < children; ++i) {
+    if (!search_qix(pos, depth + 1, win, ids)) return false;
+  }
+  return true;
+}
+
+void ShapefileReader::search(double min_lon, double min_lat, double max_lon, double max_lat,
+                             std::vector<uint32_t>& ids) const {
+  const double win[4] = {min_lon, min_lat, max_lon, max_lat};
+  ids.clear();
+
+  bool indexed = false;
+  if (qix_.is_open()) {
+    std::size_t pos = 16;
+    indexed = search_qix(pos, 0, win, ids);
+    if (!indexed) ids.clear();   // damaged tree: fall back to the full scan
+  }
+
+  ShpPolygon p;
+  if (!indexed) {
+    for (std::size_t id = 0; id < record_count_; ++id) {
+      if (record(id, p) && boxes_overlap(p.box, win)) ids.push_back((uint32_t)id);
+    }
+    return;
+  }
+
+  // Quadtree nodes list every shape that fits them, not only those that
+  // reach the window.
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  ids.erase(std::remove_if(ids.begin(), ids.end(),
+                           [&](uint32_t id) { return !record(id, p) || !boxes_overlap(p.box, win); }),
+            ids.end());
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "mmap_file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+// Native read-only access to polygon shapefiles: the .shp geometry, its .shx
+// record offsets and, when present, GDAL's .qix quadtree. All three are
+// memory-mapped; records are read in place as views over the mapped bytes,
+// so walking rings allocates nothing and never touches the .dbf.
+//
+// Shapefile coordinates are little-endian doubles at arbitrary 4-byte
+// offsets, so they are read through memcpy rather than dereferenced.
+
+// One ring of a polygon record: n lon/lat points (closed, first == last).
+struct ShpRing {
+  const unsigned char* points = nullptr;   // n x {double x, double y}
+  std::size_t n = 0;
+
+  std::size_t size() const { return n; }
+  double x(std::size_t i) const { return load(points + 16 * i); }
+  double y(std::size_t i) const { return load(points + 16 * i + 8); }
+
+private:
+  static double load(const unsigned char* p) {
+    double v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+  }
+};
+
+// A Polygon / PolygonZ / PolygonM record. Rings are not grouped: outer rings
+// run clockwise, holes counter-clockwise, in any order.
+struct ShpPolygon {
+  double box[4] = {};   // min_lon, min_lat, max_lon, max_lat
+  uint32_t num_parts = 0;
+  uint32_t num_points = 0;
+  const unsigned char* parts = nullptr;    // num_parts x int32 first-point index
+  const unsigned char* points = nullptr;
+
+  ShpRing ring(uint32_t k) const;
+};
+
+class ShapefileReader {
+public:
+  // Maps <name>.shp and <name>.shx, and <name>.qix if it exists and is
+  // readable. Throws std::runtime_error if the files are missing, malformed
+  // or hold anything but polygons, and on big-endian hosts.
+  explicit ShapefileReader(const std::filesystem::path& shp_path);
+
+  std::size_t record_count() const { return record_count_; }
+  bool has_spatial_index() const { return qix_.is_open(); }
+
+  // Reads record `id` (0-based, the OGR FID). False for null shapes and for
+  // records that do not fit in the file.
+  bool record(std::size_t id, ShpPolygon& out) const;
+
+  // Replaces `ids` with the records whose box may intersect the lon/lat
+  // rectangle, in ascending order. Uses the .qix quadtree when present and
+  // otherwise checks every record box.
+  void search(double min_lon, double min_lat, double max_lon, double max_lat,
+              std::vector<uint32_t>& ids) const;
+
+private:
+  MappedFile shp_, shx_, qix_;
+  std::size_t record_count_ = 0;
+  bool qix_swap_ = false;   // .qix written on a big-endian machine
+
+  bool search_qix(std::size_t& pos, int depth, const double win[4], std::vector<uint32_t>& ids) const;
+};
@@ -0,0 +1,28 @@
+#include "track.h"
+#include "geo_metrics.h"
+
+static constexpr double kPi = 3.141592653589793238462643383279502884;
+static double deg2rad(double d) { return d * (kPi / 180.0); }
+
+DistanceQueryResult DistanceTrack::next(double lat_deg, double lon_deg) {
+  hint_.upper_bound_m = std::numeric_limits<double>::infinity();
+  if (have_prev_) {
+    const double moved = central_angle_rad(deg2rad(prev_lat_), deg2rad(prev_lon_),
+                                           deg2rad(lat_deg), deg2rad(lon_deg)) *
+                         kGeodesicUpperBoundRadiusM;
+    // A little slack so rounding never pushes the answer past the bound.
+    hint_.upper_bound_m = (prev_m_ + moved) * (1.0 + 1e-9) + 1e-3;
+  }
+
+  const DistanceQueryResult r = engine_.query_near(lat_deg, lon_deg, hint_);
+  have_prev_ = true;
+  prev_lat_ = lat_deg;
+  prev_lon_ = lon_deg;
+  prev_m_ = r.geodesic_m;
+  return r;
+}
+
+void DistanceTrack::reset() {
+  have_prev_ = false;
+  hint_ = TrackHint{};
+}
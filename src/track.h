@@ -0,0 +1,31 @@
+#pragma once
+#include "distance_iface.h"
+
+// Answers a sequence of fixes from one moving point (a vessel track, a GPS
+// log). Each answer bounds the next: by the triangle inequality the new
+// distance to land is at most the previous one plus the distance moved, so
+// only coastline within that radius is searched, starting from the segment
+// that was nearest last time.
+//
+// Only the coastline index backend is sped up, and only there is the answer
+// the same as DistanceEngine::query's (the same distance; on a tie the land
+// point may differ). The shapefile fallback starts its search from windows
+// sized by the hint, so it may settle on a different nearest segment than
+// query() would; the GDAL plugin cannot take the hint and just
+// runs query().
+class DistanceTrack {
+public:
+  explicit DistanceTrack(DistanceEngine& engine) : engine_(engine) {}
+
+  DistanceQueryResult next(double lat_deg, double lon_deg);
+
+  // Forgets the previous fix (e.g. at a gap in the track).
+  void reset();
+
+private:
+  DistanceEngine& engine_;
+  TrackHint hint_;
+  bool have_prev_ = false;
+  double prev_lat_ = 0.0, prev_lon_ = 0.0;   // degrees
+  double prev_m_ = 0.0;
+};
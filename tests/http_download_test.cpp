@@ -0,0 +1,437 @@
+// http_download_to against a local stand-in server: resuming from a
+// .part.ranges note (one connection and parallel ranges), discarding a .part
+// without one, servers that ignore Range, If-Range mismatches, and the
+// content hash across all of them. POSIX only.
+#include "http_download.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond)                                                        \
+  do {                                                                     \
+    if (!(cond)) {                                                         \
+      std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+      ++g_failures;                                                        \
+    }                                                                      \
+  } while (0)
+
+struct Request {
+  std::string method, range, if_range;
+};
+
+// One file over HTTP/1.1, one request per connection. GETs can be cut off
+// after a number of body bytes (as a dropped connection) and answered 500
+// afterwards (as an outage), so a download is left half done on disk.
+class StandInServer {
+public:
+  struct Config {
+    std::string body;
+    std::string etag = "\"v1\"";
+    std::string head_etag;           // what HEAD reports, if not etag (a stale cache)
+    bool honour_ranges = true;       // false: advertise ranges, answer 200 anyway
+    int truncated_gets = 0;          // this many GETs send only truncate_at bytes...
+    std::size_t truncate_at = 0;
+    bool fail_after_truncation = false;   // ...and GETs after them get a 500
+  };
+
+  StandInServer() {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    ::setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(fd_, (sockaddr*)&a, sizeof a) != 0 || ::listen(fd_, 64) != 0) {
+      std::perror("stand-in server");
+      std::exit(2);
+    }
+    socklen_t len = sizeof a;
+    ::getsockname(fd_, (sockaddr*)&a, &len);
+    port_ = ntohs(a.sin_port);
+    accept_thread_ = std::thread([this] { accept_loop(); });
+  }
+
+  ~StandInServer() {
+    stop_ = true;
+    ::shutdown(fd_, SHUT_RDWR);
+    ::close(fd_);
+    accept_thread_.join();
+    for (auto& t : workers_) t.join();
+  }
+
+  std::string url() const { return "http://127.0.0.1:" + std::to_string(port_) + "/land.zip"; }
+
+  void configure(const Config& c) {
+    std::lock_guard<std::mutex> lock(mu_);
+    cfg_ = c;
+    requests_.clear();
+  }
+
+  std::vector<Request> gets() {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::vector<Request> out;
+    for (const auto& r : requests_) if (r.method == "GET") out.push_back(r);
+    return out;
+  }
+
+private:
+  int fd_ = -1;
+  int port_ = 0;
+  std::atomic<bool> stop_{false};
+  std::thread accept_thread_;
+  std::vector<std::thread> workers_;
+  std::mutex mu_;
+  Config cfg_;
+  std::vector<Request> requests_;
+
+  void accept_loop() {
+    while (!stop_) {
+      const int c = ::accept(fd_, nullptr, nullptr);
+      if (c < 0) continue;
+      workers_.emplace_back([this, c] { serve(c); });
+    }
+  }
+
+  static void send_all(int c, const char* p, std::size_t n) {
+    while (n > 0) {
+      const ssize_t k = ::send(c, p, n, MSG_NOSIGNAL);
+      if (k <= 0) return;
+      p += k;
+      n -= (std::size_t)k;
+    }
+  }
+
+  static std::string header_value(const std::string& head, const char* name) {
+    const std::string key = std::string("\r\n") + name + ":";
+    std::size_t at = head.find(key);
+    if (at == std::string::npos) return "";
+    at += key.size();
+    while (at < head.size() && head[at] == ' ') ++at;
+    return head.substr(at, head.find("\r\n", at) - at);
+  }
+
+  void serve(int c) {
+    std::string head;
+    char buf[4096];
+    while (head.find("\r\n\r\n") == std::string::npos) {
+      const ssize_t k = ::recv(c, buf, sizeof buf, 0);
+      if (k <= 0) { ::close(c); return; }
+      head.append(buf, (std::size_t)k);
+    }
+    Request rq;
+    rq.method = head.substr(0, head.find(' '));
+    rq.range = header_value(head, "Range");
+    rq.if_range = header_value(head, "If-Range");
+
+    Config cfg;
+    bool truncate = false, fail = false;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      requests_.push_back(rq);
+      cfg = cfg_;
+      if (rq.method == "GET") {
+        if (cfg_.truncated_gets > 0) {
+          --cfg_.truncated_gets;
+          truncate = true;
+        } else {
+          fail = cfg_.fail_after_truncation;
+        }
+      }
+    }
+
+    const std::string& body = cfg.body;
+    std::string out;
+    if (rq.method == "HEAD") {
+      out = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) +
+            "\r\nAccept-Ranges: bytes\r\nETag: " + (cfg.head_etag.empty() ? cfg.etag : cfg.head_etag) +
+            "\r\nConnection: close\r\n\r\n";
+      send_all(c, out.data(), out.size());
+      ::close(c);
+      return;
+    }
+    if (fail) {
+      out = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      send_all(c, out.data(), out.size());
+      ::close(c);
+      return;
+    }
+
+    std::size_t begin = 0, end = body.size();   // [begin, end)
+    bool partial = false;
+    if (cfg.honour_ranges && rq.range.rfind("bytes=", 0) == 0 &&
+        (rq.if_range.empty() || rq.if_range == cfg.etag)) {
+      const std::string spec = rq.range.substr(6);
+      const auto dash = spec.find('-');
+      begin = std::strtoull(spec.substr(0, dash).c_str(), nullptr, 10);
+      if (dash + 1 < spec.size()) end = std::strtoull(spec.substr(dash + 1).c_str(), nullptr, 10) + 1;
+      partial = true;
+    }
+    if (partial) {
+      out = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(begin) + "-" +
+            std::to_string(end - 1) + "/" + std::to_string(body.size()) + "\r\n";
+    } else {
+      out = "HTTP/1.1 200 OK\r\n";
+    }
+    out += "Content-Length: " + std::to_string(end - begin) + "\r\nAccept-Ranges: bytes\r\nETag: " +
+           cfg.etag + "\r\nConnection: close\r\n\r\n";
+    send_all(c, out.data(), out.size());
+    const std::size_t n = truncate ? std::min(end - begin, cfg.truncate_at) : end - begin;
+    send_all(c, body.data() + begin, n);
+    ::shutdown(c, SHUT_RDWR);
+    ::close(c);
+  }
+};
+
+std::string make_body(std::size_t n, uint32_t seed) {
+  std::string s(n, '\0');
+  for (auto& ch : s) {
+    seed = seed * 1664525u + 1013904223u;
+    ch = (char)(seed >> 24);
+  }
+  return s;
+}
+
+std::string hash_of(const std::string& s) {
+  ContentHash h;
+  h.update(s.data(), s.size());
+  return h.hex();
+}
+
+std::string read_file(const std::filesystem::path& p) {
+  std::ifstream f(p, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
+struct Paths {
+  std::filesystem::path out, part, note;
+};
+
+Paths fresh_paths(const std::filesystem::path& dir, const char* name) {
+  Paths p;
+  p.out = dir / name;
+  p.part = p.out;
+  p.part += ".part";
+  p.note = p.part;
+  p.note += ".ranges";
+  std::error_code ec;
+  std::filesystem::remove(p.out, ec);
+  std::filesystem::remove(p.part, ec);
+  std::filesystem::remove(p.note, ec);
+  return p;
+}
+
+DownloadOptions options(unsigned connections) {
+  DownloadOptions opt;
+  opt.connections = connections;
+  opt.progress = false;
+  return opt;
+}
+
+// Runs a download the server cuts off and then refuses; it must fail and
+// leave a .part with its note behind.
+void interrupt(StandInServer& server, StandInServer::Config cfg, int truncated_gets, std::size_t at,
+               const Paths& p, unsigned connections) {
+  cfg.truncated_gets = truncated_gets;
+  cfg.truncate_at = at;
+  cfg.fail_after_truncation = true;
+  server.configure(cfg);
+  bool threw = false;
+  try {
+    http_download_to(server.url(), p.out, options(connections));
+  } catch (const std::exception&) {
+    threw = true;
+  }
+  CHECK(threw);
+  CHECK(std::filesystem::exists(p.part));
+  CHECK(std::filesystem::exists(p.note));
+  CHECK(!std::filesystem::exists(p.out));
+}
+
+void test_single_resume(StandInServer& server, const std::filesystem::path& dir) {
+  const Paths p = fresh_paths(dir, "single.zip");
+  StandInServer::Config cfg;
+  cfg.body = make_body(300 * 1024, 1);
+  interrupt(server, cfg, 1, 100 * 1024, p, 1);
+  CHECK(std::filesystem::file_size(p.part) == 100 * 1024);
+
+  server.configure(cfg);
+  const auto r = http_download_to(server.url(), p.out, options(1));
+  const auto gets = server.gets();
+  CHECK(gets.size() == 1);
+  CHECK(!gets.empty() && gets[0].range == "bytes=102400-");
+  CHECK(!gets.empty() && gets[0].if_range == cfg.etag);
+  CHECK(r.resumed_bytes == 100 * 1024);
+  CHECK(read_file(p.out) == cfg.body);
+  CHECK(r.content_hash == hash_of(cfg.body));
+  CHECK(!std::filesystem::exists(p.part) && !std::filesystem::exists(p.note));
+}
+
+void test_parallel_resume(StandInServer& server, const std::filesystem::path& dir) {
+  const Paths p = fresh_paths(dir, "parallel.zip");
+  StandInServer::Config cfg;
+  cfg.body = make_body(9u << 20, 2);   // above the parallel threshold
+  interrupt(server, cfg, 4, 512 * 1024, p, 4);
+
+  server.configure(cfg);
+  const auto r = http_download_to(server.url(), p.out, options(4));
+  const auto gets = server.gets();
+  CHECK(!gets.empty());
+  for (const auto& g : gets) {
+    CHECK(g.range.rfind("bytes=", 0) == 0);
+    CHECK(g.if_range == cfg.etag);
+  }
+  CHECK(r.resumed_bytes > 0);
+  CHECK(read_file(p.out) == cfg.body);
+  CHECK(r.content_hash == hash_of(cfg.body));
+}
+
+void test_part_without_note(StandInServer& server, const std::filesystem::path& dir) {
+  const Paths p = fresh_paths(dir, "nonote.zip");
+  StandInServer::Config cfg;
+  cfg.body = make_body(200 * 1024, 3);
+  {
+    std::ofstream f(p.part, std::ios::binary);
+    f << std::string(50 * 1024, 'x');   // not the file's bytes
+  }
+  server.configure(cfg);
+  const auto r = http_download_to(server.url(), p.out, options(1));
+  const auto gets = server.gets();
+  CHECK(gets.size() == 1);
+  CHECK(!gets.empty() && gets[0].range.empty());
+  CHECK(r.resumed_bytes == 0);
+  CHECK(read_file(p.out) == cfg.body);
+  CHECK(r.content_hash == hash_of(cfg.body));
+}
+
+void test_range_ignored(StandInServer& server, const std::filesystem::path& dir) {
+  // One connection: the resumed GET gets the whole file with a 200.
+  {
+    const Paths p = fresh_paths(dir, "ignored_single.zip");
+    StandInServer::Config cfg;
+    cfg.body = make_body(300 * 1024, 4);
+    interrupt(server, cfg, 1, 120 * 1024, p, 1);
+    cfg.honour_ranges = false;
+    server.configure(cfg);
+    const auto r = http_download_to(server.url(), p.out, options(1));
+    const auto gets = server.gets();
+    CHECK(!gets.empty() && !gets[0].range.empty());
+    CHECK(read_file(p.out) == cfg.body);
+    CHECK(r.content_hash == hash_of(cfg.body));
+  }
+  // Parallel: the ranges are refused and it falls back to one connection.
+  {
+    const Paths p = fresh_paths(dir, "ignored_parallel.zip");
+    StandInServer::Config cfg;
+    cfg.body = make_body(9u << 20, 5);
+    cfg.honour_ranges = false;
+    server.configure(cfg);
+    const auto r = http_download_to(server.url(), p.out, options(4));
+    const auto gets = server.gets();
+    bool whole = false;   // the single-connection retry (range GETs may be logged after it)
+    for (const auto& g : gets) whole = whole || g.range.empty();
+    CHECK(whole);
+    CHECK(read_file(p.out) == cfg.body);
+    CHECK(r.content_hash == hash_of(cfg.body));
+  }
+}
+
+void test_validator_mismatch(StandInServer& server, const std::filesystem::path& dir) {
+  // The file changed and HEAD says so: the .part is not resumed at all.
+  {
+    const Paths p = fresh_paths(dir, "changed.zip");
+    StandInServer::Config cfg;
+    cfg.body = make_body(300 * 1024, 6);
+    interrupt(server, cfg, 1, 100 * 1024, p, 1);
+    cfg.body = make_body(300 * 1024, 7);
+    cfg.etag = "\"v2\"";
+    server.configure(cfg);
+    const auto r = http_download_to(server.url(), p.out, options(1));
+    const auto gets = server.gets();
+    CHECK(gets.size() == 1);
+    CHECK(!gets.empty() && gets[0].range.empty());
+    CHECK(r.resumed_bytes == 0);
+    CHECK(read_file(p.out) == cfg.body);
+    CHECK(r.content_hash == hash_of(cfg.body));
+  }
+  // HEAD still reports the old version, but If-Range makes the server send
+  // the new file whole; the stale prefix must not survive.
+  {
+    const Paths p = fresh_paths(dir, "if_range.zip");
+    StandInServer::Config cfg;
+    cfg.body = make_body(300 * 1024, 8);
+    interrupt(server, cfg, 1, 100 * 1024, p, 1);
+    cfg.head_etag = cfg.etag;
+    cfg.body = make_body(300 * 1024, 9);
+    cfg.etag = "\"v2\"";
+    server.configure(cfg);
+    const auto r = http_download_to(server.url(), p.out, options(1));
+    const auto gets = server.gets();
+    CHECK(gets.size() == 1);
+    CHECK(!gets.empty() && gets[0].range == "bytes=102400-" && gets[0].if_range == "\"v1\"");
+    CHECK(read_file(p.out) == cfg.body);
+    CHECK(r.content_hash == hash_of(cfg.body));
+  }
+}
+
+} // namespace
+
+int main() {
+  // The stand-in server is local; a proxy from the environment must not get it.
+  ::setenv("NO_PROXY", "127.0.0.1", 1);
+  ::setenv("no_proxy", "127.0.0.1", 1);
+
+  const auto dir = std::filesystem::temp_directory_path() /
+                   ("dist2land_http_test_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+
+  {
+    StandInServer server;
+    const struct {
+      const char* name;
+      void (*run)(StandInServer&, const std::filesystem::path&);
+    } tests[] = {
+      {"single_resume", test_single_resume},
+      {"parallel_resume", test_parallel_resume},
+      {"part_without_note", test_part_without_note},
+      {"range_ignored", test_range_ignored},
+      {"validator_mismatch", test_validator_mismatch},
+    };
+    for (const auto& t : tests) {
+      const int before = g_failures;
+      try {
+        t.run(server, dir);
+      } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s: unexpected exception: %s\n", t.name, e.what());
+        ++g_failures;
+      }
+      std::printf("%s: %s\n", t.name, g_failures == before ? "ok" : "FAILED");
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  if (g_failures) {
+    std::fprintf(stderr, "%d check(s) failed\n", g_failures);
+    return 1;
+  }
+  std::printf("http_download: all checks passed\n");
+  return 0;
+}